@@ -0,0 +1,90 @@
+#pragma once
+
+// Copyright © 2026 Michael Thornburgh
+// SPDX-License-Identifier: MIT
+
+// AsyncResolver performs Address::lookup()s (or a substitute lookup function)
+// on a small pool of worker threads so the RunLoop isn't blocked waiting for
+// a slow resolver. Results are delivered on the RunLoop's thread. Successful
+// and failed lookups are cached for a configurable time, and concurrent
+// queries for the same name are coalesced into one lookup.
+
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Address.hpp"
+#include "Performer.hpp"
+
+namespace com { namespace zenomt { namespace rtmfp {
+
+class AsyncResolver : public Object {
+public:
+	AsyncResolver(RunLoop *runloop, size_t numWorkers = 2);
+	~AsyncResolver();
+
+	// err is from getaddrinfo(3), 0 on success.
+	using onresult_f = std::function<void(const std::vector<Address> &addresses, int err)>;
+
+	// called on a worker thread. same signature as Address::lookup(), which is the default.
+	using lookup_f = std::function<std::vector<Address>(const char *hostname, const char *servname, int *err, int ai_flags, int ai_family, int ai_protocol)>;
+	void setLookupFunction(const lookup_f &lookup);
+
+	// TTLs of 0 disable that cache. defaults are 60 seconds positive and 5 seconds negative.
+	void setCacheTTL(Duration positiveTTL, Duration negativeTTL);
+	void setMaxCacheEntries(size_t maxEntries);
+	size_t getCacheSize() const;
+	void flushCache();
+
+	// onresult is always called later on the RunLoop, even when answered from the cache.
+	void resolve(const std::string &hostname, const std::string &servname, const onresult_f &onresult,
+		int ai_flags = 0, int ai_family = PF_UNSPEC, int ai_protocol = IPPROTO_UDP);
+
+	// stop the workers (waiting for any lookups in progress) and drop any pending results.
+	void close();
+
+protected:
+	struct Query {
+		std::string m_hostname;
+		std::string m_servname;
+		int m_flags;
+		int m_family;
+		int m_protocol;
+
+		bool operator< (const Query &rhs) const;
+	};
+
+	struct CacheEntry {
+		std::vector<Address> m_addresses;
+		int m_err;
+		Time m_expires;
+	};
+
+	void workerLoop();
+	void onLookupComplete(const Query &query, const std::vector<Address> &addresses, int err);
+	void addToCache(const Query &query, const std::vector<Address> &addresses, int err);
+
+	RunLoop *m_runloop;
+	std::shared_ptr<Performer> m_performer;
+	std::shared_ptr<bool> m_open;
+	Duration m_positiveTTL { 60.0 };
+	Duration m_negativeTTL { 5.0 };
+	size_t m_maxCacheEntries { 1024 };
+	std::map<Query, CacheEntry> m_cache;
+	std::map<Query, std::vector<onresult_f>> m_pending;
+
+	std::mutex m_mutex; // protects below
+	std::condition_variable m_cond;
+	bool m_closing { false };
+	lookup_f m_lookup;
+	std::queue<Query> m_queue;
+	std::vector<std::thread> m_workers;
+};
+
+} } } // namespace com::zenomt::rtmfp
@@ -3,10 +3,36 @@
 // Copyright © 2022 Michael Thornburgh
 // SPDX-License-Identifier: MIT
 
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
 #include "Timer.hpp"
 
 namespace com { namespace zenomt {
 
+// A snapshot of a TCP connection's state (from TCP_INFO on Linux). Fields the
+// platform doesn't know are 0.
+struct TCPInfo {
+	Time     m_time { 0 };           // when sampled, in the platform's time
+	Duration m_rtt { 0 };            // smoothed
+	Duration m_rttVariance { 0 };
+	Duration m_minRTT { 0 };
+	uint32_t m_mss { 0 };            // sending
+	uint32_t m_cwnd { 0 };           // segments
+	uint32_t m_ssthresh { 0 };       // segments
+	uint32_t m_unacked { 0 };        // segments sent and not yet acknowledged
+	uint32_t m_retransmits { 0 };    // total segments retransmitted
+	uint32_t m_lost { 0 };           // segments currently presumed lost
+	uint32_t m_notsentBytes { 0 };   // accepted from us, not yet sent
+	uint64_t m_bytesInFlight { 0 };  // estimate
+	uint64_t m_deliveryRate { 0 };   // bytes per second, recent
+	uint64_t m_pacingRate { 0 };     // bytes per second
+	uint64_t m_bytesSent { 0 };      // including retransmissions
+	uint64_t m_bytesAcked { 0 };
+	uint64_t m_bytesReceived { 0 };
+};
+
 class IStreamPlatformAdapter {
 public:
 	virtual ~IStreamPlatformAdapter() {}
@@ -21,17 +47,61 @@ public:
 	using onreceivebytes_f = std::function<bool(const void *bytes, size_t len)>;
 	virtual void setOnReceiveBytesCallback(const onreceivebytes_f &onreceivebytes) = 0;
 
+	// answer true if the bytes given to onreceivebytes are scratch memory that the callback may
+	// modify in place (for example to unmask them) until it returns. the default answers false.
+	virtual bool isReceiveBufferWritable() { return false; }
+
 	virtual void setOnStreamDidCloseCallback(const Task &onstreamdidclose) = 0;
 
 	// perform a task "later", as long as onClosed() was not called, or
 	// as long as the platform otherwise knows the client is still operating.
 	virtual void doLater(const Task &task) = 0;
 
-	// only called (and at most once) from onwritable(). answer true on success,
-	// false on failure (like no longer open). implementation MUST support receiving
-	// (and if necessary buffering) any length of write.
+	// only called from onwritable(), usually once, or a few times with writeSharedBytes() to
+	// write a gather list in order. answer true on success, false on failure (like no longer
+	// open). implementation MUST support receiving (and if necessary buffering) any length of write.
 	virtual bool writeBytes(const void *bytes, size_t len) = 0;
 
+	// like writeBytes(), but the bytes aren't copied if the implementation can avoid it. owner
+	// keeps bytes alive, and they MUST NOT be modified, until the implementation releases owner.
+	// the default implementation just calls writeBytes().
+	virtual bool writeSharedBytes(const std::shared_ptr<const void> &owner, const void *bytes, size_t len) { return writeBytes(bytes, len); }
+
+	// like writeBytes(), but send len bytes of the open file fd starting at offset, in order
+	// with the other writes. the implementation might send directly from the file (like with
+	// sendfile(2)); fd can be closed as soon as this returns, but the range MUST NOT change
+	// until it's sent. the default implementation reads the range and calls writeBytes().
+	virtual bool writeFileRange(int fd, int64_t offset, size_t len)
+	{
+#ifdef _WIN32
+		return false;
+#else
+		uint8_t buf[16384];
+		while(len)
+		{
+			ssize_t rv = ::pread(fd, buf, len < sizeof(buf) ? len : sizeof(buf), offset);
+			if((rv <= 0) or not writeBytes(buf, rv))
+				return false;
+			offset += rv;
+			len -= rv;
+		}
+		return true;
+#endif
+	}
+
+	// answer the number of bytes written but not yet sent. if includeOS, also count bytes the OS
+	// has accepted but the peer hasn't acknowledged yet (sent or not), if known. the default
+	// implementation doesn't queue.
+	virtual size_t getQueuedByteCount(bool includeOS = false) { return 0; }
+
+	// call task once, later, when getQueuedByteCount(false) is at most threshold. replaces any
+	// previous notification. the default implementation calls it at the next doLater().
+	virtual void notifyWhenQueuedBelow(size_t threshold, const Task &task) { doLater(task); }
+
+	// fill in dst with the current state of the connection and answer true, or answer false
+	// if not available. the default implementation answers false.
+	virtual bool getTCPInfo(TCPInfo *dst) { return false; }
+
 	// Called when the protocol has concluded and has no more data to send, including
 	// on error or flush of all messages.
 	virtual void onClientClosed() = 0;
@@ -0,0 +1,96 @@
+#pragma once
+
+// Copyright © 2026 Michael Thornburgh
+// SPDX-License-Identifier: MIT
+
+// PackedAddress is a compact (20 byte) value type for holding many addresses
+// in tables, such as candidate and peer lists. Unlike Address, it isn't an
+// Object and doesn't hold a whole sockaddr. IPv4 addresses are stored as
+// IPv4-mapped IPv6 addresses (::ffff:a.b.c.d), along with the port in network
+// byte order, the family, and the Origin. Comparison and hashing are on
+// family, address, and port (like Address), not origin.
+
+#include <cstring>
+#include <functional>
+
+#include "Address.hpp"
+
+namespace com { namespace zenomt { namespace rtmfp {
+
+class PackedAddress {
+public:
+	enum Family {
+		FAMILY_NONE = 0,
+		FAMILY_IPV4 = 1,
+		FAMILY_IPV6 = 2
+	};
+
+	PackedAddress() : m_ip(), m_port(), m_family(FAMILY_NONE), m_origin(Address::ORIGIN_UNKNOWN) {}
+	PackedAddress(const Address &addr) { setAddress(addr); }
+	PackedAddress(const struct sockaddr *addr, Address::Origin origin = Address::ORIGIN_UNKNOWN) { setSockaddr(addr, origin); }
+
+	void setAddress(const Address &addr);
+	Address getAddress() const;
+
+	bool setSockaddr(const struct sockaddr *addr, Address::Origin origin = Address::ORIGIN_UNKNOWN);
+	size_t getSockaddr(struct sockaddr *dst) const; // dst must have room for Address::in_sockaddr, answer length or 0 if none
+
+	int getFamily() const; // AF_INET, AF_INET6, or 0
+	unsigned getPort() const { return (unsigned(m_port[0]) << 8) + m_port[1]; }
+	Address::Origin getOrigin() const { return (Address::Origin)m_origin; }
+	void setOrigin(Address::Origin origin) { m_origin = (uint8_t)origin; }
+
+	const uint8_t *getMappedIPAddressPtr() const { return m_ip; } // always 16 bytes
+
+	bool operator== (const PackedAddress &rhs) const
+	{
+		// ip, port, and family are contiguous; excludes origin
+		return 0 == memcmp(m_ip, rhs.m_ip, KEY_LENGTH);
+	}
+
+	bool operator!= (const PackedAddress &rhs) const { return not (*this == rhs); }
+
+	bool operator< (const PackedAddress &rhs) const
+	{
+		// same order as Address: family, then address, then port. ip and port are big-endian
+		// so can be compared together bytewise.
+		if(m_family != rhs.m_family)
+			return m_family < rhs.m_family;
+		return memcmp(m_ip, rhs.m_ip, sizeof(m_ip) + sizeof(m_port)) < 0;
+	}
+
+	size_t hash() const
+	{
+		uint64_t w0, w1;
+		uint32_t w2 = 0;
+		memcpy(&w0, m_ip, sizeof(w0));
+		memcpy(&w1, m_ip + 8, sizeof(w1));
+		memcpy(&w2, m_port, 3); // port and family
+
+		uint64_t h = (w0 ^ (w1 * 0x9e3779b97f4a7c15ULL)) + w2;
+		h ^= h >> 32;
+		h *= 0xd6e8feca66d9a5f5ULL;
+		h ^= h >> 29;
+		return (size_t)h;
+	}
+
+protected:
+	static const size_t KEY_LENGTH = 16 + 2 + 1; // ip + port + family
+
+	uint8_t m_ip[16];
+	uint8_t m_port[2];
+	uint8_t m_family;
+	uint8_t m_origin;
+};
+
+static_assert(sizeof(PackedAddress) == 20, "PackedAddress should be 20 bytes");
+
+} } } // namespace com::zenomt::rtmfp
+
+namespace std {
+
+template <> struct hash<com::zenomt::rtmfp::PackedAddress> {
+	size_t operator() (const com::zenomt::rtmfp::PackedAddress &addr) const { return addr.hash(); }
+};
+
+} // namespace std
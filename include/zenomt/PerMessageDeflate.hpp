@@ -0,0 +1,99 @@
+#pragma once
+
+// Copyright © 2026 Michael Thornburgh
+// SPDX-License-Identifier: MIT
+
+// permessage-deflate (RFC 7692) for SimpleWebSocket, using zlib. Only built if zlib is available.
+
+#include <map>
+
+#include "SimpleWebSocket.hpp"
+
+struct z_stream_s;
+
+namespace com { namespace zenomt { namespace websock {
+
+// "server" and "client" are the roles in the WebSocket, so for a client the server settings
+// are what it asks of the server, and the client settings are its own compression.
+struct DeflateOptions {
+	int    m_serverMaxWindowBits { 15 };         // the server's compression window, 9..15
+	int    m_clientMaxWindowBits { 15 };         // the client's, if it lets the server limit it. 9..15
+	bool   m_serverNoContextTakeover { true };   // the server compresses each message on its own, so nothing is kept between messages
+	bool   m_clientNoContextTakeover { true };   // the client does the same
+	int    m_memLevel { 8 };                     // zlib memLevel, 1..9
+	int    m_compressionLevel { 6 };             // zlib level, 1..9
+	size_t m_minCompressSize { 64 };             // smaller messages are sent uncompressed
+	size_t m_maxMemory { 0 };                    // limit on zlib state for one connection, 0 for none
+};
+
+// Idle zlib streams shared by the PerMessageDeflates on one RunLoop. Without context takeover
+// a stream is only needed while a message is being (de)compressed, so mostly idle connections
+// hold none, and busy ones don't pay to set one up for every message. Not thread-safe; use one
+// per RunLoop.
+class DeflatePool : public Object {
+public:
+	DeflatePool(size_t maxIdlePerKind = 16);
+	~DeflatePool();
+
+	DeflatePool(const DeflatePool&) = delete;
+
+	size_t getIdleCount() const;
+
+protected:
+	friend class PerMessageDeflate;
+
+	// answer a reset stream of this kind, or nullptr if there isn't one idle.
+	z_stream_s *acquire(bool deflater, int windowBits, int memLevel, int level);
+	// take stream back (it's reset here) or free it if there are enough of its kind idle.
+	void release(z_stream_s *stream, bool deflater, int windowBits, int memLevel, int level);
+
+	size_t m_maxIdlePerKind;
+	std::map<int, std::vector<z_stream_s *>> m_idle;
+};
+
+class PerMessageDeflate : public WebSocketCompression {
+public:
+	PerMessageDeflate(const DeflateOptions &options, const std::shared_ptr<DeflatePool> &pool = nullptr);
+	~PerMessageDeflate();
+
+	std::string negotiate(const std::string &offers) override;
+	bool compress(const uint8_t *bytes, size_t len, Bytes &dst) override;
+	bool decompress(const uint8_t *bytes, size_t len, Bytes &dst, size_t maxLen) override;
+
+	// for a client. accept() fails for anything not allowed by the offer.
+	std::string offer() override;
+	bool accept(const std::string &response) override;
+
+	// the parameters agreed in negotiate() or accept().
+	int getServerWindowBits() const;
+	int getClientWindowBits() const;
+	bool isServerNoContextTakeover() const;
+	bool isClientNoContextTakeover() const;
+
+	size_t getMemoryInUse() const; // estimated zlib state held right now
+
+	// estimated zlib state for a stream with these parameters.
+	static size_t deflateMemory(int windowBits, int memLevel);
+	static size_t inflateMemory(int windowBits);
+
+protected:
+	bool acceptOffer(const std::vector<std::pair<std::string, std::string>> &params, std::string &response);
+	bool inflateSome(const uint8_t *bytes, size_t len, Bytes &dst, size_t maxLen, bool *ended);
+	void releaseDeflater();
+	void releaseInflater();
+	int getDeflateWindowBits() const;
+	int getInflateWindowBits() const;
+
+	DeflateOptions m_options;
+	std::shared_ptr<DeflatePool> m_pool;
+	int m_serverWindowBits;
+	int m_clientWindowBits;
+	int m_memLevel;
+	bool m_serverNoContextTakeover;
+	bool m_clientNoContextTakeover;
+	bool m_client;
+	z_stream_s *m_deflater;
+	z_stream_s *m_inflater;
+};
+
+} } } // namespace com::zenomt::websock
@@ -3,11 +3,41 @@
 // Copyright © 2021 Michael Thornburgh
 // SPDX-License-Identifier: MIT
 
+#include <deque>
+
 #include "IStreamPlatformAdapter.hpp"
+#include "RateTracker.hpp"
 #include "RunLoop.hpp"
 
 namespace com { namespace zenomt {
 
+// Receive scratch buffers shared by the PosixStreamPlatformAdapters on one RunLoop. Bytes
+// are only lent to onreceivebytes for the duration of the callback, so a thread's adapters
+// normally need just one buffer among them; more are only needed if a callback causes
+// another adapter to read (for example by running the RunLoop recursively). Buffers are
+// allocated on first use. Not thread-safe; use one per RunLoop.
+class ReceiveBufferPool : public Object {
+public:
+	ReceiveBufferPool(size_t bufferSize = 65536, size_t maxBuffers = 4);
+	~ReceiveBufferPool();
+
+	ReceiveBufferPool(const ReceiveBufferPool&) = delete;
+
+	// answer a buffer of getBufferSize() bytes, or nullptr if maxBuffers are already in use.
+	uint8_t *acquire();
+	void release(uint8_t *buffer);
+
+	size_t getBufferSize() const;
+	size_t getAllocatedCount() const;
+	size_t getInUseCount() const;
+
+protected:
+	size_t m_bufferSize;
+	size_t m_maxBuffers;
+	size_t m_inUse;
+	std::vector<uint8_t *> m_free;
+};
+
 class PosixStreamPlatformAdapter : public IStreamPlatformAdapter, public Object {
 public:
 	PosixStreamPlatformAdapter(RunLoop *runloop = nullptr, int unsent_lowat = 4096, size_t writeSizePerSelect = 2048);
@@ -26,26 +56,203 @@ public:
 	Time getCurrentTime() override;
 	void notifyWhenWritable(const onwritable_f &onwritable) override;
 	void setOnReceiveBytesCallback(const onreceivebytes_f &onreceivebytes) override;
+	bool isReceiveBufferWritable() override; // true, received bytes are in a scratch buffer
 	void setOnStreamDidCloseCallback(const Task &onstreamdidclose) override;
 	void doLater(const Task &task) override;
 	bool writeBytes(const void *bytes, size_t len) override;
+	bool writeSharedBytes(const std::shared_ptr<const void> &owner, const void *bytes, size_t len) override;
+	bool writeFileRange(int fd, int64_t offset, size_t len) override; // sendfile(2) on Linux
+	size_t getQueuedByteCount(bool includeOS = false) override; // OS count is SIOCOUTQ (unacknowledged) on Linux
+	void notifyWhenQueuedBelow(size_t threshold, const Task &task) override;
+	bool getTCPInfo(TCPInfo *dst) override; // Linux
 	void onClientClosed() override;
 
+	size_t getOutputQueueSize() const; // bytes written but not yet sent to the socket
+
+	// receive into buffers borrowed from pool instead of a buffer of our own. if the pool has
+	// none available, a private buffer is allocated. set before any reading happens.
+	void setReceiveBufferPool(const std::shared_ptr<ReceiveBufferPool> &pool);
+	bool hasPrivateReceiveBuffer() const;
+
+	// by default each readable event does one read of up to 64 KiB. with a budget, keep reading
+	// (and delivering) until the socket is drained or at least budget bytes were read in this
+	// event. 0 restores the default. with a budget or a pool, private reads start small and
+	// grow while they're filled.
+	void setReadBudget(size_t budget);
+
+	// when draining, use FIONREAD to size reads and to find out that the socket is drained
+	// without a read that fails with EAGAIN. costs an ioctl per read.
+	void setUseFIONREAD(bool use);
+
+	// set SO_RCVLOWAT so readable isn't signaled until at least lowat bytes are available.
+	// answer true on success. call after setSocketFd().
+	bool setReceiveLowWatermark(int lowat);
+
+	// adjust unsent_lowat (TCP_NOTSENT_LOWAT) and writeSizePerSelect from the connection's
+	// RTT, congestion window, and delivery rate (TCP_INFO, Linux), so the kernel holds just
+	// enough unsent data to keep the pipe full. the values given at construction are used
+	// until there's a measurement.
+	void setAutoTune(bool enable);
+	int getUnsentLowat() const;
+	size_t getWriteSizePerSelect() const;
+
+	static void computeAutoTuneSizes(Duration rtt, double bytesPerSecond, size_t mss, size_t *unsentLowat, size_t *writeSizePerSelect);
+
+	// sample getTCPInfo() every interval into a ring of the most recent capacity samples,
+	// calling onTCPInfoSample (if set) with each.
+	void startTCPInfoSampling(Duration interval, size_t capacity = 64);
+	void stopTCPInfoSampling();
+	std::vector<TCPInfo> getTCPInfoHistory() const; // oldest first
+	std::function<void(const TCPInfo &info)> onTCPInfoSample;
+
+	// limit output to bytesPerSecond (0 for unlimited) to smooth bursts. a TCP socket is paced
+	// by the kernel with SO_MAX_PACING_RATE (Linux) unless allowKernel is false; otherwise
+	// sends are metered by a token bucket refilled by a RunLoop timer. answer true if the
+	// kernel is pacing. call after setSocketFd().
+	bool setPacingRate(double bytesPerSecond, bool allowKernel = true);
+	double getPacingRate() const;
+	bool isKernelPacing() const;
+
+	// pace at gain times the connection's delivery rate (TCP_INFO, Linux), re-estimated
+	// periodically while sending. a gain a little above 1 leaves room to find more
+	// bandwidth. 0 stops estimating; the last rate stays in effect.
+	void setEstimatedPacing(double gain, bool allowKernel = true);
+
+	double getAchievedRate() const; // bytes per second sent to the socket, recently
+
+	// when notifyWhenWritable() is called with nothing queued, assume the socket is writable
+	// and try sending from a doLater in the same RunLoop cycle, instead of waiting for the
+	// RunLoop to report writable. falls back to waiting for writable if the socket's buffer
+	// fills up or onwritable has more to write. saves a RunLoop cycle and several system
+	// calls for each request/response.
+	void setOptimisticWrites(bool enable);
+
+	// accumulate output written during a RunLoop cycle (including from notifyWhenWritable())
+	// and send it all at the end of the cycle, from a PREPARE cycle observer, instead of
+	// waiting for writable. output needing more than one sendmsg() is sent with MSG_MORE on
+	// all but the last, so the kernel can fill whole segments. for many small writes per cycle.
+	void setCorked(bool corked);
+
+	struct IOStats {
+		uint64_t m_readableEvents;
+		uint64_t m_readCalls;
+		uint64_t m_readBytes;
+		uint64_t m_ioctlCalls;
+		uint64_t m_writableEvents;
+		uint64_t m_writeCalls;
+		uint64_t m_writeBytes;
+		uint64_t m_optimisticWrites; // sends tried without waiting for writable
+		uint64_t m_corkedFlushes;
+	};
+	IOStats getIOStats() const;
+
+	// opt in to sending output segments of at least threshold bytes with MSG_ZEROCOPY (Linux).
+	// the kernel sends from the segment's memory, so it (and its owner) is kept until the kernel
+	// reports completion on the socket's error queue, even past close(), which leaves the
+	// socket open (on the run loop) until then, or until the linger timeout, when the connection
+	// is reset and the owners released. 0 disables. answer true if enabled.
+	// call after setSocketFd(). only worthwhile for large writes (typically tens of KB and
+	// up); loopback and some devices always fall back to copying.
+	bool setZeroCopyThreshold(size_t threshold);
+
+	struct ZeroCopyStats {
+		uint64_t m_sends;       // sendmsg()s with MSG_ZEROCOPY
+		uint64_t m_completions; // sends the kernel is done with
+		uint64_t m_copied;      // completions where the kernel copied anyway
+	};
+	ZeroCopyStats getZeroCopyStats() const;
+	size_t getPinnedSegmentCount() const; // segments waiting for zerocopy completion
+	void setZeroCopyLingerTimeout(Duration timeout); // default 60 seconds
+
 protected:
+	struct OutputSegment {
+		std::shared_ptr<const void> m_owner; // keeps m_bytes alive
+		const uint8_t *m_bytes;
+		size_t m_len;
+		std::vector<uint8_t> *m_copy; // our own copied bytes (owned by m_owner) that can be appended to, or nullptr
+		int m_file; // if not negative, send m_len bytes of this file (owned by m_owner) instead of m_bytes
+		int64_t m_fileOffset;
+		bool m_pread; // sendfile(2) refused this file, so read it and send
+	};
+
 	void onInterfaceReadable();
 	void onInterfaceWritable();
+	void onOptimisticWritable();
+	void scheduleCorkFlush();
+	void onCorkFlush();
+	void processWritable();
 	void closeIfDone();
 	void tryRegisterReadable();
 	void tryRegisterWritable();
+	void tryRegisterException();
+	void checkQueuedBelow();
+	void autoTune();
+	void onTCPInfoSampleTimer();
+	void applyPacingRate(double bytesPerSecond);
+	void estimatePacingRate();
+	bool isTokenPacing() const;
+	size_t getPacingAllowance();
+	bool isPacingThrottled();
+	void waitForPacingTokens();
+	uint8_t *getPrivateReceiveBuffer(size_t size);
+	ssize_t readAndDeliver(size_t wanted, bool &filled);
+	void adaptReadSize(size_t rv, size_t requested);
+	bool sendOutputChain();
+	void consumeOutput(size_t len);
+	bool isZeroCopyEligible(const OutputSegment &segment) const;
+	bool isGatherable(const OutputSegment &segment) const;
+	bool sendFileSegment(size_t limit);
+	bool sendZeroCopy(size_t limit);
+	using ZeroCopyPinned = std::deque<std::pair<uint32_t, std::shared_ptr<const void>>>; // by send sequence number
+	void reapZeroCopyCompletions();
+	static void reapZeroCopyCompletions(int fd, ZeroCopyPinned &pinned, ZeroCopyStats &stats);
+	void lingerForZeroCopy();
+	static void abortZeroCopySocket(int fd);
+	void onInterfaceException();
 
 	bool m_clientOpen;
 	bool m_shutdown;
 	RunLoop *m_runloop;
 	int m_fd;
-	uint8_t *m_inputBuffer;
+	uint8_t *m_inputBuffer; // private, allocated only when needed
+	size_t m_inputBufferSize;
+	size_t m_readSize;
+	size_t m_readBudget;
+	bool m_useFIONREAD;
+	std::shared_ptr<ReceiveBufferPool> m_receiveBufferPool;
 	int m_unsent_lowat;
 	size_t m_writeSizePerSelect;
-	std::vector<uint8_t> m_outputBuffer;
+	bool m_writableRegistered;
+	bool m_optimisticWrites;
+	bool m_optimisticPending;
+	bool m_corked;
+	std::shared_ptr<RunLoop::CycleObserver> m_corkFlush;
+	std::deque<OutputSegment> m_outputChain;
+	size_t m_outputBytes;
+	bool m_sendfileUnsupported; // for every file
+	bool m_autoTune;
+	Time m_lastAutoTune;
+	std::shared_ptr<Timer> m_tcpInfoTimer;
+	std::vector<TCPInfo> m_tcpInfoRing;
+	size_t m_tcpInfoNext;
+	size_t m_tcpInfoCapacity;
+	double m_pacingRate;
+	bool m_pacingAllowKernel;
+	bool m_kernelPacing;
+	double m_pacingGain;
+	Time m_lastPacingEstimate;
+	double m_pacingTokens;
+	Time m_pacingRefilled;
+	std::shared_ptr<Timer> m_pacingTimer;
+	RateTracker m_sendRate;
+	size_t m_zerocopyThreshold;
+	uint32_t m_zerocopyNextSeq;
+	Duration m_zerocopyLingerTimeout;
+	ZeroCopyPinned m_zerocopyPinned;
+	ZeroCopyStats m_zerocopyStats;
+	IOStats m_ioStats;
+	size_t m_queuedBelowThreshold;
+	Task m_onqueuedbelow;
 	onwritable_f m_onwritable;
 	onreceivebytes_f m_onreceivebytes;
 	Task m_onstreamdidclose;
@@ -0,0 +1,389 @@
+#pragma once
+
+// Copyright © 2026 Michael Thornburgh
+// SPDX-License-Identifier: MIT
+
+// PrefixTable<T> maps CIDR prefixes (like 10.0.0.0/8 or 2001:db8::/32) to
+// values of type T and answers the value for the longest prefix matching an
+// Address. IPv4 prefixes are held as IPv4-mapped IPv6 prefixes (::ffff:0:0/96),
+// so IPv4 addresses and IPv4-mapped IPv6 addresses match them equally. The
+// prefixes are kept in a path-compressed binary trie whose nodes are stored
+// contiguously.
+//
+// ConcurrentPrefixTable<T> holds a published PrefixTable<T> that can be read
+// from any number of threads without locking while a writer builds and
+// publishes a replacement (read-copy-update style). Readers never block; a
+// publishing writer waits for readers of the table it's about to reuse to
+// finish.
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "PackedAddress.hpp"
+
+namespace com { namespace zenomt { namespace rtmfp {
+
+template <class T> class PrefixTable {
+public:
+	PrefixTable() { clear(); }
+
+	// prefixLength is in bits of prefix's family (0-32 for IPv4, 0-128 for IPv6). any bits
+	// of prefix beyond prefixLength are ignored. answer false if the prefix is invalid.
+	// replaces the value if prefix is already in the table.
+	bool add(const Address &prefix, unsigned prefixLength, const T &value)
+	{
+		Key key;
+		unsigned length;
+		if(not makeKey(prefix, prefixLength, key, length))
+			return false;
+
+		m_entries[std::make_pair(key, length)] = value;
+		insert(key, length, value);
+		return true;
+	}
+
+	// add a prefix in CIDR notation like "192.0.2.0/24" or "2001:db8::/32". a bare address
+	// is a host prefix (/32 or /128).
+	bool add(const char *cidr, const T &value)
+	{
+		Address prefix;
+		unsigned prefixLength;
+		if(not parseCIDR(cidr, prefix, prefixLength))
+			return false;
+		return add(prefix, prefixLength, value);
+	}
+
+	bool remove(const Address &prefix, unsigned prefixLength)
+	{
+		Key key;
+		unsigned length;
+		if((not makeKey(prefix, prefixLength, key, length)) or (0 == m_entries.erase(std::make_pair(key, length))))
+			return false;
+		rebuild();
+		return true;
+	}
+
+	bool remove(const char *cidr)
+	{
+		Address prefix;
+		unsigned prefixLength;
+		return parseCIDR(cidr, prefix, prefixLength) and remove(prefix, prefixLength);
+	}
+
+	void clear()
+	{
+		m_entries.clear();
+		rebuild();
+	}
+
+	size_t size() const { return m_entries.size(); }
+	bool empty() const { return m_entries.empty(); }
+
+	// answer the value of the longest matching prefix, or nullptr if none match. if
+	// matchedLength isn't nullptr, it's set to the length of the matching prefix in bits
+	// of addr's family. an IPv6 prefix shorter than /96 (like ::/0) also matches IPv4
+	// addresses, which counts as 0 bits of IPv4.
+	const T * lookup(const PackedAddress &addr, unsigned *matchedLength = nullptr) const
+	{
+		if(0 == addr.getFamily())
+			return nullptr;
+
+		Key key = loadKey(addr.getMappedIPAddressPtr());
+		const Node *best = nullptr;
+		int32_t cursor = 0;
+
+		while(cursor >= 0)
+		{
+			const Node &node = m_nodes[cursor];
+			if(not prefixMatches(key, node.m_key, node.m_length))
+				break;
+			if(node.m_value >= 0)
+				best = &node;
+			if(node.m_length >= 128)
+				break;
+			cursor = node.m_children[getBit(key, node.m_length)];
+		}
+
+		if(not best)
+			return nullptr;
+
+		if(matchedLength)
+		{
+			if(AF_INET == addr.getFamily())
+				*matchedLength = best->m_length > 96 ? best->m_length - 96 : 0;
+			else
+				*matchedLength = best->m_length;
+		}
+		return &m_values[best->m_value];
+	}
+
+	const T * lookup(const Address &addr, unsigned *matchedLength = nullptr) const
+	{
+		return lookup(PackedAddress(addr), matchedLength);
+	}
+
+	static bool parseCIDR(const char *cidr, Address &prefix, unsigned &prefixLength)
+	{
+		char tmp[Address::MAX_PRESENTATION_LENGTH];
+		const char *slash = strchr(cidr, '/');
+		size_t addrLength = slash ? size_t(slash - cidr) : strlen(cidr);
+		if(addrLength >= sizeof(tmp))
+			return false;
+		memcpy(tmp, cidr, addrLength);
+		tmp[addrLength] = 0;
+
+		if(not prefix.setFromPresentation(tmp, false))
+			return false;
+
+		prefixLength = (AF_INET == prefix.getFamily()) ? 32 : 128;
+		if(slash)
+		{
+			char *end = nullptr;
+			unsigned long length = strtoul(slash + 1, &end, 10);
+			if((end == slash + 1) or *end or (length > prefixLength))
+				return false;
+			prefixLength = length;
+		}
+
+		return true;
+	}
+
+protected:
+	using Key = std::pair<uint64_t, uint64_t>; // most significant half first
+
+	struct Node {
+		Key m_key;
+		unsigned m_length;
+		int32_t m_value;
+		int32_t m_children[2];
+	};
+
+	static Key loadKey(const uint8_t *ip)
+	{
+		Key rv(0, 0);
+		for(int x = 0; x < 8; x++)
+		{
+			rv.first = (rv.first << 8) | ip[x];
+			rv.second = (rv.second << 8) | ip[x + 8];
+		}
+		return rv;
+	}
+
+	static uint64_t mask64(unsigned length)
+	{
+		return length >= 64 ? ~uint64_t(0) : length ? ~uint64_t(0) << (64 - length) : 0;
+	}
+
+	static Key maskKey(const Key &key, unsigned length)
+	{
+		return Key(key.first & mask64(length), key.second & mask64(length > 64 ? length - 64 : 0));
+	}
+
+	static bool prefixMatches(const Key &key, const Key &prefix, unsigned length)
+	{
+		return 0 == ( ((key.first ^ prefix.first) & mask64(length))
+		            | ((key.second ^ prefix.second) & mask64(length > 64 ? length - 64 : 0)) );
+	}
+
+	static int getBit(const Key &key, unsigned index)
+	{
+		return index < 64 ? (key.first >> (63 - index)) & 1 : (key.second >> (127 - index)) & 1;
+	}
+
+	static unsigned commonPrefixLength(const Key &a, const Key &b, unsigned limit)
+	{
+		unsigned rv = 0;
+		while((rv < limit) and (getBit(a, rv) == getBit(b, rv)))
+			rv++;
+		return rv;
+	}
+
+	static bool makeKey(const Address &prefix, unsigned prefixLength, Key &key, unsigned &length)
+	{
+		PackedAddress packed(prefix);
+		switch(packed.getFamily())
+		{
+		case AF_INET:
+			if(prefixLength > 32)
+				return false;
+			length = prefixLength + 96;
+			break;
+		case AF_INET6:
+			if(prefixLength > 128)
+				return false;
+			length = prefixLength;
+			break;
+		default:
+			return false;
+		}
+
+		key = maskKey(loadKey(packed.getMappedIPAddressPtr()), length);
+		return true;
+	}
+
+	int32_t newNode(const Key &key, unsigned length, int32_t value)
+	{
+		Node node;
+		node.m_key = key;
+		node.m_length = length;
+		node.m_value = value;
+		node.m_children[0] = node.m_children[1] = -1;
+		m_nodes.push_back(node);
+		return int32_t(m_nodes.size() - 1);
+	}
+
+	int32_t newValue(const T &value)
+	{
+		m_values.push_back(value);
+		return int32_t(m_values.size() - 1);
+	}
+
+	void insert(const Key &key, unsigned length, const T &value)
+	{
+		int32_t cursor = 0; // the root, /0, which is a prefix of everything
+
+		while(true)
+		{
+			// invariant: node at cursor is a prefix of key and no longer than length.
+			if(m_nodes[cursor].m_length == length)
+			{
+				if(m_nodes[cursor].m_value >= 0)
+					m_values[m_nodes[cursor].m_value] = value;
+				else
+				{
+					int32_t valueIndex = newValue(value);
+					m_nodes[cursor].m_value = valueIndex;
+				}
+				return;
+			}
+
+			int bit = getBit(key, m_nodes[cursor].m_length);
+			int32_t child = m_nodes[cursor].m_children[bit];
+
+			if(child < 0)
+			{
+				int32_t leaf = newNode(key, length, newValue(value));
+				m_nodes[cursor].m_children[bit] = leaf;
+				return;
+			}
+
+			Key childKey = m_nodes[child].m_key;
+			unsigned childLength = m_nodes[child].m_length;
+			unsigned common = commonPrefixLength(key, childKey, std::min(length, childLength));
+
+			if(common == childLength)
+			{
+				cursor = child; // child is a prefix of key, descend
+				continue;
+			}
+
+			if(common == length)
+			{
+				// key is a prefix of child; insert it between cursor and child.
+				int32_t node = newNode(key, length, newValue(value));
+				m_nodes[node].m_children[getBit(childKey, length)] = child;
+				m_nodes[cursor].m_children[bit] = node;
+				return;
+			}
+
+			// key and child diverge at common; split with a valueless branch node.
+			int32_t branch = newNode(maskKey(key, common), common, -1);
+			int32_t leaf = newNode(key, length, newValue(value));
+			m_nodes[branch].m_children[getBit(childKey, common)] = child;
+			m_nodes[branch].m_children[getBit(key, common)] = leaf;
+			m_nodes[cursor].m_children[bit] = branch;
+			return;
+		}
+	}
+
+	void rebuild()
+	{
+		m_nodes.clear();
+		m_values.clear();
+		newNode(Key(0, 0), 0, -1);
+
+		for(auto it = m_entries.begin(); it != m_entries.end(); it++)
+			insert(it->first.first, it->first.second, it->second);
+	}
+
+	std::map<std::pair<Key, unsigned>, T> m_entries;
+	std::vector<Node> m_nodes;
+	std::vector<T> m_values;
+};
+
+template <class T> class ConcurrentPrefixTable {
+public:
+	ConcurrentPrefixTable() : m_current(0)
+	{
+		m_readers[0] = 0;
+		m_readers[1] = 0;
+	}
+
+	ConcurrentPrefixTable(const ConcurrentPrefixTable&) = delete;
+
+	// safe from any thread, never blocks. answer true and copy the value of the longest
+	// matching prefix to dst (if not nullptr) if there is a match.
+	bool lookup(const Address &addr, T *dst, unsigned *matchedLength = nullptr) const
+	{
+		return lookup(PackedAddress(addr), dst, matchedLength);
+	}
+
+	bool lookup(const PackedAddress &addr, T *dst, unsigned *matchedLength = nullptr) const
+	{
+		int which = enterReader();
+		const T *found = m_tables[which].lookup(addr, matchedLength);
+		if(found and dst)
+			*dst = *found;
+		m_readers[which]--;
+		return found;
+	}
+
+	// answer a copy of the currently published table, for example to modify and publish.
+	PrefixTable<T> getTable() const
+	{
+		int which = enterReader();
+		PrefixTable<T> rv = m_tables[which];
+		m_readers[which]--;
+		return rv;
+	}
+
+	// replace the published table. concurrent publishers are serialized. waits (without
+	// blocking readers) for any readers still using the table published before the
+	// current one.
+	void publish(PrefixTable<T> table)
+	{
+		std::unique_lock<std::mutex> locked(m_publishMutex);
+
+		int next = 1 - m_current;
+		while(m_readers[next])
+			std::this_thread::yield();
+
+		m_tables[next] = std::move(table);
+		m_current = next;
+	}
+
+protected:
+	int enterReader() const
+	{
+		while(true)
+		{
+			int which = m_current;
+			m_readers[which]++;
+			if(which == m_current)
+				return which;
+			m_readers[which]--; // a publish got in between, try again
+		}
+	}
+
+	PrefixTable<T> m_tables[2];
+	std::atomic<int> m_current;
+	mutable std::atomic<int> m_readers[2];
+	std::mutex m_publishMutex;
+};
+
+} } } // namespace com::zenomt::rtmfp
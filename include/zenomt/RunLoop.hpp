@@ -6,6 +6,7 @@
 #include <chrono>
 #include <cmath>
 #include <queue>
+#include <vector>
 
 #include "Timer.hpp"
 
@@ -47,12 +48,40 @@ public:
 	// called every time through the run loop
 	Task onEveryCycle;
 
+	// any number of callbacks every time through the run loop. PREPARE observers are called
+	// just before waiting for descriptors and timers, after everything else in the cycle (a
+	// good place to flush output accumulated during the cycle); CHECK observers just after
+	// descriptor actions, before doLaters. observers of a phase are called in ascending
+	// order, then in the order they were added. observers added while a phase is being
+	// dispatched are first called in the next cycle (for PREPARE, without waiting first).
+	enum CyclePhase { PREPARE, CHECK, NUM_CYCLE_PHASES };
+
+	class CycleObserver : public Object {
+	public:
+		CycleObserver(const Task &task, int order);
+
+		void cancel();
+		bool isCanceled() const;
+
+	protected:
+		friend class RunLoop;
+		Task m_task;
+		int  m_order;
+		bool m_canceled;
+		bool m_firing;
+	};
+
+	std::shared_ptr<CycleObserver> addCycleObserver(CyclePhase phase, const Task &task, int order = 0);
+
 protected:
 	void cacheTime();
 	void uncacheTime();
 
 	virtual bool hasDoLaters() const;
 	virtual void processDoLaters();
+	void processCycleObservers(CyclePhase phase);
+	bool hasNewPrepareObservers() const; // added during the last PREPARE, so don't wait for them
+	void insertCycleObserver(CyclePhase phase, const std::shared_ptr<CycleObserver> &observer);
 
 	std::chrono::steady_clock::time_point m_origin;
 	Time             m_timeCache;
@@ -60,6 +89,10 @@ protected:
 	TimerList        m_timers;
 	volatile bool    m_stopping;
 	std::queue<Task> m_doLaters;
+	std::vector<std::shared_ptr<CycleObserver>> m_cycleObservers[NUM_CYCLE_PHASES];
+	std::vector<std::pair<CyclePhase, std::shared_ptr<CycleObserver>>> m_addedCycleObservers;
+	int              m_cycleObserverDepth;
+	bool             m_newPrepareObservers;
 };
 
 } } // namespace com::zenomt
@@ -4,11 +4,12 @@
 // SPDX-License-Identifier: MIT
 
 #include <cstdint>
-#include <map>
+#include <memory>
 #include <string>
 #include <vector>
 
 #include "IStreamPlatformAdapter.hpp"
+#include "Utf8.hpp"
 
 namespace com { namespace zenomt { namespace websock {
 
@@ -27,25 +28,67 @@ public:
 	Task onError;
 
 	// schedule bytes to be written. may be called at any time, but just once from
-	// the onwritable notification gives the least buffering.
-	void writeBytes(const void *bytes, size_t len);
-	void writeBytes(const Bytes &bytes);
-	void writeBytes(const std::string &s);
+	// the onwritable notification gives the least buffering. answer false if the
+	// stream is closed or the write was refused because of the queued byte limit.
+	bool writeBytes(const void *bytes, size_t len);
+	bool writeBytes(const Bytes &bytes);
+	bool writeBytes(const std::string &s);
+
+	// like writeBytes(), but bytes aren't copied; owner keeps them alive, and they MUST NOT be
+	// modified, until they're sent and owner is released. prefix (like a frame header) is
+	// copied and goes first; prefix and bytes are accepted or refused together.
+	bool writeSharedBytes(const std::shared_ptr<const void> &owner, const void *bytes, size_t len, const void *prefix = nullptr, size_t prefixLen = 0);
 
 	using onwritable_f = IStreamPlatformAdapter::onwritable_f;
 	void notifyWhenWritable(const onwritable_f &onwritable);
 
+	// bytes written but not yet sent, here and in the platform adapter (and the OS, if
+	// includeOS and the platform knows).
+	size_t getQueuedByteCount(bool includeOS = false);
+
+	// onHighWatermark is called when the queued byte count reaches high, then onLowWatermark
+	// when it drains back to low or below. 0 for high disables.
+	void setWatermarks(size_t high, size_t low);
+	Task onHighWatermark;
+	Task onLowWatermark;
+	bool isAboveHighWatermark() const;
+
+	// refuse writes that would make the queued byte count exceed maxQueued. each refused write
+	// is either dropped whole (so a protocol writing whole messages at a time stays framed) or
+	// the stream is abandoned (refusing all later writes, with onError called later from the
+	// platform's doLater()). 0 (the default) for no limit.
+	enum OverflowAction { OVERFLOW_DROP, OVERFLOW_CLOSE };
+	void setMaxQueuedBytes(size_t maxQueued, OverflowAction action = OVERFLOW_DROP);
+	size_t getDroppedByteCount() const;
+
+	// the platform's TCPInfo for this connection, if it has one.
+	bool getTCPInfo(TCPInfo *dst);
+
 protected:
 	enum State { S_OPEN, S_CLOSING, S_ERROR };
 	virtual const uint8_t * onHeaderBytes(const uint8_t *bytes, const uint8_t *limit) { return limit; }
 	virtual const uint8_t * onBodyBytes(const uint8_t *bytes, const uint8_t *limit) { return limit; }
 
+	struct SharedOutput {
+		size_t m_rawOffset; // goes after this many bytes of m_rawOutputBuffer
+		std::shared_ptr<const void> m_owner;
+		const void *m_bytes;
+		size_t m_len;
+	};
+
 	bool onReceiveBytes(const void *bytes, size_t len);
+	bool queueOutput(const void *prefix, size_t prefixLen, const std::shared_ptr<const void> &owner, const void *bytes, size_t len);
+	// append prefix and room for len more bytes (for the caller to fill in at *dst right away)
+	// to the output, if there's room for them and alsoQueued more. call commitOutput() after.
+	bool reserveOutput(const void *prefix, size_t prefixLen, size_t len, uint8_t **dst, size_t alsoQueued = 0);
+	void commitOutput();
 	virtual void clearCallbacks();
 	void setClosedState();
 	void scheduleWrite();
 	bool onWritable();
 	bool writeRawOutputBuffer();
+	void checkHighWatermark();
+	void checkLowWatermark();
 
 	std::shared_ptr<IStreamPlatformAdapter> m_platform;
 	bool m_headerComplete { false };
@@ -53,6 +96,15 @@ protected:
 	bool m_writeScheduled { false };
 	onwritable_f m_client_onwritable;
 	Bytes m_rawOutputBuffer;
+	std::vector<SharedOutput> m_sharedOutput;
+	size_t m_sharedOutputBytes { 0 };
+	size_t m_highWatermark { 0 };
+	size_t m_lowWatermark { 0 };
+	bool m_aboveHighWatermark { false };
+	size_t m_maxQueuedBytes { 0 };
+	OverflowAction m_overflowAction { OVERFLOW_DROP };
+	bool m_overflowClosing { false };
+	size_t m_droppedBytes { 0 };
 };
 
 class SimpleHttpStream : public HeaderBodyStream {
@@ -64,6 +116,10 @@ public:
 	std::string getHeader(const std::string &name) const; // for everything except "set-cookie" RFC 7230 §3.2.2
 	std::vector<std::string> getHeaderValues(const std::string &name) const; // pretty much just for "set-cookie"
 
+	// answer the value of the index'th header field called name (in any case) without allocating,
+	// as a pointer into the header block (not NUL-terminated) and its length, or nullptr.
+	const char * findHeader(const char *name, size_t *len, size_t index = 0) const;
+
 	Task onHttpHeadersReceived;
 
 	static bool isToken(const std::string &str); // answer if str is an RFC 9110 §5.6.2 token
@@ -77,49 +133,173 @@ protected:
 	void parseHeaderBlock();
 	void clearCallbacks() override;
 
+	struct HeaderField {
+		size_t m_name;        // offsets into m_headerBlock
+		size_t m_nameLength;
+		size_t m_value;       // trimmed
+		size_t m_valueLength;
+	};
+
 	bool m_gotNewline { false };
-	std::string m_headerBlock;
-	std::map<std::string, std::vector<std::string>> m_headers;
+	std::string m_headerBlock; // unfolded in place once it's complete
+	std::vector<HeaderField> m_headers; // in order received
 	std::string m_startLine;
 };
 
-// Note: a simple *server* WebSocket
+// Per-message compression for one SimpleWebSocket, negotiated with Sec-WebSocket-Extensions.
+// See PerMessageDeflate.hpp for permessage-deflate (RFC 7692). Not shared between sockets.
+class WebSocketCompression : public Object {
+public:
+	// answer the Sec-WebSocket-Extensions response value for the first acceptable offer in
+	// offers (the request's header value), or empty to decline.
+	virtual std::string negotiate(const std::string &offers) = 0;
+
+	// replace dst with the compressed message and answer true, or answer false to send this
+	// message uncompressed.
+	virtual bool compress(const uint8_t *bytes, size_t len, Bytes &dst) = 0;
+
+	// replace dst with the decompressed message. answer false if it's invalid or would be
+	// longer than maxLen.
+	virtual bool decompress(const uint8_t *bytes, size_t len, Bytes &dst, size_t maxLen) = 0;
+
+	// for a client: answer the Sec-WebSocket-Extensions value to offer (empty for none), then
+	// answer if the server's response to it is acceptable. the defaults don't offer anything.
+	virtual std::string offer() { return std::string(); }
+	virtual bool accept(const std::string &response) { return false; }
+};
+
+// A whole unmasked data frame, encoded once, that can be sent on any number of server
+// SimpleWebSockets with sendFrame() without being copied or encoded again. It's immutable,
+// so it can also be shared between threads.
+class WebSocketFrame : public Object {
+public:
+	WebSocketFrame(const void *payload, size_t len, bool isText = false);
+	explicit WebSocketFrame(const std::string &text);
+
+	WebSocketFrame(const WebSocketFrame&) = delete;
+
+	bool isText() const;
+	const uint8_t *getPayload() const;
+	size_t getPayloadLength() const;
+	const uint8_t *getEncoded() const; // header and payload together
+	size_t getEncodedLength() const;
+
+protected:
+	Bytes m_encoded;
+	size_t m_headerLength;
+	bool m_text;
+};
+
+// Note: a simple WebSocket, a server unless initClient() is used instead of init()
 class SimpleWebSocket : public SimpleHttpStream {
 public:
 	using SimpleHttpStream::SimpleHttpStream;
 
 	void sendBinaryMessage(const void *bytes, size_t len);
 	void sendBinaryMessage(const Bytes &bytes);
+	void sendBinaryMessage(const std::shared_ptr<const void> &owner, const void *bytes, size_t len); // not copied, see writeSharedBytes()
+	void sendBinaryMessage(const std::shared_ptr<const Bytes> &bytes); // not copied
 	void sendTextMessage(const std::string &message);
 
+	// queue frame as is, sharing it with everything else it's sent on. it's sent uncompressed
+	// even if compression was negotiated. a client has to mask it, so it's copied.
+	void sendFrame(const std::shared_ptr<const WebSocketFrame> &frame);
+
+	enum CloseCode {
+		CLOSE_NORMAL           = 1000,
+		CLOSE_GOING_AWAY       = 1001,
+		CLOSE_PROTOCOL_ERROR   = 1002,
+		CLOSE_INVALID_DATA     = 1007,
+		CLOSE_POLICY_VIOLATION = 1008,
+		CLOSE_MESSAGE_TOO_BIG  = 1009,
+		CLOSE_INTERNAL_ERROR   = 1011
+	};
+
 	Task onOpen;
-	std::function<void(const uint8_t *bytes, size_t len)> onBinaryMessage;
+	std::function<void(const uint8_t *bytes, size_t len)> onBinaryMessage; // bytes are only valid during the call
 	std::function<void(const std::string &message)> onTextMessage;
 
+	// set onMessageData to get data messages in pieces as their frames arrive, instead of
+	// whole with onBinaryMessage or onTextMessage. bytes are only valid during the call.
+	// compressed messages are still decompressed whole first, then given as one piece.
+	std::function<void(bool isText)> onMessageBegin;
+	std::function<void(const uint8_t *bytes, size_t len)> onMessageData;
+	Task onMessageEnd;
+
+	// fail with CLOSE_MESSAGE_TOO_BIG as soon as a frame header says a message will be longer
+	// than this. default 16MB.
+	void setMaxMessageSize(size_t maxLen);
+	size_t getMaxMessageSize() const;
+
 	void cleanClose();
+	void cleanClose(uint16_t code, const std::string &reason = std::string());
+
+	// offer compression to the client. set before the handshake; it's dropped if the
+	// client doesn't ask for it.
+	void setCompression(const std::shared_ptr<WebSocketCompression> &compression);
+	bool isCompressing() const; // answer true if compression was negotiated
 
 	virtual void sha1(void *dst, const void *msg, size_t len) = 0;
 
+	// be a client: call instead of init(). sends the upgrade request for resource (like "/chat")
+	// with host for the Host header (like "example.com:8080") and any extraHeaders (whole lines
+	// ending with CRLF), then calls onOpen if the server accepts. outgoing frames are masked.
+	bool initClient(const std::string &host, const std::string &resource, const std::string &extraHeaders = std::string());
+	bool isClient() const;
+
+	// fill dst with len unpredictable bytes, for a client's handshake key and masking keys
+	// (RFC 6455 §10.3). the default reads the operating system's CSPRNG (getrandom(2) or
+	// arc4random_buf(3)) a buffer at a time.
+	virtual void randomBytes(void *dst, size_t len);
+
 protected:
 	const uint8_t * onBodyBytes(const uint8_t *bytes, const uint8_t *limit) override;
+	const uint8_t * parseFrames(const uint8_t *bytes, const uint8_t *limit, bool writable);
 	void shiftInputBuffer(size_t amount);
-	long onInput(const uint8_t *bytes, const uint8_t *limit);
-	void onFrame(int opcode, bool isFinal, const uint8_t *bytes, size_t len);
+	long onInput(const uint8_t *bytes, const uint8_t *limit, bool writable); // writable: unmask in place
+	long onStreamedPayload(const uint8_t *bytes, size_t len, bool writable);
+	void onStreamedFrameEnd();
+	void failConnection(uint16_t code);
+	void onFrame(int opcode, bool isFinal, bool compressed, const uint8_t *bytes, size_t len);
 	void onContinuationFrame(bool isFinal, const uint8_t *bytes, size_t len);
 	void onPingFrame(const uint8_t *bytes, size_t len);
 	void onPongFrame(const uint8_t *bytes, size_t len);
 	void onCloseFrame();
-	void onMessageFrame(int opcode, bool isFinal, const uint8_t *bytes, size_t len);
+	void onMessageFrame(int opcode, bool isFinal, bool compressed, const uint8_t *bytes, size_t len);
+	void onMessage(int opcode, bool compressed, const uint8_t *bytes, size_t len, bool textChecked = false);
 	void clearCallbacks() override;
 	void onHeadersComplete() override;
-	void writeFrame(int opcode, const void *bytes, size_t len);
+	void onClientHeadersComplete();
+	std::string acceptKey(const std::string &websocketKey);
+	void writeFrame(int opcode, const void *bytes, size_t len, bool compress = true);
+	void writeFrame(int opcode, const std::shared_ptr<const void> &owner, const void *bytes, size_t len);
 
 	bool m_handshakeComplete { false };
+	bool m_client { false };
+	std::string m_clientKey; // the Sec-WebSocket-Key we sent
+	std::unique_ptr<uint8_t[]> m_randomPool; // allocated at first use
+	size_t m_randomAvailable { 0 }; // at the end of m_randomPool
 	bool m_closing { false };
 	Bytes m_inputBuffer;
-	Bytes m_tmpFrame; // so we can re-use rather than allocating every time
+	size_t m_inputOffset { 0 }; // start of the unconsumed bytes in m_inputBuffer
+	size_t m_inputNeeded { 0 }; // bytes the incomplete frame at m_inputOffset needs, if known
+	Bytes m_tmpFrame; // for unmasking bytes we can't modify; re-used rather than allocating every time
 	Bytes m_fragmentedMessage;
 	int m_fragmentedMessageOpcode { -1 };
+	bool m_fragmentedMessageCompressed { false };
+	size_t m_maxMessageSize { size_t(1) << 24 };
+	bool m_streamingMessage { false }; // the message in progress is going to onMessageData
+	size_t m_streamedLength { 0 }; // of the message in progress
+	size_t m_streamRemaining { 0 }; // payload bytes of the current frame still to come
+	bool m_streamFinal { false };
+	bool m_streamMasked { false };
+	uint8_t m_streamMaskKey[4];
+	size_t m_streamMaskOffset { 0 };
+	Utf8Validator m_utf8; // for text that arrives in pieces
+	std::shared_ptr<WebSocketCompression> m_compression;
+	bool m_compressing { false };
+	Bytes m_inflated; // re-used for decompressed messages
+	Bytes m_deflated; // and compressed ones
 };
 
 class SimpleWebSocket_OpenSSL : public SimpleWebSocket {
@@ -130,6 +310,7 @@ public:
 	using SimpleWebSocket::SimpleWebSocket;
 
 	void sha1(void *dst, const void *msg, size_t len) override;
+	void randomBytes(void *dst, size_t len) override; // RAND_bytes()
 };
 
 } } } // namespace com::zenomt::websock
@@ -0,0 +1,37 @@
+#pragma once
+
+// Copyright © 2026 Michael Thornburgh
+// SPDX-License-Identifier: MIT
+
+#include <cstddef>
+#include <cstdint>
+
+namespace com { namespace zenomt {
+
+// answer true if bytes are entirely valid UTF-8 (RFC 3629: no overlong forms, surrogates,
+// or code points past U+10FFFF). uses the fastest implementation this CPU has.
+bool isValidUtf8(const void *bytes, size_t len);
+
+// a particular implementation, for tests and benchmarks.
+enum Utf8Implementation { UTF8_SCALAR, UTF8_SSSE3, UTF8_AVX2 };
+bool isUtf8ImplementationSupported(Utf8Implementation impl);
+bool isValidUtf8(Utf8Implementation impl, const void *bytes, size_t len);
+
+// validate UTF-8 given in pieces, which can split a character.
+class Utf8Validator {
+public:
+	// answer false once anything so far is invalid (a character that's only been started is ok).
+	bool update(const void *bytes, size_t len);
+
+	// answer true if everything was valid and no character was left unfinished, and reset.
+	bool finish();
+
+	void reset();
+
+protected:
+	uint8_t m_partial[4];          // a character split at the end of the last piece
+	size_t  m_partialLength { 0 };
+	bool    m_valid { true };
+};
+
+} } // namespace com::zenomt
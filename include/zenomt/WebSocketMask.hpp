@@ -0,0 +1,21 @@
+#pragma once
+
+// Copyright © 2026 Michael Thornburgh
+// SPDX-License-Identifier: MIT
+
+#include <cstddef>
+#include <cstdint>
+
+namespace com { namespace zenomt { namespace websock {
+
+// XOR len bytes of src with the 4-byte WebSocket masking key (RFC 6455 §5.3, in wire order)
+// into dst, which may be src to mask in place. offset is the position of src[0] in the
+// payload, so a payload can be masked in pieces. uses the fastest implementation this CPU has.
+void applyMask(uint8_t *dst, const uint8_t *src, size_t len, const uint8_t *key, size_t offset = 0);
+
+// a particular implementation, for tests and benchmarks.
+enum MaskImplementation { MASK_SCALAR, MASK_SSE2, MASK_AVX2 };
+bool isMaskImplementationSupported(MaskImplementation impl);
+void applyMask(MaskImplementation impl, uint8_t *dst, const uint8_t *src, size_t len, const uint8_t *key, size_t offset = 0);
+
+} } } // namespace com::zenomt::websock
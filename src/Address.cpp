@@ -18,6 +18,320 @@
 
 namespace com { namespace zenomt { namespace rtmfp {
 
+static char * _formatDecimal(char *dst, unsigned val)
+{
+	char tmp[10];
+	char *cursor = tmp + sizeof(tmp);
+
+	do {
+		*--cursor = '0' + (val % 10);
+		val /= 10;
+	} while(val);
+
+	while(cursor < tmp + sizeof(tmp))
+		*dst++ = *cursor++;
+
+	return dst;
+}
+
+static char * _formatIPv4(char *dst, const uint8_t *src)
+{
+	for(int x = 0; x < 4; x++)
+	{
+		if(x)
+			*dst++ = '.';
+		dst = _formatDecimal(dst, src[x]);
+	}
+
+	return dst;
+}
+
+static char * _formatIPv6(char *dst, const uint8_t *src)
+{
+	// same choices as the traditional BIND/glibc inet_ntop(3): compress the first longest
+	// run of at least two zero words (RFC 5952), lowercase hex, and dotted-quad for the
+	// last 32 bits of IPv4-mapped (::ffff:a.b.c.d) and IPv4-compatible (::a.b.c.d) addresses.
+	static const char digits[] = "0123456789abcdef";
+	unsigned words[8];
+	int bestBase = -1, bestLen = 0, curBase = -1, curLen = 0;
+
+	for(int x = 0; x < 8; x++)
+	{
+		words[x] = (src[x * 2] << 8) + src[x * 2 + 1];
+
+		if(0 == words[x])
+		{
+			if(curBase < 0)
+			{
+				curBase = x;
+				curLen = 0;
+			}
+			curLen++;
+			if(curLen > bestLen)
+			{
+				bestBase = curBase;
+				bestLen = curLen;
+			}
+		}
+		else
+			curBase = -1;
+	}
+
+	if(bestLen < 2)
+		bestBase = -1;
+
+	for(int x = 0; x < 8; x++)
+	{
+		if((bestBase >= 0) and (x >= bestBase) and (x < bestBase + bestLen))
+		{
+			if(x == bestBase)
+				*dst++ = ':';
+			continue;
+		}
+
+		if(x)
+			*dst++ = ':';
+
+		if((6 == x) and (0 == bestBase) and ((6 == bestLen) or ((5 == bestLen) and (0xffff == words[5]))))
+			return _formatIPv4(dst, src + 12);
+
+		unsigned word = words[x];
+		bool started = false;
+		for(int shift = 12; shift >= 0; shift -= 4)
+		{
+			unsigned nibble = (word >> shift) & 0x0f;
+			if(nibble or started or (0 == shift))
+			{
+				*dst++ = digits[nibble];
+				started = true;
+			}
+		}
+	}
+
+	if((bestBase >= 0) and (bestBase + bestLen == 8))
+		*dst++ = ':';
+
+	return dst;
+}
+
+static bool _parseIPv4(const char *src, const char *limit, uint8_t *dst)
+{
+	// strict dotted-quad like inet_pton(3): four decimal octets, no leading zeros
+	uint8_t tmp[4];
+	int octets = 0;
+	unsigned val = 0;
+	bool sawDigit = false;
+
+	while(src < limit)
+	{
+		char ch = *src++;
+		if((ch >= '0') and (ch <= '9'))
+		{
+			if(sawDigit and (0 == val))
+				return false;
+			val = val * 10 + (ch - '0');
+			if(val > 255)
+				return false;
+			if(not sawDigit)
+			{
+				if(++octets > 4)
+					return false;
+				sawDigit = true;
+			}
+		}
+		else if(('.' == ch) and sawDigit)
+		{
+			if(4 == octets)
+				return false;
+			tmp[octets - 1] = val;
+			val = 0;
+			sawDigit = false;
+		}
+		else
+			return false;
+	}
+
+	if((octets < 4) or not sawDigit)
+		return false;
+	tmp[3] = val;
+
+	memmove(dst, tmp, sizeof(tmp));
+	return true;
+}
+
+static int _hexDigitValue(char ch)
+{
+	if((ch >= '0') and (ch <= '9'))
+		return ch - '0';
+	if((ch >= 'a') and (ch <= 'f'))
+		return ch - 'a' + 10;
+	if((ch >= 'A') and (ch <= 'F'))
+		return ch - 'A' + 10;
+	return -1;
+}
+
+static bool _parseIPv6(const char *src, const char *limit, uint8_t *dst)
+{
+	// accepts the same forms as inet_pton(3), including a trailing dotted-quad
+	uint8_t tmp[16] = { 0 };
+	uint8_t *tp = tmp;
+	uint8_t *endp = tmp + sizeof(tmp);
+	uint8_t *colonp = nullptr;
+	const char *curtok;
+	int xdigitsSeen = 0;
+	unsigned val = 0;
+
+	if(src == limit)
+		return false;
+	if(':' == *src)
+	{
+		if((++src == limit) or (':' != *src))
+			return false;
+	}
+
+	curtok = src;
+	while(src < limit)
+	{
+		char ch = *src++;
+		int digit = _hexDigitValue(ch);
+
+		if(digit >= 0)
+		{
+			if(4 == xdigitsSeen)
+				return false;
+			val = (val << 4) | digit;
+			xdigitsSeen++;
+			continue;
+		}
+
+		if(':' == ch)
+		{
+			curtok = src;
+			if(0 == xdigitsSeen)
+			{
+				if(colonp)
+					return false;
+				colonp = tp;
+				continue;
+			}
+			else if(src == limit)
+				return false;
+			if(tp + 2 > endp)
+				return false;
+			*tp++ = (val >> 8) & 0xff;
+			*tp++ = val & 0xff;
+			xdigitsSeen = 0;
+			val = 0;
+			continue;
+		}
+
+		if(('.' == ch) and (tp + 4 <= endp) and _parseIPv4(curtok, limit, tp))
+		{
+			tp += 4;
+			xdigitsSeen = 0;
+			break;
+		}
+
+		return false;
+	}
+
+	if(xdigitsSeen > 0)
+	{
+		if(tp + 2 > endp)
+			return false;
+		*tp++ = (val >> 8) & 0xff;
+		*tp++ = val & 0xff;
+	}
+
+	if(colonp)
+	{
+		if(tp == endp)
+			return false;
+		size_t n = tp - colonp;
+		memmove(endp - n, colonp, n);
+		memset(colonp, 0, endp - n - colonp);
+		tp = endp;
+	}
+
+	if(tp != endp)
+		return false;
+
+	memmove(dst, tmp, sizeof(tmp));
+	return true;
+}
+
+static bool _parsePort(const char *src, unsigned *dst)
+{
+	unsigned port = 0;
+	int digits = 0;
+
+	for(; *src; src++, digits++)
+	{
+		if((*src < '0') or (*src > '9') or (digits >= 5))
+			return false;
+		port = port * 10 + (*src - '0');
+	}
+
+	if((0 == digits) or (port > 65535))
+		return false;
+
+	*dst = port;
+	return true;
+}
+
+static bool _fastParsePresentation(const char *src, bool withPort, uint8_t *ipaddr, size_t *ipaddrLen, unsigned *port)
+{
+	// handles well-formed presentations without sscanf(3) or inet_pton(3). answers false for
+	// anything else, which is then left to the general parser below.
+	const char *ip = src;
+	const char *ipLimit;
+	const char *rest;
+
+	if('[' == *src)
+	{
+		ip = src + 1;
+		ipLimit = strchr(ip, ']');
+		if(not ipLimit)
+			return false;
+		rest = ipLimit + 1;
+		if(withPort)
+		{
+			if(':' != *rest)
+				return false;
+			rest++;
+		}
+		else if(*rest)
+			return false;
+	}
+	else
+	{
+		ipLimit = withPort ? strchr(src, ':') : src + strlen(src);
+		if(not ipLimit)
+			return false;
+		rest = ipLimit + 1;
+		if(withPort and strchr(rest, ':'))
+			return false; // unbracketed IPv6 can't have a port
+	}
+
+	if(memchr(ip, ':', ipLimit - ip))
+	{
+		if(not _parseIPv6(ip, ipLimit, ipaddr))
+			return false;
+		*ipaddrLen = 16;
+	}
+	else
+	{
+		if(not _parseIPv4(ip, ipLimit, ipaddr))
+			return false;
+		*ipaddrLen = 4;
+	}
+
+	if(withPort)
+		return _parsePort(rest, port);
+
+	return true;
+}
+
 Address::Address() : m_origin(ORIGIN_UNKNOWN)
 {
 	erase();
@@ -311,22 +625,39 @@ std::string Address::toPresentation(bool withPort) const
 
 void Address::toPresentation(char *dst, bool withPort) const
 {
-	char buf[INET6_ADDRSTRLEN]; // big enough for INET too
+	// hand-rolled equivalent of inet_ntop(3) + snprintf(3), with no locale or allocation.
+	char *cursor = dst;
 
 	*dst = 0; // just in case
 
-	if(not inet_ntop(getFamily(), getIPAddressPtr(), buf, sizeof(buf)))
-		return;
-
-	if(not withPort)
-		snprintf(dst, MAX_PRESENTATION_LENGTH, "%s", buf);
-	else
+	switch(getFamily())
 	{
-		if(AF_INET == getFamily())
-			snprintf(dst, MAX_PRESENTATION_LENGTH, "%s:%u", buf, getPort());
-		else
-			snprintf(dst, MAX_PRESENTATION_LENGTH, "[%s]:%u", buf, getPort());
+	case AF_INET:
+		cursor = _formatIPv4(cursor, getIPAddressPtr());
+		if(withPort)
+		{
+			*cursor++ = ':';
+			cursor = _formatDecimal(cursor, getPort());
+		}
+		break;
+
+	case AF_INET6:
+		if(withPort)
+			*cursor++ = '[';
+		cursor = _formatIPv6(cursor, getIPAddressPtr());
+		if(withPort)
+		{
+			*cursor++ = ']';
+			*cursor++ = ':';
+			cursor = _formatDecimal(cursor, getPort());
+		}
+		break;
+
+	default:
+		return;
 	}
+
+	*cursor = 0;
 }
 
 static size_t _count_colons(const char *src)
@@ -341,6 +672,20 @@ static size_t _count_colons(const char *src)
 
 bool Address::setFromPresentation(const char *src, bool withPort)
 {
+	uint8_t ipaddr[16]; // big enough for IPv6
+
+	{
+		size_t ipaddrLen = 0;
+		unsigned fastPort = 0;
+		if(_fastParsePresentation(src, withPort, ipaddr, &ipaddrLen, &fastPort))
+		{
+			setIPAddress(ipaddr, ipaddrLen);
+			if(withPort)
+				setPort(fastPort);
+			return true;
+		}
+	}
+
 	char ip[45+1]; // INET6_ADDRSTRLEN is 46, explicit here to match sscanf use below
 	int port = 0;
 	int family = _count_colons(src) > 1 ? AF_INET6 : AF_INET;
@@ -366,7 +711,6 @@ bool Address::setFromPresentation(const char *src, bool withPort)
 			return false;
 	}
 
-	uint8_t ipaddr[16]; // big enough for IPv6
 	if(inet_pton(family, ip, ipaddr) < 1)
 		return false;
 
@@ -0,0 +1,212 @@
+// Copyright © 2026 Michael Thornburgh
+// SPDX-License-Identifier: MIT
+
+#include "../include/zenomt/AsyncResolver.hpp"
+#include "../include/zenomt/Retainer.hpp"
+
+namespace com { namespace zenomt { namespace rtmfp {
+
+bool AsyncResolver::Query::operator< (const Query &rhs) const
+{
+	if(m_flags != rhs.m_flags)
+		return m_flags < rhs.m_flags;
+	if(m_family != rhs.m_family)
+		return m_family < rhs.m_family;
+	if(m_protocol != rhs.m_protocol)
+		return m_protocol < rhs.m_protocol;
+	int cmp = m_hostname.compare(rhs.m_hostname);
+	if(cmp)
+		return cmp < 0;
+	return m_servname < rhs.m_servname;
+}
+
+AsyncResolver::AsyncResolver(RunLoop *runloop, size_t numWorkers) :
+	m_runloop(runloop),
+	m_performer(share_ref(new Performer(runloop), false)),
+	m_open(std::make_shared<bool>(true)),
+	m_lookup([] (const char *hostname, const char *servname, int *err, int ai_flags, int ai_family, int ai_protocol) {
+		return Address::lookup(hostname, servname, err, ai_flags, ai_family, ai_protocol);
+	})
+{
+	if(numWorkers < 1)
+		numWorkers = 1;
+	for(size_t x = 0; x < numWorkers; x++)
+		m_workers.emplace_back([this] { workerLoop(); });
+}
+
+AsyncResolver::~AsyncResolver()
+{
+	close();
+}
+
+void AsyncResolver::setLookupFunction(const lookup_f &lookup)
+{
+	std::unique_lock<std::mutex> locked(m_mutex);
+	m_lookup = lookup;
+}
+
+void AsyncResolver::setCacheTTL(Duration positiveTTL, Duration negativeTTL)
+{
+	m_positiveTTL = positiveTTL;
+	m_negativeTTL = negativeTTL;
+}
+
+void AsyncResolver::setMaxCacheEntries(size_t maxEntries)
+{
+	m_maxCacheEntries = maxEntries;
+	while(m_cache.size() > m_maxCacheEntries)
+		m_cache.erase(m_cache.begin());
+}
+
+size_t AsyncResolver::getCacheSize() const
+{
+	return m_cache.size();
+}
+
+void AsyncResolver::flushCache()
+{
+	m_cache.clear();
+}
+
+void AsyncResolver::resolve(const std::string &hostname, const std::string &servname, const onresult_f &onresult, int ai_flags, int ai_family, int ai_protocol)
+{
+	if(not *m_open)
+		return;
+
+	Query query = { hostname, servname, ai_flags, ai_family, ai_protocol };
+
+	auto it = m_cache.find(query);
+	if(it != m_cache.end())
+	{
+		if(it->second.m_expires > m_runloop->getCurrentTime())
+		{
+			std::shared_ptr<bool> open = m_open;
+			std::vector<Address> addresses = it->second.m_addresses;
+			int err = it->second.m_err;
+			m_runloop->doLater([open, onresult, addresses, err] {
+				if(*open and onresult)
+					onresult(addresses, err);
+			});
+			return;
+		}
+
+		m_cache.erase(it);
+	}
+
+	auto &waiting = m_pending[query];
+	waiting.push_back(onresult);
+	if(waiting.size() > 1)
+		return; // already looking this up
+
+	{
+		std::unique_lock<std::mutex> locked(m_mutex);
+		m_queue.push(query);
+	}
+	m_cond.notify_one();
+}
+
+void AsyncResolver::close()
+{
+	*m_open = false;
+
+	{
+		std::unique_lock<std::mutex> locked(m_mutex);
+		m_closing = true;
+	}
+	m_cond.notify_all();
+
+	for(auto it = m_workers.begin(); it != m_workers.end(); it++)
+		if(it->joinable())
+			it->join();
+	m_workers.clear();
+
+	m_performer->close();
+	m_pending.clear();
+	m_cache.clear();
+}
+
+// ---
+
+void AsyncResolver::workerLoop()
+{
+	while(true)
+	{
+		Query query;
+		lookup_f lookup;
+
+		{
+			std::unique_lock<std::mutex> locked(m_mutex);
+			while(m_queue.empty() and not m_closing)
+				m_cond.wait(locked);
+			if(m_closing)
+				return;
+			query = m_queue.front();
+			m_queue.pop();
+			lookup = m_lookup;
+		}
+
+		int err = 0;
+		std::vector<Address> addresses;
+		if(lookup)
+			addresses = lookup(query.m_hostname.empty() ? nullptr : query.m_hostname.c_str(), query.m_servname.empty() ? nullptr : query.m_servname.c_str(),
+				&err, query.m_flags, query.m_family, query.m_protocol);
+
+		m_performer->perform([this, query, addresses, err] { onLookupComplete(query, addresses, err); });
+	}
+}
+
+void AsyncResolver::onLookupComplete(const Query &query, const std::vector<Address> &addresses, int err)
+{
+	if(not *m_open)
+		return;
+
+	addToCache(query, addresses, err);
+
+	std::vector<onresult_f> waiting;
+	auto it = m_pending.find(query);
+	if(it != m_pending.end())
+	{
+		swap(waiting, it->second);
+		m_pending.erase(it);
+	}
+
+	auto myself = retain_ref(this);
+	for(auto each = waiting.begin(); (each != waiting.end()) and *m_open; each++)
+		if(*each)
+			(*each)(addresses, err);
+}
+
+void AsyncResolver::addToCache(const Query &query, const std::vector<Address> &addresses, int err)
+{
+	Duration ttl = (err or addresses.empty()) ? m_negativeTTL : m_positiveTTL;
+	if((ttl <= 0) or (0 == m_maxCacheEntries))
+		return;
+
+	Time now = m_runloop->getCurrentTime();
+
+	if(m_cache.size() >= m_maxCacheEntries)
+	{
+		auto soonest = m_cache.end();
+		for(auto it = m_cache.begin(); it != m_cache.end(); )
+		{
+			if(it->second.m_expires <= now)
+				it = m_cache.erase(it);
+			else
+			{
+				if((soonest == m_cache.end()) or (it->second.m_expires < soonest->second.m_expires))
+					soonest = it;
+				it++;
+			}
+		}
+
+		if(m_cache.size() >= m_maxCacheEntries)
+			m_cache.erase(soonest);
+	}
+
+	CacheEntry &entry = m_cache[query];
+	entry.m_addresses = addresses;
+	entry.m_err = err;
+	entry.m_expires = now + ttl;
+}
+
+} } } // namespace com::zenomt::rtmfp
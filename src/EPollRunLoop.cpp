@@ -133,7 +133,11 @@ void EPollRunLoop::run(Duration runInterval, Duration minSleep)
 	m_runningInThread = std::this_thread::get_id();
 
 	do {
-		Duration sleepTime = hasDoLaters() ? 0.0 : m_timers.howLongToNextFire(getCurrentTime());
+		processCycleObservers(PREPARE);
+		if(m_stopping)
+			break;
+
+		Duration sleepTime = (hasDoLaters() or hasNewPrepareObservers()) ? 0.0 : m_timers.howLongToNextFire(getCurrentTime());
 		if(sleepTime < minSleep)
 			sleepTime = minSleep;
 		if(sleepTime > 0.0)
@@ -170,6 +174,9 @@ void EPollRunLoop::run(Duration runInterval, Duration minSleep)
 				break;
 		}
 
+		if(not m_stopping)
+			processCycleObservers(CHECK);
+
 		processDoLaters();
 
 		if(not m_stopping)
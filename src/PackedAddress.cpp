@@ -0,0 +1,95 @@
+// Copyright © 2026 Michael Thornburgh
+// SPDX-License-Identifier: MIT
+
+#include "../include/zenomt/PackedAddress.hpp"
+
+namespace com { namespace zenomt { namespace rtmfp {
+
+static const uint8_t map_prefix[12] = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xff, 0xff };
+
+void PackedAddress::setAddress(const Address &addr)
+{
+	setSockaddr(addr.getSockaddr(), addr.getOrigin());
+}
+
+Address PackedAddress::getAddress() const
+{
+	Address::in_sockaddr tmp;
+	getSockaddr(&tmp.s);
+	return Address(&tmp.s, getOrigin());
+}
+
+bool PackedAddress::setSockaddr(const struct sockaddr *addr, Address::Origin origin)
+{
+	*this = PackedAddress();
+	m_origin = (uint8_t)origin;
+
+	if(not addr)
+		return false;
+
+	switch(addr->sa_family)
+	{
+	case AF_INET:
+		{
+			const struct sockaddr_in *s4 = (const struct sockaddr_in *)addr;
+			memcpy(m_ip, map_prefix, sizeof(map_prefix));
+			memcpy(m_ip + sizeof(map_prefix), &s4->sin_addr, 4);
+			memcpy(m_port, &s4->sin_port, 2);
+			m_family = FAMILY_IPV4;
+		}
+		return true;
+
+	case AF_INET6:
+		{
+			const struct sockaddr_in6 *s6 = (const struct sockaddr_in6 *)addr;
+			memcpy(m_ip, &s6->sin6_addr, 16);
+			memcpy(m_port, &s6->sin6_port, 2);
+			m_family = FAMILY_IPV6;
+		}
+		return true;
+	}
+
+	return false;
+}
+
+size_t PackedAddress::getSockaddr(struct sockaddr *dst) const
+{
+	Address::in_sockaddr *addr = (Address::in_sockaddr *)dst;
+	memset(addr, 0, sizeof(*addr));
+
+	switch(m_family)
+	{
+	case FAMILY_IPV4:
+		addr->s4.sin_family = AF_INET;
+#ifdef SIN6_LEN
+		addr->s4.sin_len = sizeof(struct sockaddr_in);
+#endif
+		memcpy(&addr->s4.sin_addr, m_ip + sizeof(map_prefix), 4);
+		memcpy(&addr->s4.sin_port, m_port, 2);
+		return sizeof(struct sockaddr_in);
+
+	case FAMILY_IPV6:
+		addr->s6.sin6_family = AF_INET6;
+#ifdef SIN6_LEN
+		addr->s6.sin6_len = sizeof(struct sockaddr_in6);
+#endif
+		memcpy(&addr->s6.sin6_addr, m_ip, 16);
+		memcpy(&addr->s6.sin6_port, m_port, 2);
+		return sizeof(struct sockaddr_in6);
+	}
+
+	return 0;
+}
+
+int PackedAddress::getFamily() const
+{
+	switch(m_family)
+	{
+	case FAMILY_IPV4: return AF_INET;
+	case FAMILY_IPV6: return AF_INET6;
+	}
+
+	return 0;
+}
+
+} } } // namespace com::zenomt::rtmfp
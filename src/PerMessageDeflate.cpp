@@ -0,0 +1,546 @@
+// Copyright © 2026 Michael Thornburgh
+// SPDX-License-Identifier: MIT
+
+#include <algorithm>
+#include <cassert>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <set>
+
+#include <zlib.h>
+
+#include "../include/zenomt/PerMessageDeflate.hpp"
+#include "../include/zenomt/URIParse.hpp"
+
+namespace {
+
+const int MIN_WINDOW_BITS = 9; // zlib won't do raw deflate with 8
+const int MAX_WINDOW_BITS = 15;
+const uint8_t DEFLATE_TAIL[4] = { 0x00, 0x00, 0xff, 0xff }; // RFC 7692 §7.2.1
+
+int _clamp(int val, int lo, int hi)
+{
+	return std::min(std::max(val, lo), hi);
+}
+
+int _streamKind(bool deflater, int windowBits, int memLevel, int level)
+{
+	if(not deflater)
+		memLevel = level = 0;
+	return (deflater ? 1 << 24 : 0) | (level << 16) | (windowBits << 8) | memLevel;
+}
+
+z_stream *_newStream(bool deflater, int windowBits, int memLevel, int level)
+{
+	z_stream *rv = new z_stream;
+	memset(rv, 0, sizeof(z_stream));
+
+	// negative windowBits for raw deflate, without the zlib header and checksum.
+	int status = deflater ?
+		deflateInit2(rv, level, Z_DEFLATED, -windowBits, memLevel, Z_DEFAULT_STRATEGY) :
+		inflateInit2(rv, -windowBits);
+	if(Z_OK != status)
+	{
+		delete rv;
+		return nullptr;
+	}
+	return rv;
+}
+
+void _freeStream(z_stream *stream, bool deflater)
+{
+	if(deflater)
+		deflateEnd(stream);
+	else
+		inflateEnd(stream);
+	delete stream;
+}
+
+std::string _trim(const std::string &s)
+{
+	size_t left = s.find_first_not_of(" \t");
+	if(std::string::npos == left)
+		return std::string();
+	size_t right = s.find_last_not_of(" \t");
+	return s.substr(left, right - left + 1);
+}
+
+// answer the window bits value, or 0 if it isn't one.
+int _parseWindowBits(std::string value)
+{
+	if((value.size() >= 2) and ('"' == value.front()) and ('"' == value.back()))
+		value = value.substr(1, value.size() - 2);
+	if(value.empty() or (value.size() > 2) or (std::string::npos != value.find_first_not_of("0123456789")))
+		return 0;
+	int rv = atoi(value.c_str());
+	return ((rv >= 8) and (rv <= MAX_WINDOW_BITS)) ? rv : 0;
+}
+
+}
+
+namespace com { namespace zenomt { namespace websock {
+
+// --- DeflatePool
+
+DeflatePool::DeflatePool(size_t maxIdlePerKind) :
+	m_maxIdlePerKind(maxIdlePerKind)
+{
+}
+
+DeflatePool::~DeflatePool()
+{
+	for(auto it = m_idle.begin(); it != m_idle.end(); it++)
+		for(auto each = it->second.begin(); each != it->second.end(); each++)
+			_freeStream(*each, it->first >> 24);
+}
+
+size_t DeflatePool::getIdleCount() const
+{
+	size_t rv = 0;
+	for(auto it = m_idle.begin(); it != m_idle.end(); it++)
+		rv += it->second.size();
+	return rv;
+}
+
+z_stream *DeflatePool::acquire(bool deflater, int windowBits, int memLevel, int level)
+{
+	auto it = m_idle.find(_streamKind(deflater, windowBits, memLevel, level));
+	if((it == m_idle.end()) or it->second.empty())
+		return nullptr;
+
+	z_stream *rv = it->second.back();
+	it->second.pop_back();
+	return rv;
+}
+
+void DeflatePool::release(z_stream *stream, bool deflater, int windowBits, int memLevel, int level)
+{
+	auto &idle = m_idle[_streamKind(deflater, windowBits, memLevel, level)];
+	if(idle.size() >= m_maxIdlePerKind)
+	{
+		_freeStream(stream, deflater);
+		return;
+	}
+
+	if(deflater)
+		deflateReset(stream);
+	else
+		inflateReset(stream);
+	idle.push_back(stream);
+}
+
+// --- PerMessageDeflate
+
+PerMessageDeflate::PerMessageDeflate(const DeflateOptions &options, const std::shared_ptr<DeflatePool> &pool) :
+	m_options(options),
+	m_pool(pool),
+	m_serverWindowBits(_clamp(options.m_serverMaxWindowBits, MIN_WINDOW_BITS, MAX_WINDOW_BITS)),
+	m_clientWindowBits(MAX_WINDOW_BITS),
+	m_memLevel(_clamp(options.m_memLevel, 1, MAX_MEM_LEVEL)),
+	m_serverNoContextTakeover(options.m_serverNoContextTakeover),
+	m_clientNoContextTakeover(false),
+	m_client(false),
+	m_deflater(nullptr),
+	m_inflater(nullptr)
+{
+	m_options.m_compressionLevel = _clamp(options.m_compressionLevel, 1, 9);
+}
+
+PerMessageDeflate::~PerMessageDeflate()
+{
+	releaseDeflater();
+	releaseInflater();
+}
+
+std::string PerMessageDeflate::negotiate(const std::string &offers)
+{
+	auto each = URIParse::split(offers, ',');
+	for(auto it = each.begin(); it != each.end(); it++)
+	{
+		auto parts = URIParse::split(*it, ';');
+		if(parts.empty() or (0 != URIParse::lowercase(_trim(parts[0])).compare("permessage-deflate")))
+			continue;
+
+		std::vector<std::pair<std::string, std::string>> params;
+		for(auto param = parts.begin() + 1; param != parts.end(); param++)
+		{
+			auto nameValue = URIParse::split(*param, '=', 2);
+			params.push_back(std::make_pair(URIParse::lowercase(_trim(nameValue[0])), nameValue.size() > 1 ? _trim(nameValue[1]) : std::string()));
+		}
+
+		std::string response;
+		if(acceptOffer(params, response))
+			return response;
+	}
+
+	return std::string();
+}
+
+bool PerMessageDeflate::acceptOffer(const std::vector<std::pair<std::string, std::string>> &params, std::string &response)
+{
+	bool serverNoContextTakeover = m_options.m_serverNoContextTakeover;
+	bool clientNoContextTakeover = m_options.m_clientNoContextTakeover;
+	int serverWindowBits = _clamp(m_options.m_serverMaxWindowBits, MIN_WINDOW_BITS, MAX_WINDOW_BITS);
+	bool serverWindowBitsOffered = false;
+	int clientWindowBits = MAX_WINDOW_BITS;
+	bool clientWindowBitsOffered = false;
+	int memLevel = _clamp(m_options.m_memLevel, 1, MAX_MEM_LEVEL);
+	std::set<std::string> seen;
+
+	for(auto it = params.begin(); it != params.end(); it++)
+	{
+		const std::string &name = it->first;
+		const std::string &value = it->second;
+		if(not seen.insert(name).second)
+			return false; // RFC 7692 §7: each parameter at most once
+
+		if(0 == name.compare("server_no_context_takeover") and value.empty())
+			serverNoContextTakeover = true;
+		else if(0 == name.compare("client_no_context_takeover") and value.empty())
+			clientNoContextTakeover = true; // a hint; we say so in the response so we can count on it
+		else if(0 == name.compare("server_max_window_bits"))
+		{
+			int bits = _parseWindowBits(value);
+			if(0 == bits)
+				return false;
+			serverWindowBits = std::min(serverWindowBits, bits);
+			serverWindowBitsOffered = true;
+		}
+		else if(0 == name.compare("client_max_window_bits"))
+		{
+			int bits = value.empty() ? MAX_WINDOW_BITS : _parseWindowBits(value);
+			if(0 == bits)
+				return false;
+			clientWindowBits = std::min(_clamp(m_options.m_clientMaxWindowBits, MIN_WINDOW_BITS, MAX_WINDOW_BITS), bits);
+			clientWindowBitsOffered = true;
+		}
+		else
+			return false;
+	}
+
+	if(serverWindowBits < MIN_WINDOW_BITS)
+		return false;
+
+	if(m_options.m_maxMemory)
+	{
+		auto total = [&] { return deflateMemory(serverWindowBits, memLevel) + inflateMemory(clientWindowBits); };
+		while((total() > m_options.m_maxMemory) and (serverWindowBits > MIN_WINDOW_BITS))
+			serverWindowBits--;
+		while((total() > m_options.m_maxMemory) and clientWindowBitsOffered and (clientWindowBits > MIN_WINDOW_BITS))
+			clientWindowBits--;
+		while((total() > m_options.m_maxMemory) and (memLevel > 1))
+			memLevel--;
+		if(total() > m_options.m_maxMemory)
+			return false;
+	}
+
+	response = "permessage-deflate";
+	if(serverNoContextTakeover)
+		response.append("; server_no_context_takeover");
+	if(clientNoContextTakeover)
+		response.append("; client_no_context_takeover");
+	if(serverWindowBitsOffered or (serverWindowBits < MAX_WINDOW_BITS))
+		response.append("; server_max_window_bits=" + std::to_string(serverWindowBits));
+	if(clientWindowBitsOffered and (clientWindowBits < MAX_WINDOW_BITS))
+		response.append("; client_max_window_bits=" + std::to_string(clientWindowBits));
+
+	releaseDeflater();
+	releaseInflater();
+	m_serverWindowBits = serverWindowBits;
+	m_clientWindowBits = clientWindowBits;
+	m_memLevel = memLevel;
+	m_serverNoContextTakeover = serverNoContextTakeover;
+	m_clientNoContextTakeover = clientNoContextTakeover;
+	m_client = false;
+
+	return true;
+}
+
+std::string PerMessageDeflate::offer()
+{
+	int serverWindowBits = _clamp(m_options.m_serverMaxWindowBits, MIN_WINDOW_BITS, MAX_WINDOW_BITS);
+	int clientWindowBits = _clamp(m_options.m_clientMaxWindowBits, MIN_WINDOW_BITS, MAX_WINDOW_BITS);
+	int memLevel = _clamp(m_options.m_memLevel, 1, MAX_MEM_LEVEL);
+
+	if(m_options.m_maxMemory)
+	{
+		auto total = [&] { return deflateMemory(clientWindowBits, memLevel) + inflateMemory(serverWindowBits); };
+		while((total() > m_options.m_maxMemory) and (clientWindowBits > MIN_WINDOW_BITS))
+			clientWindowBits--;
+		while((total() > m_options.m_maxMemory) and (serverWindowBits > MIN_WINDOW_BITS))
+			serverWindowBits--;
+		while((total() > m_options.m_maxMemory) and (memLevel > 1))
+			memLevel--;
+		if(total() > m_options.m_maxMemory)
+			return std::string();
+	}
+
+	// the server can limit our window however it likes, so say we can take that.
+	std::string rv = "permessage-deflate; client_max_window_bits";
+	if(clientWindowBits < MAX_WINDOW_BITS)
+		rv.append("=" + std::to_string(clientWindowBits));
+	if(serverWindowBits < MAX_WINDOW_BITS)
+		rv.append("; server_max_window_bits=" + std::to_string(serverWindowBits));
+	if(m_options.m_serverNoContextTakeover)
+		rv.append("; server_no_context_takeover");
+	if(m_options.m_clientNoContextTakeover)
+		rv.append("; client_no_context_takeover");
+
+	releaseDeflater();
+	releaseInflater();
+	m_serverWindowBits = serverWindowBits;
+	m_clientWindowBits = clientWindowBits;
+	m_memLevel = memLevel;
+	m_serverNoContextTakeover = m_options.m_serverNoContextTakeover;
+	m_clientNoContextTakeover = m_options.m_clientNoContextTakeover;
+	m_client = true;
+
+	return rv;
+}
+
+bool PerMessageDeflate::accept(const std::string &response)
+{
+	if(not m_client)
+		return false;
+
+	auto parts = URIParse::split(response, ';');
+	if(parts.empty() or (0 != URIParse::lowercase(_trim(parts[0])).compare("permessage-deflate")))
+		return false; // including more than one extension
+
+	bool serverNoContextTakeover = false;
+	bool clientNoContextTakeover = m_clientNoContextTakeover;
+	int serverWindowBits = MAX_WINDOW_BITS;
+	int clientWindowBits = m_clientWindowBits;
+	std::set<std::string> seen;
+
+	for(auto it = parts.begin() + 1; it != parts.end(); it++)
+	{
+		auto nameValue = URIParse::split(*it, '=', 2);
+		std::string name = URIParse::lowercase(_trim(nameValue[0]));
+		std::string value = nameValue.size() > 1 ? _trim(nameValue[1]) : std::string();
+		if(not seen.insert(name).second)
+			return false;
+
+		if(0 == name.compare("server_no_context_takeover") and value.empty())
+			serverNoContextTakeover = true;
+		else if(0 == name.compare("client_no_context_takeover") and value.empty())
+			clientNoContextTakeover = true;
+		else if(0 == name.compare("server_max_window_bits"))
+		{
+			serverWindowBits = _parseWindowBits(value);
+			if((0 == serverWindowBits) or (serverWindowBits > m_serverWindowBits))
+				return false;
+		}
+		else if(0 == name.compare("client_max_window_bits"))
+		{
+			int bits = _parseWindowBits(value);
+			if(bits < MIN_WINDOW_BITS)
+				return false; // zlib can't make a raw deflate stream with a window of 8
+			clientWindowBits = std::min(clientWindowBits, bits);
+		}
+		else
+			return false;
+	}
+
+	// RFC 7692 §7.1.1.1 and §7.1.2.1, the server has to agree to what we asked of it.
+	if( (m_serverNoContextTakeover and not serverNoContextTakeover)
+	 or ((m_serverWindowBits < MAX_WINDOW_BITS) and not seen.count("server_max_window_bits"))
+	)
+		return false;
+
+	releaseDeflater();
+	releaseInflater();
+	m_serverWindowBits = std::max(serverWindowBits, MIN_WINDOW_BITS); // a bigger window inflates a smaller one's data
+	m_clientWindowBits = clientWindowBits;
+	m_serverNoContextTakeover = serverNoContextTakeover;
+	m_clientNoContextTakeover = clientNoContextTakeover;
+
+	return true;
+}
+
+bool PerMessageDeflate::compress(const uint8_t *bytes, size_t len, Bytes &dst)
+{
+	// an uncompressed message doesn't touch the compression context, so skipping is always ok.
+	if((len < m_options.m_minCompressSize) or (len > UINT_MAX / 2))
+		return false;
+
+	if((not m_deflater) and m_pool)
+		m_deflater = m_pool->acquire(true, getDeflateWindowBits(), m_memLevel, m_options.m_compressionLevel);
+	if(not m_deflater)
+		m_deflater = _newStream(true, getDeflateWindowBits(), m_memLevel, m_options.m_compressionLevel);
+	if(not m_deflater)
+		return false;
+
+	m_deflater->next_in = (Bytef *)bytes;
+	m_deflater->avail_in = len;
+	dst.clear();
+
+	int status;
+	do {
+		size_t used = dst.size();
+		dst.resize(used + deflateBound(m_deflater, m_deflater->avail_in) + 16);
+		m_deflater->next_out = dst.data() + used;
+		m_deflater->avail_out = dst.size() - used;
+		status = deflate(m_deflater, Z_SYNC_FLUSH);
+		dst.resize(dst.size() - m_deflater->avail_out);
+	} while((Z_OK == status) and (0 == m_deflater->avail_out));
+
+	// Z_BUF_ERROR just means the last call had nothing left to do.
+	if( ((Z_OK != status) and (Z_BUF_ERROR != status))
+	 or m_deflater->avail_in
+	 or (dst.size() < sizeof(DEFLATE_TAIL))
+	 or memcmp(dst.data() + dst.size() - sizeof(DEFLATE_TAIL), DEFLATE_TAIL, sizeof(DEFLATE_TAIL))
+	)
+	{
+		// a fresh stream never refers back to what the peer hasn't seen, so it's safe to go on without this one.
+		_freeStream(m_deflater, true);
+		m_deflater = nullptr;
+		return false;
+	}
+	dst.resize(dst.size() - sizeof(DEFLATE_TAIL));
+
+	if(m_client ? m_clientNoContextTakeover : m_serverNoContextTakeover)
+	{
+		releaseDeflater();
+		return dst.size() < len; // otherwise just send it as is
+	}
+
+	return true; // the context has this message now, so the peer must see it compressed
+}
+
+bool PerMessageDeflate::decompress(const uint8_t *bytes, size_t len, Bytes &dst, size_t maxLen)
+{
+	if(len > UINT_MAX / 2)
+		return false;
+
+	if((not m_inflater) and m_pool)
+		m_inflater = m_pool->acquire(false, getInflateWindowBits(), 0, 0);
+	if(not m_inflater)
+		m_inflater = _newStream(false, getInflateWindowBits(), 0, 0);
+	if(not m_inflater)
+		return false;
+
+	dst.clear();
+	bool ended = false;
+	if( (not inflateSome(bytes, len, dst, maxLen, &ended))
+	 or ((not ended) and not inflateSome(DEFLATE_TAIL, sizeof(DEFLATE_TAIL), dst, maxLen, &ended))
+	)
+	{
+		_freeStream(m_inflater, false);
+		m_inflater = nullptr;
+		return false;
+	}
+
+	if(m_client ? m_serverNoContextTakeover : m_clientNoContextTakeover)
+		releaseInflater();
+
+	return true;
+}
+
+bool PerMessageDeflate::inflateSome(const uint8_t *bytes, size_t len, Bytes &dst, size_t maxLen, bool *ended)
+{
+	m_inflater->next_in = (Bytef *)bytes;
+	m_inflater->avail_in = len;
+
+	for(;;)
+	{
+		size_t used = dst.size();
+		size_t room = std::min(std::max(std::max(used, len * 2), size_t(4096)), size_t(1) << 30);
+		if(room > maxLen - used)
+			room = maxLen - used + 1; // just enough to notice going over
+		dst.resize(used + room);
+		m_inflater->next_out = dst.data() + used;
+		m_inflater->avail_out = room;
+		int status = inflate(m_inflater, Z_SYNC_FLUSH);
+		dst.resize(dst.size() - m_inflater->avail_out);
+
+		if(dst.size() > maxLen)
+			return false;
+
+		if(Z_STREAM_END == status)
+		{
+			// the peer ended the stream (BFINAL). the next message starts a new one.
+			inflateReset(m_inflater);
+			*ended = true;
+			return true;
+		}
+
+		if((Z_OK != status) and (Z_BUF_ERROR != status))
+			return false;
+
+		if(m_inflater->avail_out)
+			return 0 == m_inflater->avail_in; // done, unless it's stuck
+	}
+}
+
+void PerMessageDeflate::releaseDeflater()
+{
+	if(not m_deflater)
+		return;
+	if(m_pool)
+		m_pool->release(m_deflater, true, getDeflateWindowBits(), m_memLevel, m_options.m_compressionLevel);
+	else
+		_freeStream(m_deflater, true);
+	m_deflater = nullptr;
+}
+
+void PerMessageDeflate::releaseInflater()
+{
+	if(not m_inflater)
+		return;
+	if(m_pool)
+		m_pool->release(m_inflater, false, getInflateWindowBits(), 0, 0);
+	else
+		_freeStream(m_inflater, false);
+	m_inflater = nullptr;
+}
+
+int PerMessageDeflate::getDeflateWindowBits() const
+{
+	return m_client ? m_clientWindowBits : m_serverWindowBits;
+}
+
+int PerMessageDeflate::getInflateWindowBits() const
+{
+	return m_client ? m_serverWindowBits : m_clientWindowBits;
+}
+
+int PerMessageDeflate::getServerWindowBits() const
+{
+	return m_serverWindowBits;
+}
+
+int PerMessageDeflate::getClientWindowBits() const
+{
+	return m_clientWindowBits;
+}
+
+bool PerMessageDeflate::isServerNoContextTakeover() const
+{
+	return m_serverNoContextTakeover;
+}
+
+bool PerMessageDeflate::isClientNoContextTakeover() const
+{
+	return m_clientNoContextTakeover;
+}
+
+size_t PerMessageDeflate::getMemoryInUse() const
+{
+	return (m_deflater ? deflateMemory(getDeflateWindowBits(), m_memLevel) : 0)
+		+ (m_inflater ? inflateMemory(getInflateWindowBits()) : 0);
+}
+
+size_t PerMessageDeflate::deflateMemory(int windowBits, int memLevel)
+{
+	// zconf.h, plus the stream and zlib's own state
+	return (size_t(1) << (windowBits + 2)) + (size_t(1) << (memLevel + 9)) + 6 * 1024;
+}
+
+size_t PerMessageDeflate::inflateMemory(int windowBits)
+{
+	return (size_t(1) << windowBits) + 7 * 1024;
+}
+
+} } } // namespace com::zenomt::websock
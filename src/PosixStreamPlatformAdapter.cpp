@@ -1,35 +1,223 @@
 // Copyright © 2021 Michael Thornburgh
 // SPDX-License-Identifier: MIT
 
+#include <algorithm>
 #include <cassert>
 #include <cerrno>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
 
+#include <sys/ioctl.h>
+#ifdef __linux__
+#include <sys/sendfile.h>
+#include <linux/sockios.h>
+#endif
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <netinet/in.h>
 #include <netinet/tcp.h>
 #include <unistd.h>
 #include <fcntl.h>
 
+#ifdef __linux__
+#include <linux/errqueue.h>
+#endif
+
+#if defined(SO_ZEROCOPY) && defined(MSG_ZEROCOPY) && defined(SO_EE_ORIGIN_ZEROCOPY)
+#define ZENOMT_HAVE_ZEROCOPY 1
+#endif
+
 #include "../include/zenomt/Retainer.hpp"
 #include "../include/zenomt/PosixStreamPlatformAdapter.hpp"
 
 namespace com { namespace zenomt {
 
 static const size_t INPUT_BUFFER_SIZE = 65536;
+static const size_t MIN_READ_SIZE = 4096;
+static const size_t OUTPUT_CHUNK_SIZE = 16384; // copied writes are coalesced into chunks of at least this size
+static const int MAX_IOV = 64; // segments per sendmsg()
+static const Duration AUTOTUNE_INTERVAL = 0.1;
+static const size_t AUTOTUNE_MAX_LOWAT = 8 * 1024 * 1024;
+static const size_t AUTOTUNE_MAX_WRITE_SIZE = 1024 * 1024;
+static const Duration PACING_BURST_INTERVAL = 0.01; // the token bucket holds this much time's worth of sending
+static const size_t PACING_MIN_BURST = 4096;
+static const size_t PACING_QUANTUM = 1500; // don't wake up to send less than about a packet
+static const Duration PACING_ESTIMATE_INTERVAL = 0.1;
+static const Duration ZEROCOPY_LINGER_INTERVAL = 0.05; // check for completions this often after close()
+static const Duration ZEROCOPY_LINGER_TIMEOUT = 60; // then abort the connection
+
+#ifdef __linux__
+// struct tcp_info from <linux/tcp.h>, which can't be included with <netinet/tcp.h>. glibc's
+// copy is missing the newer fields. the kernel only ever appends, and tells us how much
+// it filled in.
+struct _linux_tcp_info {
+	uint8_t  tcpi_state;
+	uint8_t  tcpi_ca_state;
+	uint8_t  tcpi_retransmits;
+	uint8_t  tcpi_probes;
+	uint8_t  tcpi_backoff;
+	uint8_t  tcpi_options;
+	uint8_t  tcpi_wscale;
+	uint8_t  tcpi_flags;
+	uint32_t tcpi_rto;
+	uint32_t tcpi_ato;
+	uint32_t tcpi_snd_mss;
+	uint32_t tcpi_rcv_mss;
+	uint32_t tcpi_unacked;
+	uint32_t tcpi_sacked;
+	uint32_t tcpi_lost;
+	uint32_t tcpi_retrans;
+	uint32_t tcpi_fackets;
+	uint32_t tcpi_last_data_sent;
+	uint32_t tcpi_last_ack_sent;
+	uint32_t tcpi_last_data_recv;
+	uint32_t tcpi_last_ack_recv;
+	uint32_t tcpi_pmtu;
+	uint32_t tcpi_rcv_ssthresh;
+	uint32_t tcpi_rtt;
+	uint32_t tcpi_rttvar;
+	uint32_t tcpi_snd_ssthresh;
+	uint32_t tcpi_snd_cwnd;
+	uint32_t tcpi_advmss;
+	uint32_t tcpi_reordering;
+	uint32_t tcpi_rcv_rtt;
+	uint32_t tcpi_rcv_space;
+	uint32_t tcpi_total_retrans;
+	uint64_t tcpi_pacing_rate;
+	uint64_t tcpi_max_pacing_rate;
+	uint64_t tcpi_bytes_acked;
+	uint64_t tcpi_bytes_received;
+	uint32_t tcpi_segs_out;
+	uint32_t tcpi_segs_in;
+	uint32_t tcpi_notsent_bytes;
+	uint32_t tcpi_min_rtt;
+	uint32_t tcpi_data_segs_in;
+	uint32_t tcpi_data_segs_out;
+	uint64_t tcpi_delivery_rate;
+	uint64_t tcpi_busy_time;
+	uint64_t tcpi_rwnd_limited;
+	uint64_t tcpi_sndbuf_limited;
+	uint32_t tcpi_delivered;
+	uint32_t tcpi_delivered_ce;
+	uint64_t tcpi_bytes_sent;
+	uint64_t tcpi_bytes_retrans;
+};
+
+static socklen_t _getLinuxTCPInfo(int fd, struct _linux_tcp_info *info)
+{
+	socklen_t len = sizeof(*info);
+	memset(info, 0, sizeof(*info));
+	if(::getsockopt(fd, IPPROTO_TCP, TCP_INFO, info, &len) < 0)
+		return 0;
+	return len;
+}
+#endif
+
+static double _pacingBurst(double bytesPerSecond)
+{
+	return std::max(bytesPerSecond * double(PACING_BURST_INTERVAL), double(PACING_MIN_BURST));
+}
+
+ReceiveBufferPool::ReceiveBufferPool(size_t bufferSize, size_t maxBuffers) :
+	m_bufferSize(bufferSize),
+	m_maxBuffers(maxBuffers),
+	m_inUse(0)
+{
+}
+
+ReceiveBufferPool::~ReceiveBufferPool()
+{
+	assert(0 == m_inUse);
+	for(auto it = m_free.begin(); it != m_free.end(); it++)
+		free(*it);
+}
+
+uint8_t *ReceiveBufferPool::acquire()
+{
+	uint8_t *rv = nullptr;
+
+	if(not m_free.empty())
+	{
+		rv = m_free.back();
+		m_free.pop_back();
+	}
+	else if(m_inUse < m_maxBuffers)
+		rv = (uint8_t *)malloc(m_bufferSize);
+
+	if(rv)
+		m_inUse++;
+	return rv;
+}
+
+void ReceiveBufferPool::release(uint8_t *buffer)
+{
+	assert(m_inUse);
+	m_inUse--;
+	m_free.push_back(buffer);
+}
+
+size_t ReceiveBufferPool::getBufferSize() const
+{
+	return m_bufferSize;
+}
+
+size_t ReceiveBufferPool::getAllocatedCount() const
+{
+	return m_inUse + m_free.size();
+}
+
+size_t ReceiveBufferPool::getInUseCount() const
+{
+	return m_inUse;
+}
+
+// ---
 
 PosixStreamPlatformAdapter::PosixStreamPlatformAdapter(RunLoop *runloop, int unsent_lowat, size_t writeSizePerSelect) :
 	m_clientOpen(true),
 	m_shutdown(false),
 	m_runloop(runloop),
 	m_fd(-1),
+	m_inputBuffer(nullptr),
+	m_inputBufferSize(0),
+	m_readSize(MIN_READ_SIZE),
+	m_readBudget(0),
+	m_useFIONREAD(false),
 	m_unsent_lowat(unsent_lowat),
 	m_writeSizePerSelect(writeSizePerSelect),
+	m_writableRegistered(false),
+	m_optimisticWrites(false),
+	m_optimisticPending(false),
+	m_corked(false),
+	m_outputBytes(0),
+#ifdef __linux__
+	m_sendfileUnsupported(false),
+#else
+	m_sendfileUnsupported(true), // only Linux's sendfile(2) is used; elsewhere, always pread and send
+#endif
+	m_autoTune(false),
+	m_lastAutoTune(-INFINITY),
+	m_tcpInfoNext(0),
+	m_tcpInfoCapacity(0),
+	m_pacingRate(0),
+	m_pacingAllowKernel(true),
+	m_kernelPacing(false),
+	m_pacingGain(0),
+	m_lastPacingEstimate(-INFINITY),
+	m_pacingTokens(0),
+	m_pacingRefilled(0),
+	m_zerocopyThreshold(0),
+	m_zerocopyNextSeq(0),
+	m_zerocopyLingerTimeout(ZEROCOPY_LINGER_TIMEOUT),
+	m_zerocopyStats(),
+	m_ioStats(),
+	m_queuedBelowThreshold(0),
 	m_doLaterAllowed(std::make_shared<bool>(true))
 {
-	m_inputBuffer = (uint8_t *)calloc(1, INPUT_BUFFER_SIZE);
 }
 
 PosixStreamPlatformAdapter::~PosixStreamPlatformAdapter()
@@ -46,6 +234,7 @@ void PosixStreamPlatformAdapter::attachToRunLoop(RunLoop *runloop)
 	m_runloop = runloop;
 	tryRegisterReadable();
 	tryRegisterWritable();
+	tryRegisterException();
 }
 
 void PosixStreamPlatformAdapter::detachFromRunLoop()
@@ -53,18 +242,36 @@ void PosixStreamPlatformAdapter::detachFromRunLoop()
 	if(m_runloop)
 		m_runloop->unregisterDescriptor(m_fd);
 	m_runloop = nullptr;
+	m_writableRegistered = false;
+	if(m_corkFlush)
+		m_corkFlush->cancel();
+	m_corkFlush.reset();
 }
 
 void PosixStreamPlatformAdapter::close()
 {
 	*m_doLaterAllowed = false;
+	stopTCPInfoSampling();
+	onTCPInfoSample = nullptr;
+	if(m_pacingTimer)
+		m_pacingTimer->cancel();
+	m_pacingTimer.reset();
+	if(m_corkFlush)
+		m_corkFlush->cancel();
+	m_corkFlush.reset();
 
 	if(m_fd >= 0)
 	{
 		if(m_runloop)
 			m_runloop->unregisterDescriptor(m_fd);
-		::close(m_fd);
+		if(not m_zerocopyPinned.empty())
+			reapZeroCopyCompletions();
+		if(m_zerocopyPinned.empty())
+			::close(m_fd);
+		else
+			lingerForZeroCopy();
 		m_fd = -1;
+		m_writableRegistered = false;
 	}
 
 	Task cb;
@@ -120,7 +327,20 @@ Time PosixStreamPlatformAdapter::getCurrentTime()
 void PosixStreamPlatformAdapter::notifyWhenWritable(const onwritable_f &onwritable)
 {
 	m_onwritable = onwritable;
-	tryRegisterWritable();
+
+	if(m_corked and m_onwritable)
+		scheduleCorkFlush();
+	else if(m_optimisticWrites and m_onwritable and m_runloop and (m_fd >= 0) and m_outputChain.empty() and not (m_writableRegistered or m_pacingTimer))
+	{
+		if(not m_optimisticPending)
+		{
+			m_optimisticPending = true;
+			auto myself = retain_ref(this);
+			doLater([myself] { myself->onOptimisticWritable(); });
+		}
+	}
+	else
+		tryRegisterWritable();
 }
 
 void PosixStreamPlatformAdapter::setOnReceiveBytesCallback(const onreceivebytes_f &onreceivebytes)
@@ -129,6 +349,11 @@ void PosixStreamPlatformAdapter::setOnReceiveBytesCallback(const onreceivebytes_
 	tryRegisterReadable();
 }
 
+bool PosixStreamPlatformAdapter::isReceiveBufferWritable()
+{
+	return true;
+}
+
 void PosixStreamPlatformAdapter::setOnStreamDidCloseCallback(const Task &onstreamdidclose)
 {
 	m_onstreamdidclose = onstreamdidclose;
@@ -150,9 +375,474 @@ bool PosixStreamPlatformAdapter::writeBytes(const void *bytes_, size_t len)
 		return false;
 
 	const uint8_t *bytes = (const uint8_t *)bytes_;
-	m_outputBuffer.insert(m_outputBuffer.end(), bytes, bytes + len);
+
+	if(0 == len)
+		return true;
+
+	if(m_outputChain.empty() or (not m_outputChain.back().m_copy) or (m_outputChain.back().m_copy->capacity() - m_outputChain.back().m_copy->size() < len))
+	{
+		// never grow an existing copy, so segment pointers stay valid.
+		auto copy = std::make_shared<std::vector<uint8_t>>();
+		copy->reserve(std::max(len, OUTPUT_CHUNK_SIZE));
+		m_outputChain.push_back({ copy, copy->data(), 0, copy.get(), -1, 0, false });
+	}
+
+	OutputSegment &tail = m_outputChain.back();
+	tail.m_copy->insert(tail.m_copy->end(), bytes, bytes + len);
+	tail.m_len += len;
+	m_outputBytes += len;
+
+	if(m_corked)
+		scheduleCorkFlush();
+
+	return true;
+}
+
+bool PosixStreamPlatformAdapter::writeSharedBytes(const std::shared_ptr<const void> &owner, const void *bytes, size_t len)
+{
+	if(m_fd < 0)
+		return false;
+
+	if(len <= OUTPUT_CHUNK_SIZE / 8)
+		return writeBytes(bytes, len); // not worth its own iovec
+
+	m_outputChain.push_back({ owner, (const uint8_t *)bytes, len, nullptr, -1, 0, false });
+	m_outputBytes += len;
+
+	if(m_corked)
+		scheduleCorkFlush();
+
+	return true;
+}
+
+bool PosixStreamPlatformAdapter::writeFileRange(int fd, int64_t offset, size_t len)
+{
+	if(m_fd < 0)
+		return false;
+
+	if(0 == len)
+		return true;
+
+	// our own descriptor, so the caller can close theirs as soon as this returns.
+	int file = ::dup(fd);
+	if(file < 0)
+	{
+		::perror("dup");
+		return false;
+	}
+
+	std::shared_ptr<const void> owner(nullptr, [file] (const void *) { ::close(file); });
+
+	m_outputChain.push_back({ owner, nullptr, len, nullptr, file, offset, m_sendfileUnsupported });
+	m_outputBytes += len;
+
+	if(m_corked)
+		scheduleCorkFlush();
+
+	return true;
+}
+
+size_t PosixStreamPlatformAdapter::getOutputQueueSize() const
+{
+	return m_outputBytes;
+}
+
+void PosixStreamPlatformAdapter::setReceiveBufferPool(const std::shared_ptr<ReceiveBufferPool> &pool)
+{
+	m_receiveBufferPool = pool;
+}
+
+bool PosixStreamPlatformAdapter::hasPrivateReceiveBuffer() const
+{
+	return m_inputBuffer;
+}
+
+void PosixStreamPlatformAdapter::setReadBudget(size_t budget)
+{
+	m_readBudget = budget;
+}
+
+void PosixStreamPlatformAdapter::setUseFIONREAD(bool use)
+{
+	m_useFIONREAD = use;
+}
+
+bool PosixStreamPlatformAdapter::setReceiveLowWatermark(int lowat)
+{
+	return (m_fd >= 0) and (0 == ::setsockopt(m_fd, SOL_SOCKET, SO_RCVLOWAT, &lowat, sizeof(lowat)));
+}
+
+PosixStreamPlatformAdapter::IOStats PosixStreamPlatformAdapter::getIOStats() const
+{
+	return m_ioStats;
+}
+
+void PosixStreamPlatformAdapter::setAutoTune(bool enable)
+{
+	m_autoTune = enable;
+	m_lastAutoTune = -INFINITY;
+}
+
+int PosixStreamPlatformAdapter::getUnsentLowat() const
+{
+	return m_unsent_lowat;
+}
+
+size_t PosixStreamPlatformAdapter::getWriteSizePerSelect() const
+{
+	return m_writeSizePerSelect;
+}
+
+void PosixStreamPlatformAdapter::computeAutoTuneSizes(Duration rtt, double bytesPerSecond, size_t mss, size_t *unsentLowat, size_t *writeSizePerSelect)
+{
+	// the kernel should hold enough unsent data to keep sending at the current rate while we
+	// wait to be woken up and refill it; we allow a quarter RTT for that. any more just delays
+	// our prioritization decisions. each wakeup should refill about what the kernel will want.
+	mss = std::max(mss, size_t(536));
+	double bdp = bytesPerSecond * rtt;
+	size_t lowat = std::min(std::max(size_t(bdp / 4), 2 * mss), AUTOTUNE_MAX_LOWAT);
+	*unsentLowat = lowat;
+	*writeSizePerSelect = std::min(std::max(lowat, mss), AUTOTUNE_MAX_WRITE_SIZE);
+}
+
+void PosixStreamPlatformAdapter::autoTune()
+{
+#ifdef TCP_NOTSENT_LOWAT
+	Time now = m_runloop->getCurrentTime();
+	if(now - m_lastAutoTune < AUTOTUNE_INTERVAL)
+		return;
+	m_lastAutoTune = now;
+
+	TCPInfo info;
+	if((not getTCPInfo(&info)) or (info.m_rtt <= 0) or (0 == info.m_mss))
+		return; // not TCP, or nothing measured yet
+
+	double rate = info.m_deliveryRate;
+	if(rate <= 0)
+		rate = double(info.m_cwnd) * info.m_mss / info.m_rtt; // the most cwnd would allow
+
+	size_t lowat, writeSize;
+	computeAutoTuneSizes(info.m_rtt, rate, info.m_mss, &lowat, &writeSize);
+
+	// some hysteresis, so we don't make a system call for every little wiggle.
+	if((lowat > m_unsent_lowat * 1.25) or (lowat < m_unsent_lowat * 0.75))
+	{
+		int val = (int)lowat;
+		if(0 == ::setsockopt(m_fd, IPPROTO_TCP, TCP_NOTSENT_LOWAT, &val, sizeof(val)))
+			m_unsent_lowat = val;
+	}
+	m_writeSizePerSelect = writeSize;
+#endif
+}
+
+bool PosixStreamPlatformAdapter::getTCPInfo(TCPInfo *dst)
+{
+#ifdef __linux__
+	struct _linux_tcp_info info;
+	socklen_t len;
+	if((m_fd < 0) or ((len = _getLinuxTCPInfo(m_fd, &info)) < offsetof(_linux_tcp_info, tcpi_rcv_rtt)))
+		return false; // not TCP
+
+	// _getLinuxTCPInfo() zeroed anything an older kernel didn't fill in.
+	*dst = TCPInfo();
+	dst->m_time = m_runloop ? m_runloop->getCurrentTime() : 0;
+	dst->m_rtt = info.tcpi_rtt / 1000000.0;
+	dst->m_rttVariance = info.tcpi_rttvar / 1000000.0;
+	dst->m_minRTT = info.tcpi_min_rtt / 1000000.0;
+	dst->m_mss = info.tcpi_snd_mss;
+	dst->m_cwnd = info.tcpi_snd_cwnd;
+	dst->m_ssthresh = info.tcpi_snd_ssthresh;
+	dst->m_unacked = info.tcpi_unacked;
+	dst->m_retransmits = info.tcpi_total_retrans;
+	dst->m_lost = info.tcpi_lost;
+	dst->m_notsentBytes = info.tcpi_notsent_bytes;
+	dst->m_deliveryRate = info.tcpi_delivery_rate;
+	dst->m_pacingRate = info.tcpi_pacing_rate;
+	dst->m_bytesSent = info.tcpi_bytes_sent;
+	dst->m_bytesAcked = info.tcpi_bytes_acked;
+	dst->m_bytesReceived = info.tcpi_bytes_received;
+
+	// the kernel's packets-in-flight: unacked, less what's been SACKed or lost, plus retransmits.
+	int64_t segments = int64_t(info.tcpi_unacked) - info.tcpi_sacked - info.tcpi_lost + info.tcpi_retrans;
+	dst->m_bytesInFlight = segments > 0 ? uint64_t(segments) * info.tcpi_snd_mss : 0;
 
 	return true;
+#else
+	(void)dst;
+	return false;
+#endif
+}
+
+void PosixStreamPlatformAdapter::startTCPInfoSampling(Duration interval, size_t capacity)
+{
+	stopTCPInfoSampling();
+	if((not m_runloop) or (0 == capacity))
+		return;
+
+	m_tcpInfoRing.clear();
+	m_tcpInfoRing.reserve(capacity);
+	m_tcpInfoNext = 0;
+	m_tcpInfoCapacity = capacity;
+
+	// not retaining ourselves; the timer is canceled by close() and stopTCPInfoSampling().
+	m_tcpInfoTimer = m_runloop->scheduleRel([this] (const std::shared_ptr<Timer> &sender, Time now) { onTCPInfoSampleTimer(); }, 0, interval);
+}
+
+void PosixStreamPlatformAdapter::stopTCPInfoSampling()
+{
+	if(m_tcpInfoTimer)
+		m_tcpInfoTimer->cancel();
+	m_tcpInfoTimer.reset();
+}
+
+std::vector<TCPInfo> PosixStreamPlatformAdapter::getTCPInfoHistory() const
+{
+	if(m_tcpInfoRing.size() < m_tcpInfoCapacity)
+		return m_tcpInfoRing;
+
+	std::vector<TCPInfo> rv(m_tcpInfoRing.begin() + m_tcpInfoNext, m_tcpInfoRing.end());
+	rv.insert(rv.end(), m_tcpInfoRing.begin(), m_tcpInfoRing.begin() + m_tcpInfoNext);
+	return rv;
+}
+
+void PosixStreamPlatformAdapter::onTCPInfoSampleTimer()
+{
+	auto myself = retain_ref(this);
+
+	TCPInfo info;
+	if(not getTCPInfo(&info))
+		return;
+
+	if(m_tcpInfoRing.size() < m_tcpInfoCapacity)
+		m_tcpInfoRing.push_back(info);
+	else
+		m_tcpInfoRing[m_tcpInfoNext] = info;
+	m_tcpInfoNext = (m_tcpInfoNext + 1) % m_tcpInfoCapacity;
+
+	if(onTCPInfoSample)
+		onTCPInfoSample(info);
+}
+
+bool PosixStreamPlatformAdapter::setPacingRate(double bytesPerSecond, bool allowKernel)
+{
+	m_pacingGain = 0;
+	m_pacingAllowKernel = allowKernel;
+	applyPacingRate(bytesPerSecond);
+	return m_kernelPacing;
+}
+
+double PosixStreamPlatformAdapter::getPacingRate() const
+{
+	return m_pacingRate;
+}
+
+bool PosixStreamPlatformAdapter::isKernelPacing() const
+{
+	return m_kernelPacing;
+}
+
+void PosixStreamPlatformAdapter::setEstimatedPacing(double gain, bool allowKernel)
+{
+	m_pacingGain = std::max(gain, 0.0);
+	m_pacingAllowKernel = allowKernel;
+	m_lastPacingEstimate = -INFINITY;
+}
+
+double PosixStreamPlatformAdapter::getAchievedRate() const
+{
+	return m_runloop ? m_sendRate.getRate(m_runloop->getCurrentTime()) : 0;
+}
+
+void PosixStreamPlatformAdapter::applyPacingRate(double bytesPerSecond)
+{
+	bool wasTokenPacing = isTokenPacing();
+	if(wasTokenPacing)
+		getPacingAllowance(); // credit the old rate up to now
+
+	bytesPerSecond = std::max(bytesPerSecond, 0.0);
+	bool wasKernelPacing = m_kernelPacing;
+	m_kernelPacing = false;
+
+#if defined(__linux__) && defined(SO_MAX_PACING_RATE)
+	// the kernel accepts the option for any socket, but only TCP (or the fq qdisc) paces.
+	struct _linux_tcp_info info;
+	bool useKernel = m_pacingAllowKernel and (bytesPerSecond > 0) and (m_fd >= 0) and _getLinuxTCPInfo(m_fd, &info);
+	if(useKernel or wasKernelPacing)
+	{
+		uint32_t val = (useKernel and (bytesPerSecond < UINT32_MAX)) ? uint32_t(bytesPerSecond) : UINT32_MAX; // UINT32_MAX is unlimited
+		m_kernelPacing = (0 == ::setsockopt(m_fd, SOL_SOCKET, SO_MAX_PACING_RATE, &val, sizeof(val))) and useKernel;
+	}
+#else
+	(void)wasKernelPacing;
+#endif
+
+	m_pacingRate = bytesPerSecond;
+
+	if(isTokenPacing())
+	{
+		if(not wasTokenPacing)
+		{
+			m_pacingTokens = _pacingBurst(m_pacingRate);
+			m_pacingRefilled = m_runloop ? m_runloop->getCurrentTimeNoCache() : 0;
+		}
+	}
+	else if(m_pacingTimer)
+	{
+		m_pacingTimer->cancel();
+		m_pacingTimer.reset();
+		tryRegisterWritable();
+	}
+}
+
+void PosixStreamPlatformAdapter::estimatePacingRate()
+{
+	Time now = m_runloop->getCurrentTime();
+	if(now - m_lastPacingEstimate < PACING_ESTIMATE_INTERVAL)
+		return;
+	m_lastPacingEstimate = now;
+
+	TCPInfo info;
+	if((not getTCPInfo(&info)) or (info.m_deliveryRate <= 0))
+		return; // not TCP, or nothing measured yet
+
+	// some hysteresis, so we don't make a system call for every little wiggle.
+	double rate = info.m_deliveryRate * m_pacingGain;
+	if((rate > m_pacingRate * 1.1) or (rate < m_pacingRate * 0.9))
+		applyPacingRate(rate);
+}
+
+bool PosixStreamPlatformAdapter::isTokenPacing() const
+{
+	return (m_pacingRate > 0) and not m_kernelPacing;
+}
+
+size_t PosixStreamPlatformAdapter::getPacingAllowance()
+{
+	if(not isTokenPacing())
+		return SIZE_MAX;
+
+	Time now = m_runloop ? m_runloop->getCurrentTimeNoCache() : m_pacingRefilled;
+	m_pacingTokens = std::min(m_pacingTokens + double(now - m_pacingRefilled) * m_pacingRate, _pacingBurst(m_pacingRate));
+	m_pacingRefilled = now;
+
+	return m_pacingTokens > 0 ? size_t(m_pacingTokens) : 0;
+}
+
+bool PosixStreamPlatformAdapter::isPacingThrottled()
+{
+	return isTokenPacing() and m_outputBytes and (getPacingAllowance() < std::min(m_outputBytes, PACING_QUANTUM));
+}
+
+void PosixStreamPlatformAdapter::waitForPacingTokens()
+{
+	if(m_pacingTimer or (not m_runloop) or (m_fd < 0))
+		return;
+
+	// stop listening for writable until there are tokens to send with, or we'd spin.
+	m_runloop->unregisterDescriptor(m_fd, RunLoop::WRITABLE);
+	m_writableRegistered = false;
+
+	double wanted = double(std::min(m_outputBytes, PACING_QUANTUM)) - m_pacingTokens;
+
+	// not retaining ourselves; the timer is canceled by close() and applyPacingRate().
+	m_pacingTimer = m_runloop->scheduleRel([this] (const std::shared_ptr<Timer> &sender, Time now) {
+		m_pacingTimer.reset();
+		tryRegisterWritable();
+	}, std::max(wanted / m_pacingRate, 0.0));
+}
+
+void PosixStreamPlatformAdapter::setOptimisticWrites(bool enable)
+{
+	m_optimisticWrites = enable;
+}
+
+void PosixStreamPlatformAdapter::setCorked(bool corked)
+{
+	m_corked = corked;
+
+	if(m_corked)
+	{
+		if(m_onwritable or not m_outputChain.empty())
+			scheduleCorkFlush();
+	}
+	else
+	{
+		if(m_corkFlush)
+			m_corkFlush->cancel();
+		m_corkFlush.reset();
+		tryRegisterWritable();
+	}
+}
+
+bool PosixStreamPlatformAdapter::setZeroCopyThreshold(size_t threshold)
+{
+	m_zerocopyThreshold = 0;
+
+#ifdef ZENOMT_HAVE_ZEROCOPY
+	if((m_fd < 0) or (0 == threshold))
+		return false;
+
+	int val = 1;
+	if(::setsockopt(m_fd, SOL_SOCKET, SO_ZEROCOPY, &val, sizeof(val)) < 0)
+		return false;
+
+	m_zerocopyThreshold = threshold;
+	tryRegisterException();
+	return true;
+#else
+	(void)threshold;
+	return false;
+#endif
+}
+
+PosixStreamPlatformAdapter::ZeroCopyStats PosixStreamPlatformAdapter::getZeroCopyStats() const
+{
+	return m_zerocopyStats;
+}
+
+size_t PosixStreamPlatformAdapter::getPinnedSegmentCount() const
+{
+	return m_zerocopyPinned.size();
+}
+
+void PosixStreamPlatformAdapter::setZeroCopyLingerTimeout(Duration timeout)
+{
+	m_zerocopyLingerTimeout = timeout;
+}
+
+size_t PosixStreamPlatformAdapter::getQueuedByteCount(bool includeOS)
+{
+	size_t rv = m_outputBytes;
+
+#ifdef SIOCOUTQ
+	int unsent = 0;
+	if(includeOS and (m_fd >= 0) and (0 == ::ioctl(m_fd, SIOCOUTQ, &unsent)) and (unsent > 0))
+		rv += unsent;
+#else
+	(void)includeOS;
+#endif
+
+	return rv;
+}
+
+void PosixStreamPlatformAdapter::notifyWhenQueuedBelow(size_t threshold, const Task &task)
+{
+	m_queuedBelowThreshold = threshold;
+	m_onqueuedbelow = task;
+	checkQueuedBelow();
+}
+
+void PosixStreamPlatformAdapter::checkQueuedBelow()
+{
+	// the writable handler stays registered while there's output queued, so we'll be back
+	// here after every send until the queue is small enough.
+	if(m_onqueuedbelow and (m_outputBytes <= m_queuedBelowThreshold))
+	{
+		Task task;
+		swap(task, m_onqueuedbelow);
+		if(m_runloop)
+			doLater(task);
+	}
 }
 
 void PosixStreamPlatformAdapter::onClientClosed()
@@ -160,6 +850,7 @@ void PosixStreamPlatformAdapter::onClientClosed()
 	*m_doLaterAllowed = false;
 	m_clientOpen = false;
 	m_onwritable = nullptr;
+	m_onqueuedbelow = nullptr;
 	m_onreceivebytes = nullptr;
 	m_onstreamdidclose = nullptr;
 	closeIfDone();
@@ -177,84 +868,531 @@ void PosixStreamPlatformAdapter::onInterfaceReadable()
 		return;
 	}
 
-	ssize_t rv = ::recvfrom(m_fd, m_inputBuffer, INPUT_BUFFER_SIZE, 0, nullptr, nullptr);
+	m_ioStats.m_readableEvents++;
+
+	size_t total = 0;
+	while(true)
+	{
+		size_t wanted = m_readSize;
+		if(m_useFIONREAD and total)
+		{
+			// ask rather than find out with a read that fails with EAGAIN.
+			int available = 0;
+			m_ioStats.m_ioctlCalls++;
+			if((::ioctl(m_fd, FIONREAD, &available) < 0) or (available <= 0))
+				break;
+			wanted = available;
+		}
+
+		bool filled = false;
+		ssize_t rv = readAndDeliver(wanted, filled);
+		if(rv <= 0)
+			break;
+		total += rv;
+
+		if((total >= m_readBudget) or (not (filled or m_useFIONREAD)) or (m_fd < 0) or m_shutdown or not m_onreceivebytes)
+			break; // a short read means we've probably drained the socket
+	}
+}
+
+ssize_t PosixStreamPlatformAdapter::readAndDeliver(size_t wanted, bool &filled)
+{
+	// the pool is held until the buffer is returned, in case the callback changes pools.
+	std::shared_ptr<ReceiveBufferPool> pool = m_receiveBufferPool;
+	uint8_t *buffer = pool ? pool->acquire() : nullptr;
+	size_t bufferSize;
+	if(buffer)
+		bufferSize = pool->getBufferSize();
+	else
+	{
+		// read sizes only adapt when tuned for many connections (with a pool) or for draining.
+		if(pool or m_readBudget)
+			bufferSize = std::max(std::min(wanted, INPUT_BUFFER_SIZE), MIN_READ_SIZE);
+		else
+			bufferSize = INPUT_BUFFER_SIZE;
+		buffer = getPrivateReceiveBuffer(bufferSize);
+		pool.reset();
+
+		if(not buffer)
+		{
+			close();
+			if(m_onstreamdidclose)
+				m_onstreamdidclose();
+			return -1;
+		}
+	}
+
+	bool ok = false;
+	ssize_t rv = ::recvfrom(m_fd, buffer, bufferSize, 0, nullptr, nullptr);
+	m_ioStats.m_readCalls++;
 	if(0 == rv)
-		goto error; // if we select and get 0 from recvfrom, the other side has closed.
-	if(rv < 0)
+		; // if we select and get 0 from recvfrom, the other side has closed.
+	else if(rv < 0)
 	{
 		if((EAGAIN == errno) or (EINTR == errno))
-			return;
-		if(errno)
+			ok = true;
+		else if(errno)
 			::perror("recvfrom");
-		goto error;
 	}
+	else
+	{
+		m_ioStats.m_readBytes += rv;
+		filled = (size_t)rv == bufferSize;
+		adaptReadSize(rv, bufferSize);
 
-	if(m_shutdown)
-		return; // discard any read data if we're shutting down
+		if(m_shutdown)
+			ok = true; // discard any read data if we're shutting down
+		else if(m_clientOpen)
+		{
+			ok = true;
+			if(not m_onreceivebytes(buffer, (size_t)rv))
+				m_onreceivebytes = nullptr;
+		}
+	}
+
+	if(pool)
+		pool->release(buffer);
 
-	if(not m_clientOpen)
-		goto error;
+	if(not ok)
+	{
+		close();
+		if(m_onstreamdidclose)
+			m_onstreamdidclose();
+		return -1;
+	}
 
-	if(not m_onreceivebytes(m_inputBuffer, (size_t)rv))
-		m_onreceivebytes = nullptr;
+	return rv < 0 ? 0 : rv;
+}
 
-	return;
+void PosixStreamPlatformAdapter::adaptReadSize(size_t rv, size_t requested)
+{
+	// grow quickly while reads fill what we asked for, and back off slowly for trickles, so
+	// quiet connections keep a small private buffer and busy ones read in big gulps.
+	if((rv == requested) and (m_readSize < INPUT_BUFFER_SIZE))
+		m_readSize = std::min(m_readSize * 2, INPUT_BUFFER_SIZE);
+	else if((rv < m_readSize / 4) and (m_readSize > MIN_READ_SIZE))
+		m_readSize = std::max(m_readSize / 2, MIN_READ_SIZE);
+}
 
-error:
-	close();
-	if(m_onstreamdidclose)
-		m_onstreamdidclose();
+uint8_t *PosixStreamPlatformAdapter::getPrivateReceiveBuffer(size_t size)
+{
+	// only ever grown, and the contents needn't be preserved.
+	if(size > m_inputBufferSize)
+	{
+		free(m_inputBuffer);
+		m_inputBuffer = (uint8_t *)malloc(size);
+		m_inputBufferSize = m_inputBuffer ? size : 0;
+	}
+	return m_inputBuffer;
 }
 
 void PosixStreamPlatformAdapter::onInterfaceWritable()
 {
 	auto myself = retain_ref(this);
+	m_ioStats.m_writableEvents++;
+	processWritable();
+}
+
+void PosixStreamPlatformAdapter::onOptimisticWritable()
+{
+	m_optimisticPending = false;
+	if(m_writableRegistered or m_pacingTimer or (m_fd < 0))
+		return; // the usual way took over in the meantime
 
-	while(m_onwritable and (m_outputBuffer.size() < m_writeSizePerSelect))
+	m_ioStats.m_optimisticWrites++;
+	processWritable(); // if the socket isn't writable after all, the send gets EAGAIN and we register
+}
+
+void PosixStreamPlatformAdapter::scheduleCorkFlush()
+{
+	// if we're waiting for writable (or pacing tokens), everything goes out from there.
+	if(m_corkFlush or (not m_runloop) or (m_fd < 0) or m_writableRegistered or m_pacingTimer)
+		return;
+
+	// not retaining ourselves; the observer is canceled by close() and detachFromRunLoop().
+	m_corkFlush = m_runloop->addCycleObserver(RunLoop::PREPARE, [this] { onCorkFlush(); });
+}
+
+void PosixStreamPlatformAdapter::onCorkFlush()
+{
+	auto myself = retain_ref(this);
+
+	// m_corkFlush stays set until we're done, so writes made by onwritable don't schedule another.
+	if((m_fd >= 0) and (m_onwritable or not m_outputChain.empty()) and not (m_writableRegistered or m_pacingTimer))
+	{
+		m_ioStats.m_corkedFlushes++;
+		processWritable();
+	}
+
+	if(m_corkFlush)
+		m_corkFlush->cancel();
+	m_corkFlush.reset();
+}
+
+void PosixStreamPlatformAdapter::processWritable()
+{
+	if(m_autoTune)
+		autoTune();
+
+	if(m_pacingGain > 0)
+		estimatePacingRate();
+
+	if(not m_zerocopyPinned.empty())
+		reapZeroCopyCompletions(); // in case the run loop doesn't report error queue readiness
+
+	while(m_onwritable and (m_outputBytes < m_writeSizePerSelect))
 	{
 		if(not m_onwritable())
 			m_onwritable = nullptr;
 	}
 
-	if(m_outputBuffer.size())
+	if(not sendOutputChain())
 	{
-		uint8_t *buf = m_outputBuffer.data();
-		size_t len = m_outputBuffer.size();
-		int flags = 0;
+		close();
+		if(m_onstreamdidclose)
+			m_onstreamdidclose();
+		return;
+	}
+
+	checkQueuedBelow();
+
+	if(isPacingThrottled())
+		waitForPacingTokens();
+	else if(m_outputChain.empty() and m_runloop and not m_onwritable)
+	{
+		m_runloop->unregisterDescriptor(m_fd, RunLoop::WRITABLE);
+		m_writableRegistered = false;
+	}
+	else
+		tryRegisterWritable(); // more to do
+
+	closeIfDone();
+}
+
+bool PosixStreamPlatformAdapter::sendOutputChain()
+{
+	// gather as many segments as we can into each sendmsg(). on a partial send, just advance
+	// past what was sent; nothing is moved. when pacing with the token bucket, send no more
+	// than the tokens allow.
+	while(not m_outputChain.empty())
+	{
+		if(isPacingThrottled())
+			break;
+		size_t allowance = getPacingAllowance();
+
+		if(not isGatherable(m_outputChain.front()))
+		{
+			size_t before = m_outputBytes;
+			if(not (m_outputChain.front().m_file >= 0 ? sendFileSegment(allowance) : sendZeroCopy(allowance)))
+				return false;
+			if(m_outputBytes == before)
+				break; // nothing sent, socket buffer is full
+			continue;
+		}
+
+		struct iovec iov[MAX_IOV];
+		struct msghdr msg;
+		size_t total = 0;
+		int count = 0;
+
+		for(auto it = m_outputChain.begin(); (it != m_outputChain.end()) and (count < MAX_IOV) and (total < allowance) and ((0 == count) or isGatherable(*it)); it++, count++)
+		{
+			iov[count].iov_base = (void *)it->m_bytes;
+			iov[count].iov_len = std::min(it->m_len, allowance - total);
+			total += iov[count].iov_len;
+		}
 
+		memset(&msg, 0, sizeof(msg));
+		msg.msg_iov = iov;
+		msg.msg_iovlen = count;
+
+		int flags = 0;
 #ifdef MSG_NOSIGNAL
 		flags |= MSG_NOSIGNAL;
 #endif
+#ifdef MSG_MORE
+		if(m_corked and (size_t(count) < m_outputChain.size()))
+			flags |= MSG_MORE; // there's more right behind this
+#endif
 
-		ssize_t rv = ::sendto(m_fd, buf, len, flags, nullptr, 0);
+		ssize_t rv = ::sendmsg(m_fd, &msg, flags);
+		m_ioStats.m_writeCalls++;
 		if(rv < 0)
 		{
 			if((EAGAIN == errno) or (EINTR == errno))
-				return;
-			::perror("sendto");
-			close();
-			if(m_onstreamdidclose)
-				m_onstreamdidclose();
+				return true;
+			::perror("sendmsg");
+			return false;
+		}
+
+		consumeOutput(rv);
+
+		if((size_t)rv < total)
+			break; // socket buffer is full
+	}
+
+	return true;
+}
+
+void PosixStreamPlatformAdapter::consumeOutput(size_t len)
+{
+	assert(len <= m_outputBytes);
+	m_ioStats.m_writeBytes += len;
+	m_outputBytes -= len;
+	if(isTokenPacing())
+		m_pacingTokens -= len;
+	if(m_runloop)
+		m_sendRate.update(len, m_runloop->getCurrentTime());
+
+	while(len)
+	{
+		OutputSegment &front = m_outputChain.front();
+		if(len < front.m_len)
+		{
+			if(front.m_file >= 0)
+				front.m_fileOffset += len;
+			else
+				front.m_bytes += len;
+			front.m_len -= len;
 			return;
 		}
-		else if((size_t)rv < len)
+
+		len -= front.m_len;
+		m_outputChain.pop_front();
+	}
+}
+
+bool PosixStreamPlatformAdapter::isZeroCopyEligible(const OutputSegment &segment) const
+{
+	return m_zerocopyThreshold and (segment.m_len >= m_zerocopyThreshold) and (segment.m_file < 0);
+}
+
+bool PosixStreamPlatformAdapter::isGatherable(const OutputSegment &segment) const
+{
+	return (segment.m_file < 0) and not isZeroCopyEligible(segment);
+}
+
+bool PosixStreamPlatformAdapter::sendFileSegment(size_t limit)
+{
+	OutputSegment &front = m_outputChain.front();
+	size_t len = std::min(front.m_len, limit);
+	ssize_t rv = -1;
+
+#ifdef __linux__
+	if(not front.m_pread)
+	{
+		off_t offset = front.m_fileOffset;
+		rv = ::sendfile(m_fd, front.m_file, &offset, len);
+		m_ioStats.m_writeCalls++;
+		if((rv < 0) and ((EINVAL == errno) or (ENOSYS == errno) or (EOPNOTSUPP == errno)))
 		{
-			::memmove(buf, buf + rv, len - rv);
-			m_outputBuffer.resize(len - rv);
+			front.m_pread = true; // for example, a file that can't be mmapped
+			if(ENOSYS == errno)
+				m_sendfileUnsupported = true; // and never will be
 		}
-		else
-			m_outputBuffer.clear();
 	}
+#endif
 
-	if(m_outputBuffer.empty() and m_runloop and not m_onwritable)
-		m_runloop->unregisterDescriptor(m_fd, RunLoop::WRITABLE);
+	if((rv < 0) and front.m_pread)
+	{
+		// read a piece into a temporary buffer and send what we can. anything not sent is
+		// read again next time.
+		uint8_t buf[INPUT_BUFFER_SIZE];
+		ssize_t got = ::pread(front.m_file, buf, std::min(len, sizeof(buf)), front.m_fileOffset);
+		if(got <= 0)
+		{
+			::perror("pread");
+			return false;
+		}
+		int flags = 0;
+#ifdef MSG_NOSIGNAL
+		flags |= MSG_NOSIGNAL;
+#endif
+		rv = ::send(m_fd, buf, got, flags);
+		m_ioStats.m_writeCalls++;
+	}
 
-	closeIfDone();
+	if(rv < 0)
+	{
+		if((EAGAIN == errno) or (EINTR == errno))
+			return true;
+		::perror(front.m_pread ? "send" : "sendfile");
+		return false;
+	}
+
+	if(0 == rv)
+	{
+		fprintf(stderr, "sendfile: file is shorter than the requested range\n");
+		return false;
+	}
+
+	consumeOutput(rv);
+	return true;
+}
+
+bool PosixStreamPlatformAdapter::sendZeroCopy(size_t limit)
+{
+#ifdef ZENOMT_HAVE_ZEROCOPY
+	OutputSegment &front = m_outputChain.front();
+	struct iovec iov;
+	struct msghdr msg;
+
+	iov.iov_base = (void *)front.m_bytes;
+	iov.iov_len = std::min(front.m_len, limit);
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+
+	ssize_t rv = ::sendmsg(m_fd, &msg, MSG_ZEROCOPY | MSG_NOSIGNAL);
+	m_ioStats.m_writeCalls++;
+	if(rv < 0)
+	{
+		if((EAGAIN == errno) or (EINTR == errno))
+			return true;
+		if(ENOBUFS == errno)
+		{
+			// out of option memory for pinning (too many completions outstanding). copy this
+			// one; we'll try zerocopy again next time.
+			rv = ::send(m_fd, front.m_bytes, iov.iov_len, MSG_NOSIGNAL);
+			m_ioStats.m_writeCalls++;
+			if(rv < 0)
+				return (EAGAIN == errno) or (EINTR == errno);
+			consumeOutput(rv);
+			return true;
+		}
+		::perror("sendmsg(MSG_ZEROCOPY)");
+		return false;
+	}
+
+	if(rv > 0)
+	{
+		// every successful zerocopy send gets the next sequence number, even if partial.
+		m_zerocopyPinned.push_back(std::make_pair(m_zerocopyNextSeq++, front.m_owner));
+		m_zerocopyStats.m_sends++;
+	}
+
+	consumeOutput(rv);
+	return true;
+#else
+	(void)limit;
+	return false;
+#endif
+}
+
+void PosixStreamPlatformAdapter::reapZeroCopyCompletions()
+{
+	reapZeroCopyCompletions(m_fd, m_zerocopyPinned, m_zerocopyStats);
+}
+
+void PosixStreamPlatformAdapter::reapZeroCopyCompletions(int fd, ZeroCopyPinned &pinned, ZeroCopyStats &stats)
+{
+#ifdef ZENOMT_HAVE_ZEROCOPY
+	while(fd >= 0)
+	{
+		uint8_t control[128];
+		struct msghdr msg;
+		memset(&msg, 0, sizeof(msg));
+		msg.msg_control = control;
+		msg.msg_controllen = sizeof(control);
+
+		if(::recvmsg(fd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0)
+			return; // EAGAIN when the error queue is empty
+
+		for(struct cmsghdr *cm = CMSG_FIRSTHDR(&msg); cm; cm = CMSG_NXTHDR(&msg, cm))
+		{
+			if(not (((SOL_IP == cm->cmsg_level) and (IP_RECVERR == cm->cmsg_type))
+			     or ((SOL_IPV6 == cm->cmsg_level) and (IPV6_RECVERR == cm->cmsg_type))))
+				continue;
+
+			struct sock_extended_err serr;
+			memcpy(&serr, CMSG_DATA(cm), sizeof(serr));
+			if((SO_EE_ORIGIN_ZEROCOPY != serr.ee_origin) or serr.ee_errno)
+				continue;
+
+			// [ee_info, ee_data] is an inclusive range of completed sequence numbers. they're
+			// usually but not necessarily in order.
+			uint32_t lo = serr.ee_info;
+			uint32_t count = serr.ee_data - lo + 1;
+			stats.m_completions += count;
+			if(serr.ee_code & SO_EE_CODE_ZEROCOPY_COPIED)
+				stats.m_copied += count;
+
+			for(auto it = pinned.begin(); it != pinned.end(); )
+			{
+				if(it->first - lo < count)
+					it = pinned.erase(it);
+				else
+					it++;
+			}
+		}
+	}
+#endif
+}
+
+void PosixStreamPlatformAdapter::lingerForZeroCopy()
+{
+	// MSG_ZEROCOPY pins the pages, not the allocations, and the kernel keeps sending what's
+	// in the socket buffer after close(2). so hang on to the socket and the owners until the
+	// kernel says it's done with all of them, or until the linger timeout (a peer that keeps
+	// acknowledging zero window probes can keep TCP from ever giving up).
+	int fd = m_fd;
+	auto pinned = std::make_shared<ZeroCopyPinned>();
+	swap(*pinned, m_zerocopyPinned);
+
+	if(not m_runloop)
+	{
+		// no way to wait; abort so the kernel discards what it hasn't sent instead of sending
+		// from memory that's about to be released.
+		abortZeroCopySocket(fd);
+		return;
+	}
+
+	Time deadline = m_runloop->getCurrentTimeNoCache() + m_zerocopyLingerTimeout;
+	m_runloop->scheduleRel([fd, pinned, deadline] (const std::shared_ptr<Timer> &sender, Time now) {
+		ZeroCopyStats stats = ZeroCopyStats();
+		reapZeroCopyCompletions(fd, *pinned, stats);
+		if(pinned->empty())
+			::close(fd);
+		else if(now >= deadline)
+		{
+			abortZeroCopySocket(fd);
+			pinned->clear();
+		}
+		else
+			return;
+		sender->cancel();
+	}, ZEROCOPY_LINGER_INTERVAL, ZEROCOPY_LINGER_INTERVAL);
+}
+
+void PosixStreamPlatformAdapter::abortZeroCopySocket(int fd)
+{
+	struct linger lingerval = { 1, 0 };
+	::setsockopt(fd, SOL_SOCKET, SO_LINGER, &lingerval, sizeof(lingerval));
+	::close(fd);
+}
+
+void PosixStreamPlatformAdapter::onInterfaceException()
+{
+	auto myself = retain_ref(this);
+	reapZeroCopyCompletions();
+
+	int err = 0;
+	socklen_t errlen = sizeof(err);
+	if((m_fd >= 0) and (0 == ::getsockopt(m_fd, SOL_SOCKET, SO_ERROR, &err, &errlen)) and err)
+	{
+		// a real socket error rather than a completion. it would stay pending if we're
+		// not also waiting to read or write.
+		errno = err;
+		::perror("socket");
+		close();
+		if(m_onstreamdidclose)
+			m_onstreamdidclose();
+	}
 }
 
 void PosixStreamPlatformAdapter::closeIfDone()
 {
-	if(m_outputBuffer.empty() and (not m_clientOpen) and (not m_shutdown) and (m_fd >= 0))
+	if(m_outputChain.empty() and (not m_clientOpen) and (not m_shutdown) and (m_fd >= 0))
 	{
 		m_shutdown = true;
 		shutdown(m_fd, SHUT_WR);
@@ -272,10 +1410,21 @@ void PosixStreamPlatformAdapter::tryRegisterReadable()
 
 void PosixStreamPlatformAdapter::tryRegisterWritable()
 {
-	if(m_runloop and (m_fd >= 0) and m_onwritable)
+	// while waiting for pacing tokens, the timer will register.
+	if(m_runloop and (m_fd >= 0) and (m_onwritable or not m_outputChain.empty()) and not (m_pacingTimer or m_writableRegistered))
 	{
 		auto myself = retain_ref(this);
 		m_runloop->registerDescriptor(m_fd, RunLoop::WRITABLE, [myself] { myself->onInterfaceWritable(); });
+		m_writableRegistered = true;
+	}
+}
+
+void PosixStreamPlatformAdapter::tryRegisterException()
+{
+	if(m_runloop and (m_fd >= 0) and m_zerocopyThreshold)
+	{
+		auto myself = retain_ref(this);
+		m_runloop->registerDescriptor(m_fd, RunLoop::EXCEPTION, [myself] { myself->onInterfaceException(); });
 	}
 }
 
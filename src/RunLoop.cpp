@@ -1,6 +1,8 @@
 // Copyright © 2021 Michael Thornburgh
 // SPDX-License-Identifier: MIT
 
+#include <algorithm>
+
 #include "../include/zenomt/RunLoop.hpp"
 
 namespace com { namespace zenomt {
@@ -8,7 +10,9 @@ namespace com { namespace zenomt {
 RunLoop::RunLoop(bool sharedTimeOrigin) :
 	m_timeCache(0),
 	m_timeIsCached(false),
-	m_stopping(false)
+	m_stopping(false),
+	m_cycleObserverDepth(0),
+	m_newPrepareObservers(false)
 {
 	m_origin = sharedTimeOrigin ? std::chrono::steady_clock::time_point() : std::chrono::steady_clock::now();
 }
@@ -93,12 +97,118 @@ void RunLoop::processDoLaters()
 	}
 }
 
+std::shared_ptr<RunLoop::CycleObserver> RunLoop::addCycleObserver(CyclePhase phase, const Task &task, int order)
+{
+	auto rv = share_ref(new CycleObserver(task, order), false);
+	if(m_cycleObserverDepth)
+		m_addedCycleObservers.push_back(std::make_pair(phase, rv)); // don't disturb the dispatch in progress
+	else
+		insertCycleObserver(phase, rv);
+	return rv;
+}
+
+void RunLoop::insertCycleObserver(CyclePhase phase, const std::shared_ptr<CycleObserver> &observer)
+{
+	auto &observers = m_cycleObservers[phase];
+	int order = observer->m_order;
+	auto it = std::upper_bound(observers.begin(), observers.end(), order, [] (int lhs, const std::shared_ptr<CycleObserver> &rhs) { return lhs < rhs->m_order; });
+	observers.insert(it, observer);
+}
+
+void RunLoop::processCycleObservers(CyclePhase phase)
+{
+	auto &observers = m_cycleObservers[phase];
+	if(PREPARE == phase)
+		m_newPrepareObservers = false;
+	if(observers.empty())
+		return;
+
+	// the vector isn't changed while we're dispatching, so we can walk it without copying.
+	bool sawCanceled = false;
+	m_cycleObserverDepth++;
+	for(size_t x = 0; (x < observers.size()) and not m_stopping; x++)
+	{
+		CycleObserver *each = observers[x].get();
+		if(not each->m_canceled)
+		{
+			each->m_firing = true;
+			each->m_task();
+			each->m_firing = false;
+		}
+		if(each->m_canceled)
+		{
+			each->m_task = nullptr; // in case any circular references
+			sawCanceled = true;
+		}
+	}
+	m_cycleObserverDepth--;
+
+	if(m_cycleObserverDepth)
+		return;
+
+	if(sawCanceled)
+		observers.erase(std::remove_if(observers.begin(), observers.end(), [] (const std::shared_ptr<CycleObserver> &each) { return each->m_canceled; }), observers.end());
+
+	if(not m_addedCycleObservers.empty())
+	{
+		std::vector<std::pair<CyclePhase, std::shared_ptr<CycleObserver>>> added;
+		swap(added, m_addedCycleObservers);
+		for(auto it = added.begin(); it != added.end(); it++)
+		{
+			if(not it->second->m_canceled)
+			{
+				insertCycleObserver(it->first, it->second);
+				if((PREPARE == phase) and (PREPARE == it->first))
+					m_newPrepareObservers = true; // like a cork flush scheduled by another observer
+			}
+		}
+	}
+}
+
+bool RunLoop::hasNewPrepareObservers() const
+{
+	return m_newPrepareObservers;
+}
+
 void RunLoop::clear()
 {
 	m_timers.clear();
 
 	while(hasDoLaters()) // std::queue doesn't have a clear
 		m_doLaters.pop();
+
+	for(size_t phase = 0; phase < NUM_CYCLE_PHASES; phase++)
+	{
+		for(auto it = m_cycleObservers[phase].begin(); it != m_cycleObservers[phase].end(); it++)
+			(*it)->cancel();
+		if(0 == m_cycleObserverDepth)
+			m_cycleObservers[phase].clear();
+	}
+	for(auto it = m_addedCycleObservers.begin(); it != m_addedCycleObservers.end(); it++)
+		it->second->cancel();
+	m_addedCycleObservers.clear();
+}
+
+// ---
+
+RunLoop::CycleObserver::CycleObserver(const Task &task, int order) :
+	m_task(task),
+	m_order(order),
+	m_canceled(not task),
+	m_firing(false)
+{
+}
+
+void RunLoop::CycleObserver::cancel()
+{
+	m_canceled = true;
+	if(not m_firing)
+		m_task = nullptr; // in case any circular references
+}
+
+bool RunLoop::CycleObserver::isCanceled() const
+{
+	return m_canceled;
 }
 
 } } // namespace com::zenomt
@@ -78,8 +78,12 @@ void SelectRunLoop::run(Duration runInterval, Duration minSleep)
 	m_runningInThread = std::this_thread::get_id();
 
 	do {
+		processCycleObservers(PREPARE);
+		if(m_stopping)
+			break;
+
 		struct timeval timeout;
-		Duration sleepTime =  hasDoLaters() ? 0 : m_timers.howLongToNextFire(getCurrentTime());
+		Duration sleepTime = (hasDoLaters() or hasNewPrepareObservers()) ? 0 : m_timers.howLongToNextFire(getCurrentTime());
 		if(sleepTime < minSleep)
 			sleepTime = minSleep;
 		sleepTime += Duration(0.0000005); // 1/2 µs
@@ -117,6 +121,9 @@ void SelectRunLoop::run(Duration runInterval, Duration minSleep)
 				break;
 		}
 
+		if(not m_stopping)
+			processCycleObservers(CHECK);
+
 		processDoLaters();
 
 		if(not m_stopping)
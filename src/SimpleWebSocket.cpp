@@ -1,24 +1,39 @@
 // Copyright © 2022 Michael Thornburgh
 // SPDX-License-Identifier: MIT
 
+#include <algorithm>
 #include <cassert>
 #include <cctype>
+#include <cerrno>
+#include <cstdlib>
 #include <cstring>
-#include <regex>
+#include <random>
+
+#if defined(__linux__)
+#include <sys/random.h>
+#endif
 
 #include "../include/zenomt/Retainer.hpp"
 #include "../include/zenomt/SimpleWebSocket.hpp"
 #include "../include/zenomt/URIParse.hpp"
+#include "../include/zenomt/WebSocketMask.hpp"
 
 namespace {
 
 const uint8_t WS_FLAG_FIN = 0x80;
+const uint8_t WS_FLAG_RSV1 = 0x40; // "per-message compressed" RFC 7692 §6
+const uint8_t WS_FLAG_RSV = 0x70;
 const uint8_t WS_FLAG_MSK = 0x80;
 const uint8_t WS_OPCODE_MASK = 0x0f;
 const uint8_t WS_LENGTH_MASK = 0x7f;
 const size_t WS_LENGTH_16 = 126;
 const size_t WS_LENGTH_64 = 127;
-const size_t WS_MAX_FRAME = 1 << 24; // 16MB, big enough for anything reasonable
+const size_t WS_MAX_CONTROL = 125; // RFC 6455 §5.5
+const size_t WS_INPUT_KEEP = 65536; // keep an input buffer up to this big for re-use when it empties
+const size_t WS_RANDOM_POOL = 256; // CSPRNG bytes fetched at a time for masking keys
+const size_t WS_MAX_HEADER = 14; // with a masking key
+const size_t WS_SHARE_PAYLOAD_MIN = 1024; // smaller shared payloads are just copied
+const size_t RAW_OUTPUT_SHARE_MIN = 65536; // hand a raw output buffer this big to the platform without copying
 
 enum {
 	WS_OP_CONTINUATION = 0x0,
@@ -29,23 +44,6 @@ enum {
 	WS_OP_PONG         = 0xa
 };
 
-std::string _replace(const std::string &s, const char *pattern, const char *fmt)
-{
-	return std::regex_replace(s, std::regex(pattern), fmt);
-}
-
-std::string _trim(const std::string &s)
-{
-	auto left = s.data();
-	auto right = left + s.size();
-
-	while((left < right) and std::isspace(*left))
-		left++;
-	while((right > left) and std::isspace(*(right - 1)))
-		right--;
-	return std::string(left, right);
-}
-
 bool _istchar(int c)
 {
 	// RFC 7230 §3.2.6
@@ -72,6 +70,78 @@ bool _istchar(int c)
 	}
 }
 
+bool _isToken(const char *s, size_t len)
+{
+	for(size_t x = 0; x < len; x++)
+		if(not _istchar(uint8_t(s[x])))
+			return false;
+	return len > 0;
+}
+
+bool _isspace(char c)
+{
+	return (' ' == c) or ('\t' == c) or ('\n' == c) or ('\v' == c) or ('\f' == c) or ('\r' == c);
+}
+
+uint8_t _asciiLower(uint8_t c)
+{
+	return ((c >= 'A') and (c <= 'Z')) ? c + ('a' - 'A') : c;
+}
+
+bool _equalsIgnoringCase(const char *a, const char *b, size_t len)
+{
+	for(size_t x = 0; x < len; x++)
+		if(_asciiLower(a[x]) != _asciiLower(b[x]))
+			return false;
+	return true;
+}
+
+// in place, CRLF becomes LF, any other CR becomes SP, and then an obs-fold (LF followed by SP
+// or HT, RFC 7230 §3.2.4) becomes SP. answer the new length. stretches without anything to
+// change are found with memchr() and moved whole.
+size_t _unfoldHeaderBlock(char *block, size_t len)
+{
+	size_t dst = 0;
+	size_t cursor = 0;
+	while(cursor < len)
+	{
+		const char *cr = (const char *)memchr(block + cursor, '\r', len - cursor);
+		size_t end = cr ? cr - block : len;
+		if(dst != cursor)
+			memmove(block + dst, block + cursor, end - cursor);
+		dst += end - cursor;
+		cursor = end;
+
+		if(cr)
+		{
+			if((cursor + 1 >= len) or ('\n' != block[cursor + 1]))
+				block[dst++] = ' ';
+			cursor++;
+		}
+	}
+
+	len = dst;
+	dst = 0;
+	cursor = 0;
+	while(cursor < len)
+	{
+		const char *lf = (const char *)memchr(block + cursor, '\n', len - cursor);
+		size_t end = lf ? lf - block + 1 : len;
+		if(dst != cursor)
+			memmove(block + dst, block + cursor, end - cursor);
+		dst += end - cursor;
+		cursor = end;
+
+		if(lf and (cursor < len) and ((' ' == block[cursor]) or ('\t' == block[cursor])))
+		{
+			block[dst - 1] = ' ';
+			cursor++;
+		}
+	}
+
+	return dst;
+}
+
 std::string _base64enc(const void *bytes, size_t len, bool pad = true)
 {
 	const char *alphabet = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
@@ -120,6 +190,65 @@ std::string _base64enc(const void *bytes, size_t len, bool pad = true)
 	return rv;
 }
 
+// fill dst from the operating system's CSPRNG.
+void _systemRandomBytes(void *dst_, size_t len)
+{
+	uint8_t *dst = (uint8_t *)dst_;
+#if defined(__APPLE__) || defined(__FreeBSD__) || defined(__OpenBSD__) || defined(__NetBSD__)
+	arc4random_buf(dst, len);
+	len = 0;
+#elif defined(__linux__)
+	while(len)
+	{
+		ssize_t rv = getrandom(dst, len, 0);
+		if(rv < 0)
+		{
+			if(EINTR == errno)
+				continue;
+			break; // very old kernel, try std::random_device below
+		}
+		dst += rv;
+		len -= rv;
+	}
+#endif
+
+	if(len)
+	{
+		std::random_device rd;
+		while(len)
+		{
+			unsigned r = rd();
+			size_t each = std::min(len, sizeof(r));
+			memcpy(dst, &r, each);
+			dst += each;
+			len -= each;
+		}
+	}
+}
+
+size_t _encodeFrameHeader(uint8_t *dst, uint8_t flags, int opcode, size_t len)
+{
+	uint8_t *cursor = dst;
+
+	*cursor++ = flags | (opcode & WS_OPCODE_MASK);
+	if(len > 65535)
+	{
+		*cursor++ = 0 | WS_LENGTH_64;
+		for(int shift = 56; shift >= 0; shift -= 8)
+			*cursor++ = (len >> shift) & 0xff;
+	}
+	else if(len > 125)
+	{
+		*cursor++ = 0 | WS_LENGTH_16;
+		*cursor++ = (len >> 8) & 0xff;
+		*cursor++ = len & 0xff;
+	}
+	else
+		*cursor++ = 0 | len;
+
+	return cursor - dst;
+}
+
 }
 
 namespace com { namespace zenomt { namespace websock {
@@ -161,22 +290,115 @@ void HeaderBodyStream::shutdown()
 	}
 }
 
-void HeaderBodyStream::writeBytes(const void *bytes, size_t len)
+bool HeaderBodyStream::writeBytes(const void *bytes, size_t len)
 {
-	const uint8_t *cursor = (const uint8_t *)bytes;
-	const uint8_t *limit = cursor + len;
-	m_rawOutputBuffer.insert(m_rawOutputBuffer.end(), cursor, limit);
-	scheduleWrite();
+	return queueOutput(nullptr, 0, nullptr, bytes, len);
+}
+
+bool HeaderBodyStream::writeBytes(const Bytes &bytes)
+{
+	return writeBytes(bytes.data(), bytes.size());
+}
+
+bool HeaderBodyStream::writeBytes(const std::string &s)
+{
+	return writeBytes(s.data(), s.size());
+}
+
+bool HeaderBodyStream::writeSharedBytes(const std::shared_ptr<const void> &owner, const void *bytes, size_t len, const void *prefix, size_t prefixLen)
+{
+	return queueOutput(prefix, prefixLen, owner, bytes, len);
+}
+
+size_t HeaderBodyStream::getQueuedByteCount(bool includeOS)
+{
+	return m_rawOutputBuffer.size() + m_sharedOutputBytes + m_platform->getQueuedByteCount(includeOS);
+}
+
+void HeaderBodyStream::setWatermarks(size_t high, size_t low)
+{
+	m_highWatermark = high;
+	m_lowWatermark = std::min(low, high);
+	checkHighWatermark();
+}
+
+bool HeaderBodyStream::isAboveHighWatermark() const
+{
+	return m_aboveHighWatermark;
+}
+
+void HeaderBodyStream::setMaxQueuedBytes(size_t maxQueued, OverflowAction action)
+{
+	m_maxQueuedBytes = maxQueued;
+	m_overflowAction = action;
 }
 
-void HeaderBodyStream::writeBytes(const Bytes &bytes)
+size_t HeaderBodyStream::getDroppedByteCount() const
 {
-	writeBytes(bytes.data(), bytes.size());
+	return m_droppedBytes;
 }
 
-void HeaderBodyStream::writeBytes(const std::string &s)
+bool HeaderBodyStream::getTCPInfo(TCPInfo *dst)
 {
-	writeBytes(s.data(), s.size());
+	return m_platform->getTCPInfo(dst);
+}
+
+bool HeaderBodyStream::queueOutput(const void *prefix, size_t prefixLen, const std::shared_ptr<const void> &owner, const void *bytes, size_t len)
+{
+	if(owner and len)
+	{
+		uint8_t *ignored;
+		if(not reserveOutput(prefix, prefixLen, 0, &ignored, len))
+			return false;
+		m_sharedOutput.push_back({ m_rawOutputBuffer.size(), owner, bytes, len });
+		m_sharedOutputBytes += len;
+	}
+	else
+	{
+		uint8_t *dst;
+		if(not reserveOutput(prefix, prefixLen, len, &dst))
+			return false;
+		if(len)
+			memcpy(dst, bytes, len);
+	}
+
+	commitOutput();
+	return true;
+}
+
+bool HeaderBodyStream::reserveOutput(const void *prefix, size_t prefixLen, size_t len, uint8_t **dst, size_t alsoQueued)
+{
+	if((m_state >= S_ERROR) or m_overflowClosing)
+		return false;
+
+	size_t total = prefixLen + len + alsoQueued;
+	if(m_maxQueuedBytes and (getQueuedByteCount() + total > m_maxQueuedBytes))
+	{
+		if(OVERFLOW_CLOSE == m_overflowAction)
+		{
+			// not from inside the caller's write, where onError could release us or re-enter it.
+			m_overflowClosing = true;
+			auto myself = retain_ref(this);
+			m_platform->doLater([myself] { myself->setClosedState(); });
+		}
+		else
+			m_droppedBytes += total;
+		return false;
+	}
+
+	if(prefixLen)
+		m_rawOutputBuffer.insert(m_rawOutputBuffer.end(), (const uint8_t *)prefix, (const uint8_t *)prefix + prefixLen);
+	size_t offset = m_rawOutputBuffer.size();
+	m_rawOutputBuffer.resize(offset + len);
+	*dst = m_rawOutputBuffer.data() + offset;
+
+	return true;
+}
+
+void HeaderBodyStream::commitOutput()
+{
+	scheduleWrite();
+	checkHighWatermark();
 }
 
 bool HeaderBodyStream::onReceiveBytes(const void *bytes, size_t len)
@@ -206,6 +428,8 @@ void HeaderBodyStream::notifyWhenWritable(const onwritable_f &onwritable)
 void HeaderBodyStream::clearCallbacks()
 {
 	onError = nullptr;
+	onHighWatermark = nullptr;
+	onLowWatermark = nullptr;
 	m_client_onwritable = nullptr;
 }
 
@@ -258,15 +482,75 @@ bool HeaderBodyStream::onWritable()
 
 bool HeaderBodyStream::writeRawOutputBuffer()
 {
-	if((m_state < S_ERROR) and not m_rawOutputBuffer.empty())
+	if((m_state < S_ERROR) and not (m_rawOutputBuffer.empty() and m_sharedOutput.empty()))
 	{
-		m_platform->writeBytes(m_rawOutputBuffer.data(), m_rawOutputBuffer.size());
+		// a big raw buffer is given away rather than copied again by the platform.
+		std::shared_ptr<Bytes> rawOwner;
+		if(m_rawOutputBuffer.size() >= RAW_OUTPUT_SHARE_MIN)
+		{
+			rawOwner = std::make_shared<Bytes>();
+			rawOwner->swap(m_rawOutputBuffer);
+		}
+		const Bytes &raw = rawOwner ? *rawOwner : m_rawOutputBuffer;
+
+		auto writeRaw = [&] (size_t from, size_t to) {
+			if(to <= from)
+				return;
+			if(rawOwner)
+				m_platform->writeSharedBytes(rawOwner, raw.data() + from, to - from);
+			else
+				m_platform->writeBytes(raw.data() + from, to - from);
+		};
+
+		size_t rawCursor = 0;
+		for(auto it = m_sharedOutput.begin(); it != m_sharedOutput.end(); it++)
+		{
+			writeRaw(rawCursor, it->m_rawOffset);
+			rawCursor = it->m_rawOffset;
+			m_platform->writeSharedBytes(it->m_owner, it->m_bytes, it->m_len);
+		}
+		writeRaw(rawCursor, raw.size());
+
 		m_rawOutputBuffer.clear();
+		m_sharedOutput.clear();
+		m_sharedOutputBytes = 0;
+		if(m_aboveHighWatermark)
+			checkLowWatermark();
 		return true;
 	}
 	return false;
 }
 
+void HeaderBodyStream::checkHighWatermark()
+{
+	if(m_highWatermark and (not m_aboveHighWatermark) and (m_state < S_ERROR) and (getQueuedByteCount() >= m_highWatermark))
+	{
+		m_aboveHighWatermark = true;
+		checkLowWatermark(); // arm the platform notification
+		if(m_aboveHighWatermark and onHighWatermark)
+			onHighWatermark();
+	}
+}
+
+void HeaderBodyStream::checkLowWatermark()
+{
+	if((not m_aboveHighWatermark) or (m_state >= S_ERROR))
+		return;
+
+	if(getQueuedByteCount() <= m_lowWatermark)
+	{
+		m_aboveHighWatermark = false;
+		if(onLowWatermark)
+			onLowWatermark();
+	}
+	else if(m_rawOutputBuffer.empty() and m_sharedOutput.empty())
+	{
+		// otherwise we'll check again when our buffer is handed to the platform.
+		auto myself = retain_ref(this);
+		m_platform->notifyWhenQueuedBelow(m_lowWatermark, [myself] { myself->checkLowWatermark(); });
+	}
+}
+
 // --- SimpleHttpStream
 
 std::string SimpleHttpStream::getStartLine() const
@@ -276,62 +560,91 @@ std::string SimpleHttpStream::getStartLine() const
 
 bool SimpleHttpStream::hasHeader(const std::string &name) const
 {
-	return m_headers.count(URIParse::lowercase(name)) > 0;
+	size_t len;
+	return findHeader(name.c_str(), &len);
 }
 
 std::string SimpleHttpStream::getHeader(const std::string &name) const
 {
 	std::string rv;
-	auto vals = getHeaderValues(name);
-	bool first = true;
-	for(auto it = vals.begin(); it != vals.end(); it++)
+	size_t len;
+	for(size_t index = 0; const char *value = findHeader(name.c_str(), &len, index); index++)
 	{
-		if(not first)
+		if(index)
 			rv.push_back(',');
-		rv.append(*it);
-		first = false;
+		rv.append(value, len);
 	}
 	return rv;
 }
 
 std::vector<std::string> SimpleHttpStream::getHeaderValues(const std::string &name) const
 {
-	auto it = m_headers.find(URIParse::lowercase(name));
-	if(it != m_headers.end())
-		return it->second;
-	return std::vector<std::string>();
+	std::vector<std::string> rv;
+	size_t len;
+	for(size_t index = 0; const char *value = findHeader(name.c_str(), &len, index); index++)
+		rv.push_back(std::string(value, len));
+	return rv;
+}
+
+const char * SimpleHttpStream::findHeader(const char *name, size_t *len, size_t index) const
+{
+	size_t nameLength = strlen(name);
+	const char *block = m_headerBlock.data();
+
+	for(auto it = m_headers.begin(); it != m_headers.end(); it++)
+	{
+		if((it->m_nameLength == nameLength) and _equalsIgnoringCase(block + it->m_name, name, nameLength) and (0 == index--))
+		{
+			*len = it->m_valueLength;
+			return block + it->m_value;
+		}
+	}
+
+	return nullptr;
 }
 
 bool SimpleHttpStream::isToken(const std::string &s)
 {
-	for(auto it = s.begin(); it != s.end(); it++)
-		if(not _istchar(*it))
-			return false;
-	return not s.empty();
+	return _isToken(s.data(), s.size());
 }
 
 const uint8_t * SimpleHttpStream::onHeaderBytes(const uint8_t *bytes, const uint8_t *limit)
 {
+	// the block ends at a blank line: LF, any CRs, LF. only LFs need a closer look, so skip
+	// to each one with memchr() (vectorized in any modern libc) instead of a byte at a time.
 	const uint8_t *cursor = bytes;
+	bool complete = false;
 
 	while(cursor < limit)
 	{
-		uint8_t c = *cursor++;
-		m_headerBlock.push_back(c);
-
-		if('\n' == c)
+		if(m_gotNewline)
 		{
-			if(m_gotNewline)
+			while((cursor < limit) and ('\r' == *cursor))
+				cursor++;
+			if(cursor == limit)
+				break;
+			if('\n' == *cursor++)
 			{
-				parseHeaderBlock();
+				complete = true;
 				break;
 			}
-			m_gotNewline = true;
-		}
-		else if('\r' != c)
 			m_gotNewline = false;
+		}
+
+		const uint8_t *newline = (const uint8_t *)memchr(cursor, '\n', limit - cursor);
+		if(not newline)
+		{
+			cursor = limit;
+			break;
+		}
+		cursor = newline + 1;
+		m_gotNewline = true;
 	}
 
+	m_headerBlock.append((const char *)bytes, cursor - bytes);
+	if(complete)
+		parseHeaderBlock();
+
 	return cursor;
 }
 
@@ -345,30 +658,47 @@ void SimpleHttpStream::parseHeaderBlock()
 {
 	m_headerComplete = true;
 
-	std::string tmp = _replace(m_headerBlock, "\r\n", "\n");
-	tmp = _replace(tmp, "\r", " ");
-	tmp = _replace(tmp, "\n[ \t]", " ");
+	m_headerBlock.resize(_unfoldHeaderBlock(&m_headerBlock[0], m_headerBlock.size()));
+	const char *block = m_headerBlock.data();
+	size_t len = m_headerBlock.size();
 
-	auto lines = URIParse::split(tmp, "\n");
+	// each field is just offsets into the block, so nothing is copied or lowercased.
 	bool needStartLine = true;
-	for(auto it = lines.begin(); it != lines.end(); it++)
+	size_t cursor = 0;
+	while(cursor <= len)
 	{
+		const char *newline = (const char *)memchr(block + cursor, '\n', len - cursor);
+		size_t end = newline ? newline - block : len;
+
 		if(needStartLine)
 		{
-			m_startLine = *it;
+			m_startLine.assign(block + cursor, end - cursor);
 			needStartLine = false;
 		}
-		else if(it->size())
+		else if(end > cursor)
 		{
-			auto parts = URIParse::split(*it, ":", 2);
-			if((2 != parts.size()) or not isToken(parts[0]))
+			const char *colon = (const char *)memchr(block + cursor, ':', end - cursor);
+			if((not colon) or not _isToken(block + cursor, colon - (block + cursor)))
 			{
 				setClosedState();
 				return;
 			}
 
-			m_headers[URIParse::lowercase(parts[0])].push_back(_trim(parts[1]));
+			HeaderField field;
+			field.m_name = cursor;
+			field.m_nameLength = colon - (block + cursor);
+			size_t value = field.m_name + field.m_nameLength + 1;
+			size_t valueEnd = end;
+			while((value < valueEnd) and _isspace(block[value]))
+				value++;
+			while((valueEnd > value) and _isspace(block[valueEnd - 1]))
+				valueEnd--;
+			field.m_value = value;
+			field.m_valueLength = valueEnd - value;
+			m_headers.push_back(field);
 		}
+
+		cursor = end + 1;
 	}
 
 	onHeadersComplete();
@@ -388,6 +718,48 @@ void SimpleHttpStream::reset()
 	m_startLine.clear();
 }
 
+// --- WebSocketFrame
+
+WebSocketFrame::WebSocketFrame(const void *payload, size_t len, bool isText) :
+	m_text(isText)
+{
+	uint8_t header[WS_MAX_HEADER];
+	m_headerLength = _encodeFrameHeader(header, WS_FLAG_FIN, isText ? WS_OP_TEXT : WS_OP_BINARY, len);
+	m_encoded.reserve(m_headerLength + len);
+	m_encoded.assign(header, header + m_headerLength);
+	m_encoded.insert(m_encoded.end(), (const uint8_t *)payload, (const uint8_t *)payload + len);
+}
+
+WebSocketFrame::WebSocketFrame(const std::string &text) :
+	WebSocketFrame(text.data(), text.size(), true)
+{
+}
+
+bool WebSocketFrame::isText() const
+{
+	return m_text;
+}
+
+const uint8_t * WebSocketFrame::getPayload() const
+{
+	return m_encoded.data() + m_headerLength;
+}
+
+size_t WebSocketFrame::getPayloadLength() const
+{
+	return m_encoded.size() - m_headerLength;
+}
+
+const uint8_t * WebSocketFrame::getEncoded() const
+{
+	return m_encoded.data();
+}
+
+size_t WebSocketFrame::getEncodedLength() const
+{
+	return m_encoded.size();
+}
+
 // --- SimpleWebSocket
 
 void SimpleWebSocket::sendBinaryMessage(const void *bytes, size_t len)
@@ -400,75 +772,180 @@ void SimpleWebSocket::sendBinaryMessage(const Bytes &bytes)
 	sendBinaryMessage(bytes.data(), bytes.size());
 }
 
+void SimpleWebSocket::sendBinaryMessage(const std::shared_ptr<const void> &owner, const void *bytes, size_t len)
+{
+	writeFrame(WS_OP_BINARY, owner, bytes, len);
+}
+
+void SimpleWebSocket::sendBinaryMessage(const std::shared_ptr<const Bytes> &bytes)
+{
+	if(bytes)
+		sendBinaryMessage(bytes, bytes->data(), bytes->size());
+}
+
 void SimpleWebSocket::sendTextMessage(const std::string &message)
 {
 	writeFrame(WS_OP_TEXT, message.data(), message.size());
 }
 
+void SimpleWebSocket::sendFrame(const std::shared_ptr<const WebSocketFrame> &frame)
+{
+	if(not frame)
+		return;
+
+	if(m_client)
+		writeFrame(frame->isText() ? WS_OP_TEXT : WS_OP_BINARY, frame->getPayload(), frame->getPayloadLength(), false);
+	else if(frame->getEncodedLength() < WS_SHARE_PAYLOAD_MIN)
+		writeBytes(frame->getEncoded(), frame->getEncodedLength());
+	else
+		writeSharedBytes(frame, frame->getEncoded(), frame->getEncodedLength());
+}
+
 void SimpleWebSocket::cleanClose()
 {
 	writeFrame(WS_OP_CLOSE, nullptr, 0);
 	m_closing = true;
 }
 
+void SimpleWebSocket::cleanClose(uint16_t code, const std::string &reason)
+{
+	uint8_t payload[WS_MAX_CONTROL] = { uint8_t(code >> 8), uint8_t(code & 0xff) };
+	size_t reasonLen = std::min(reason.size(), sizeof(payload) - 2);
+	memmove(payload + 2, reason.data(), reasonLen);
+	writeFrame(WS_OP_CLOSE, payload, 2 + reasonLen);
+	m_closing = true;
+}
+
+void SimpleWebSocket::failConnection(uint16_t code)
+{
+	// RFC 6455 §7.1.7, say why if we haven't already started closing, and read no more.
+	if(not m_closing)
+		cleanClose(code);
+	shutdown();
+}
+
+void SimpleWebSocket::setMaxMessageSize(size_t maxLen)
+{
+	m_maxMessageSize = maxLen;
+}
+
+size_t SimpleWebSocket::getMaxMessageSize() const
+{
+	return m_maxMessageSize;
+}
+
 const uint8_t * SimpleWebSocket::onBodyBytes(const uint8_t *bytes, const uint8_t *limit)
 {
 	auto myself = retain_ref(this);
 
+	if(m_inputBuffer.empty())
+	{
+		// usually whole frames arrive together, so parse (and unmask) them right where they
+		// were received, and only buffer a partial frame left at the end.
+		const uint8_t *cursor = parseFrames(bytes, limit, m_platform->isReceiveBufferWritable());
+		if(cursor and (cursor < limit))
+		{
+			m_inputBuffer.reserve(std::max(m_inputNeeded, size_t(limit - cursor)));
+			m_inputBuffer.insert(m_inputBuffer.end(), cursor, limit);
+		}
+		return limit;
+	}
+
 	m_inputBuffer.insert(m_inputBuffer.end(), bytes, limit);
-	const uint8_t *buffer = m_inputBuffer.data();
-	const uint8_t *cursor = buffer;
-	const uint8_t *inputLimit = cursor + m_inputBuffer.size();
+	if(m_inputBuffer.size() - m_inputOffset < m_inputNeeded)
+		return limit; // still waiting for the rest of the frame
+
+	const uint8_t *buffer = m_inputBuffer.data() + m_inputOffset;
+	const uint8_t *cursor = parseFrames(buffer, m_inputBuffer.data() + m_inputBuffer.size(), true);
+	if(cursor)
+		shiftInputBuffer(cursor - buffer);
+
+	(void) myself;
+
+	return limit;
+}
+
+const uint8_t * SimpleWebSocket::parseFrames(const uint8_t *bytes, const uint8_t *limit, bool writable)
+{
+	const uint8_t *cursor = bytes;
 
-	while(cursor < inputLimit)
+	while(cursor < limit)
 	{
-		long consumed = onInput(cursor, inputLimit);
+		long consumed = onInput(cursor, limit, writable);
 		if(consumed < 0)
-		{
 			setClosedState();
-			return limit;
-		}
+		if(m_state >= S_CLOSING)
+			return nullptr; // failed, or closed during a callback
 		if(0 == consumed)
 			break;
 		cursor += consumed;
 	}
 
-	shiftInputBuffer(cursor - buffer);
-
-	(void) myself;
-
-	return limit;
+	return cursor;
 }
 
 void SimpleWebSocket::shiftInputBuffer(size_t amount)
 {
-	if(amount)
+	assert(m_inputOffset + amount <= m_inputBuffer.size());
+	m_inputOffset += amount;
+	size_t unconsumed = m_inputBuffer.size() - m_inputOffset;
+
+	if(0 == unconsumed)
+	{
+		if(m_inputBuffer.capacity() > WS_INPUT_KEEP)
+			Bytes().swap(m_inputBuffer);
+		m_inputBuffer.clear();
+		m_inputOffset = 0;
+		return;
+	}
+
+	// move the unconsumed bytes to the front only when that's no more than were just
+	// consumed (so each byte is moved at most about once), or if growing would copy them anyway.
+	bool mustGrow = m_inputNeeded > m_inputBuffer.capacity() - m_inputOffset;
+	if(m_inputOffset and (mustGrow or (unconsumed <= m_inputOffset)))
 	{
-		assert(amount <= m_inputBuffer.size());
-		size_t newSize = m_inputBuffer.size() - amount;
 		uint8_t *buf = m_inputBuffer.data();
-		::memmove(buf, buf + amount, newSize);
-		m_inputBuffer.resize(newSize);
+		::memmove(buf, buf + m_inputOffset, unconsumed);
+		m_inputBuffer.resize(unconsumed);
+		m_inputOffset = 0;
 	}
+
+	if(mustGrow)
+		m_inputBuffer.reserve(m_inputNeeded); // the rest of a big frame is appended without reallocating
 }
 
-long SimpleWebSocket::onInput(const uint8_t *bytes, const uint8_t *limit)
+long SimpleWebSocket::onInput(const uint8_t *bytes, const uint8_t *limit, bool writable)
 {
 	size_t remaining = limit - bytes;
 	assert(remaining > 0);
 	const uint8_t *cursor = bytes;
 	size_t needed = 2;
 
+	m_inputNeeded = 0;
+	if(m_streamRemaining)
+		return onStreamedPayload(bytes, std::min(remaining, m_streamRemaining), writable);
+
 	if(remaining < needed)
+	{
+		m_inputNeeded = needed;
 		return 0;
+	}
 	bool isFinal = *cursor & WS_FLAG_FIN;
 	int opcode = *cursor & WS_OPCODE_MASK;
+	uint8_t rsv = *cursor & WS_FLAG_RSV;
 	cursor++;
 
+	// RSV1 is only allowed, and only on the first frame of a data message, with compression.
+	if(rsv and ((WS_FLAG_RSV1 != rsv) or (not m_compressing) or (opcode & 0x8) or (WS_OP_CONTINUATION == opcode)))
+		return -1;
+
 	bool hasMask = *cursor & WS_FLAG_MSK;
 	size_t payloadLength = *cursor & WS_LENGTH_MASK;
 	cursor++;
 
+	if(hasMask and m_client)
+		return -1; // RFC 6455 §5.1, servers don't mask
+
 	if(hasMask)
 		needed += 4;
 	if(WS_LENGTH_16 == payloadLength)
@@ -476,7 +953,10 @@ long SimpleWebSocket::onInput(const uint8_t *bytes, const uint8_t *limit)
 	else if(WS_LENGTH_64 == payloadLength)
 		needed += 8;
 	if(remaining < needed)
+	{
+		m_inputNeeded = needed;
 		return 0;
+	}
 
 	if(WS_LENGTH_16 == payloadLength)
 	{
@@ -494,47 +974,136 @@ long SimpleWebSocket::onInput(const uint8_t *bytes, const uint8_t *limit)
 		payloadLength += *cursor++; payloadLength <<= 8;
 		payloadLength += *cursor++;
 	}
-	if(payloadLength > WS_MAX_FRAME)
+
+	if((opcode & 0x8) and ((payloadLength > WS_MAX_CONTROL) or not isFinal))
 		return -1;
+
+	const uint8_t *maskKey = nullptr;
+	if(hasMask)
+	{
+		maskKey = cursor;
+		cursor += 4;
+	}
+
+	if(not (opcode & 0x8))
+	{
+		size_t messageSoFar = 0;
+		if(WS_OP_CONTINUATION == opcode)
+			messageSoFar = m_streamingMessage ? m_streamedLength : m_fragmentedMessage.size();
+		if(payloadLength > m_maxMessageSize - std::min(messageSoFar, m_maxMessageSize))
+		{
+			failConnection(CLOSE_MESSAGE_TOO_BIG);
+			return 0;
+		}
+	}
+
+	bool streamed = (WS_OP_CONTINUATION == opcode) ? m_streamingMessage :
+		(onMessageData and (not rsv) and (m_fragmentedMessageOpcode < 0) and ((WS_OP_TEXT == opcode) or (WS_OP_BINARY == opcode)));
+	if(streamed)
+	{
+		// just the header now. the payload is passed along as it arrives, without waiting for all of it.
+		if(WS_OP_CONTINUATION != opcode)
+		{
+			m_streamingMessage = true;
+			m_fragmentedMessageOpcode = opcode;
+			m_streamedLength = 0;
+			m_utf8.reset();
+			if(onMessageBegin)
+				onMessageBegin(WS_OP_TEXT == opcode);
+		}
+		m_streamedLength += payloadLength;
+		m_streamRemaining = payloadLength;
+		m_streamFinal = isFinal;
+		m_streamMasked = hasMask;
+		if(hasMask)
+			memcpy(m_streamMaskKey, maskKey, sizeof(m_streamMaskKey));
+		m_streamMaskOffset = 0;
+		if(0 == payloadLength)
+			onStreamedFrameEnd();
+		return needed;
+	}
+
 	needed += payloadLength;
 	if(remaining < needed)
+	{
+		m_inputNeeded = needed;
 		return 0;
+	}
 
 	// at this point there's enough remaining for the entire frame
-	uint32_t mask = 0;
-	if(hasMask)
+
+	assert(cursor + payloadLength <= limit);
+
+	if(hasMask and writable)
+	{
+		uint8_t *payload = const_cast<uint8_t *>(cursor);
+		applyMask(payload, payload, payloadLength, maskKey);
+		onFrame(opcode, isFinal, rsv, payload, payloadLength);
+	}
+	else if(hasMask)
 	{
-		mask += *cursor++; mask <<=8;
-		mask += *cursor++; mask <<=8;
-		mask += *cursor++; mask <<=8;
-		mask += *cursor++;
+		m_tmpFrame.resize(payloadLength);
+		applyMask(m_tmpFrame.data(), cursor, payloadLength, maskKey);
+		onFrame(opcode, isFinal, rsv, m_tmpFrame.data(), payloadLength);
 	}
+	else
+		onFrame(opcode, isFinal, rsv, cursor, payloadLength);
 
-	const uint8_t *payloadLimit = cursor + payloadLength;
-	assert(payloadLimit <= limit);
+	return needed;
+}
 
-	if(hasMask)
+long SimpleWebSocket::onStreamedPayload(const uint8_t *bytes, size_t len, bool writable)
+{
+	const uint8_t *payload = bytes;
+	if(m_streamMasked)
 	{
-		int maskShift = 24;
-		m_tmpFrame.clear();
-
-		while(cursor < payloadLimit)
+		uint8_t *dst;
+		if(writable)
+			dst = const_cast<uint8_t *>(bytes);
+		else
 		{
-			m_tmpFrame.push_back(*cursor++ ^ ((mask >> maskShift) & 0xff));
-			maskShift -= 8;
-			if(maskShift < 0)
-				maskShift = 24;
+			m_tmpFrame.resize(len);
+			dst = m_tmpFrame.data();
 		}
+		applyMask(dst, bytes, len, m_streamMaskKey, m_streamMaskOffset);
+		m_streamMaskOffset += len;
+		payload = dst;
+	}
 
-		onFrame(opcode, isFinal, m_tmpFrame.data(), payloadLength);
+	if((WS_OP_TEXT == m_fragmentedMessageOpcode) and not m_utf8.update(payload, len))
+	{
+		failConnection(CLOSE_INVALID_DATA);
+		return 0;
 	}
-	else
-		onFrame(opcode, isFinal, cursor, payloadLength);
 
-	return needed;
+	m_streamRemaining -= len;
+	if(onMessageData)
+		onMessageData(payload, len);
+	if(0 == m_streamRemaining)
+		onStreamedFrameEnd();
+
+	return len;
+}
+
+void SimpleWebSocket::onStreamedFrameEnd()
+{
+	if(not m_streamFinal)
+		return;
+
+	int opcode = m_fragmentedMessageOpcode;
+	m_streamingMessage = false;
+	m_fragmentedMessageOpcode = -1;
+	m_streamedLength = 0;
+	if((WS_OP_TEXT == opcode) and not m_utf8.finish())
+	{
+		failConnection(CLOSE_INVALID_DATA);
+		return;
+	}
+	if(onMessageEnd)
+		onMessageEnd();
 }
 
-void SimpleWebSocket::onFrame(int opcode, bool isFinal, const uint8_t *bytes, size_t len)
+void SimpleWebSocket::onFrame(int opcode, bool isFinal, bool compressed, const uint8_t *bytes, size_t len)
 {
 	switch(opcode)
 	{
@@ -555,7 +1124,7 @@ void SimpleWebSocket::onFrame(int opcode, bool isFinal, const uint8_t *bytes, si
 		break;
 
 	default:
-		onMessageFrame(opcode, isFinal, bytes, len);
+		onMessageFrame(opcode, isFinal, compressed, bytes, len);
 		break;
 	}
 }
@@ -568,13 +1137,23 @@ void SimpleWebSocket::onContinuationFrame(bool isFinal, const uint8_t *bytes, si
 		return;
 	}
 
+	// text is checked as it arrives, so bad text fails without waiting for the rest.
+	bool checkText = (WS_OP_TEXT == m_fragmentedMessageOpcode) and not m_fragmentedMessageCompressed;
+	if(checkText and not (m_utf8.update(bytes, len) and ((not isFinal) or m_utf8.finish())))
+	{
+		failConnection(CLOSE_INVALID_DATA);
+		return;
+	}
+
 	m_fragmentedMessage.insert(m_fragmentedMessage.end(), bytes, bytes + len);
 	if(isFinal)
 	{
 		int opcode = m_fragmentedMessageOpcode;
 		m_fragmentedMessageOpcode = -1;
-		onMessageFrame(opcode, true, m_fragmentedMessage.data(), m_fragmentedMessage.size());
+		onMessage(opcode, m_fragmentedMessageCompressed, m_fragmentedMessage.data(), m_fragmentedMessage.size(), checkText);
 		m_fragmentedMessage.clear();
+		if(m_fragmentedMessage.capacity() > WS_INPUT_KEEP)
+			Bytes().swap(m_fragmentedMessage);
 	}
 }
 
@@ -595,7 +1174,7 @@ void SimpleWebSocket::onCloseFrame()
 		cleanClose();
 }
 
-void SimpleWebSocket::onMessageFrame(int opcode, bool isFinal, const uint8_t *bytes, size_t len)
+void SimpleWebSocket::onMessageFrame(int opcode, bool isFinal, bool compressed, const uint8_t *bytes, size_t len)
 {
 	if(m_fragmentedMessageOpcode > 0)
 	{
@@ -605,9 +1184,48 @@ void SimpleWebSocket::onMessageFrame(int opcode, bool isFinal, const uint8_t *by
 
 	if(not isFinal)
 	{
+		m_utf8.reset();
+		if((WS_OP_TEXT == opcode) and (not compressed) and not m_utf8.update(bytes, len))
+		{
+			failConnection(CLOSE_INVALID_DATA);
+			return;
+		}
 		m_fragmentedMessageOpcode = opcode;
+		m_fragmentedMessageCompressed = compressed;
 		m_fragmentedMessage.insert(m_fragmentedMessage.end(), bytes, bytes + len);
 	}
+	else
+		onMessage(opcode, compressed, bytes, len);
+}
+
+void SimpleWebSocket::onMessage(int opcode, bool compressed, const uint8_t *bytes, size_t len, bool textChecked)
+{
+	if(compressed)
+	{
+		if(not m_compression->decompress(bytes, len, m_inflated, m_maxMessageSize))
+		{
+			setClosedState();
+			return;
+		}
+		bytes = m_inflated.data();
+		len = m_inflated.size();
+	}
+
+	if((WS_OP_TEXT == opcode) and (not textChecked) and not isValidUtf8(bytes, len))
+	{
+		failConnection(CLOSE_INVALID_DATA);
+		return;
+	}
+
+	if(onMessageData and ((WS_OP_TEXT == opcode) or (WS_OP_BINARY == opcode)))
+	{
+		if(onMessageBegin)
+			onMessageBegin(WS_OP_TEXT == opcode);
+		if(onMessageData)
+			onMessageData(bytes, len);
+		if(onMessageEnd)
+			onMessageEnd();
+	}
 	else
 	{
 		switch(opcode)
@@ -626,6 +1244,20 @@ void SimpleWebSocket::onMessageFrame(int opcode, bool isFinal, const uint8_t *by
 			break; // we don't know what this is.
 		}
 	}
+
+	if(m_inflated.capacity() > WS_INPUT_KEEP)
+		Bytes().swap(m_inflated);
+}
+
+void SimpleWebSocket::setCompression(const std::shared_ptr<WebSocketCompression> &compression)
+{
+	if(not m_handshakeComplete)
+		m_compression = compression;
+}
+
+bool SimpleWebSocket::isCompressing() const
+{
+	return m_compressing;
 }
 
 void SimpleWebSocket::clearCallbacks()
@@ -634,12 +1266,25 @@ void SimpleWebSocket::clearCallbacks()
 	onOpen = nullptr;
 	onBinaryMessage = nullptr;
 	onTextMessage = nullptr;
+	onMessageBegin = nullptr;
+	onMessageData = nullptr;
+	onMessageEnd = nullptr;
+
+	// only called when closing, so let go of any compression state now too.
+	m_compression.reset();
+	m_compressing = false;
 }
 
 void SimpleWebSocket::onHeadersComplete()
 {
 	SimpleHttpStream::onHeadersComplete();
 
+	if(m_client)
+	{
+		onClientHeadersComplete();
+		return;
+	}
+
 	auto startline = URIParse::split(m_startLine, " ");
 	if((startline.size() != 3) or (0 != startline[0].compare("GET")))
 	{
@@ -659,60 +1304,175 @@ void SimpleWebSocket::onHeadersComplete()
 		return;
 	}
 
-	websocketKey.append("258EAFA5-E914-47DA-95CA-C5AB0DC85B11");
-	uint8_t md[160/8] = { 0 };
-	sha1(md, websocketKey.data(), websocketKey.size());
-	std::string websocketAccept = _base64enc(md, sizeof(md));
+	std::string websocketAccept = acceptKey(websocketKey);
+
+	std::string extensions;
+	if(m_compression)
+		extensions = m_compression->negotiate(getHeader("sec-websocket-extensions"));
+	if(extensions.empty())
+		m_compression.reset();
+	else
+	{
+		m_compressing = true;
+		extensions = "Sec-WebSocket-Extensions: " + extensions + "\r\n";
+	}
 
 	writeBytes(std::string(
 		"HTTP/1.1 101 Switching Protocols\r\n"
 		"Upgrade: websocket\r\n"
 		"Connection: Upgrade\r\n"
-		"Sec-WebSocket-Accept: ") + websocketAccept + std::string("\r\n"
+		"Sec-WebSocket-Accept: ") + websocketAccept + std::string("\r\n")
+		+ extensions +
 		"\r\n"
-	));
+	);
 
 	m_handshakeComplete = true;
 	if(onOpen)
 		onOpen();
 }
 
-void SimpleWebSocket::writeFrame(int opcode, const void *bytes_, size_t len)
+void SimpleWebSocket::onClientHeadersComplete()
 {
-	const uint8_t *bytes = (const uint8_t *)bytes_;
-	uint8_t basicLengthField = 0;
+	auto statusLine = URIParse::split(m_startLine, " ", 3);
+	if( (statusLine.size() < 2)
+	 or (0 != statusLine[0].compare("HTTP/1.1"))
+	 or (0 != statusLine[1].compare("101"))
+	 or (0 != URIParse::lowercase(getHeader("upgrade")).compare("websocket"))
+	 or (std::string::npos == URIParse::lowercase(getHeader("connection")).find("upgrade"))
+	 or (0 != getHeader("sec-websocket-accept").compare(acceptKey(m_clientKey)))
+	)
+	{
+		setClosedState();
+		return;
+	}
 
-	if(len > 65535)
-		basicLengthField = WS_LENGTH_64;
-	else if(len > 125)
-		basicLengthField = WS_LENGTH_16;
+	std::string extensions = getHeader("sec-websocket-extensions");
+	if(extensions.empty())
+		m_compression.reset();
+	else if(m_compression and m_compression->accept(extensions))
+		m_compressing = true;
+	else
+	{
+		setClosedState(); // it's using something we didn't offer
+		return;
+	}
+
+	m_handshakeComplete = true;
+	if(onOpen)
+		onOpen();
+}
+
+std::string SimpleWebSocket::acceptKey(const std::string &websocketKey)
+{
+	std::string str = websocketKey + "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+	uint8_t md[160/8] = { 0 };
+	sha1(md, str.data(), str.size());
+	return _base64enc(md, sizeof(md));
+}
+
+bool SimpleWebSocket::initClient(const std::string &host, const std::string &resource, const std::string &extraHeaders)
+{
+	m_client = true;
+	if(not init())
+		return false;
+
+	uint8_t nonce[16];
+	randomBytes(nonce, sizeof(nonce));
+	m_clientKey = _base64enc(nonce, sizeof(nonce));
+
+	std::string request =
+		"GET " + resource + " HTTP/1.1\r\n"
+		"Host: " + host + "\r\n"
+		"Upgrade: websocket\r\n"
+		"Connection: Upgrade\r\n"
+		"Sec-WebSocket-Key: " + m_clientKey + "\r\n"
+		"Sec-WebSocket-Version: 13\r\n";
+
+	std::string offer = m_compression ? m_compression->offer() : std::string();
+	if(offer.empty())
+		m_compression.reset();
 	else
-		basicLengthField = len;
+		request += "Sec-WebSocket-Extensions: " + offer + "\r\n";
 
-	Bytes frame;
-	frame.push_back(WS_FLAG_FIN | (opcode & WS_OPCODE_MASK));
-	frame.push_back(0 | basicLengthField); // servers don't mask data
-	if(WS_LENGTH_64 == basicLengthField)
+	return writeBytes(request + extraHeaders + "\r\n");
+}
+
+bool SimpleWebSocket::isClient() const
+{
+	return m_client;
+}
+
+void SimpleWebSocket::randomBytes(void *dst_, size_t len)
+{
+	// a 4 byte masking key per frame, so take them from a buffer to save system calls.
+	uint8_t *dst = (uint8_t *)dst_;
+	while(len)
 	{
-		frame.push_back((len >> 56) & 0xff);
-		frame.push_back((len >> 48) & 0xff);
-		frame.push_back((len >> 40) & 0xff);
-		frame.push_back((len >> 32) & 0xff);
-		frame.push_back((len >> 24) & 0xff);
-		frame.push_back((len >> 16) & 0xff);
-		frame.push_back((len >>  8) & 0xff);
-		frame.push_back((len      ) & 0xff);
+		if(0 == m_randomAvailable)
+		{
+			if(not m_randomPool) // only clients need it
+				m_randomPool.reset(new uint8_t[WS_RANDOM_POOL]);
+			_systemRandomBytes(m_randomPool.get(), WS_RANDOM_POOL);
+			m_randomAvailable = WS_RANDOM_POOL;
+		}
+
+		size_t each = std::min(len, m_randomAvailable);
+		uint8_t *src = m_randomPool.get() + WS_RANDOM_POOL - m_randomAvailable;
+		memcpy(dst, src, each);
+		memset(src, 0, each); // never hand out the same bytes twice
+		m_randomAvailable -= each;
+		dst += each;
+		len -= each;
 	}
-	else if(WS_LENGTH_16 == basicLengthField)
+}
+
+void SimpleWebSocket::writeFrame(int opcode, const void *bytes, size_t len, bool compress)
+{
+	uint8_t header[WS_MAX_HEADER];
+	uint8_t flags = WS_FLAG_FIN;
+
+	if(compress and m_compressing and not (opcode & 0x8) and m_compression->compress((const uint8_t *)bytes, len, m_deflated))
 	{
-		frame.push_back((len >>  8) & 0xff);
-		frame.push_back((len      ) & 0xff);
+		flags |= WS_FLAG_RSV1;
+		bytes = m_deflated.data();
+		len = m_deflated.size();
 	}
 
-	if(len and bytes)
-		frame.insert(frame.end(), bytes, bytes + len);
+	size_t headerLen = _encodeFrameHeader(header, flags, opcode, len);
+
+	if(m_client)
+	{
+		// clients mask everything (RFC 6455 §5.3), masking straight into the output buffer.
+		uint8_t *maskKey = header + headerLen;
+		header[1] |= WS_FLAG_MSK;
+		randomBytes(maskKey, 4);
+		headerLen += 4;
+
+		uint8_t *dst;
+		if(reserveOutput(header, headerLen, len, &dst))
+		{
+			applyMask(dst, (const uint8_t *)bytes, len, maskKey);
+			commitOutput();
+		}
+	}
+	else
+		queueOutput(header, headerLen, nullptr, bytes, len);
+
+	if(m_deflated.capacity() > WS_INPUT_KEEP)
+		Bytes().swap(m_deflated);
+}
+
+void SimpleWebSocket::writeFrame(int opcode, const std::shared_ptr<const void> &owner, const void *bytes, size_t len)
+{
+	if(m_client or m_compressing or (len < WS_SHARE_PAYLOAD_MIN))
+	{
+		writeFrame(opcode, bytes, len); // masking or compressing makes a new payload anyway
+		return;
+	}
 
-	writeBytes(frame);
+	uint8_t header[WS_MAX_HEADER];
+	size_t headerLen = _encodeFrameHeader(header, WS_FLAG_FIN, opcode, len);
+	writeSharedBytes(owner, bytes, len, header, headerLen);
 }
 
 } } } // namespace com::zenomt::websock
@@ -5,6 +5,7 @@
 // Note: *not* WSS (TLS). That's a job for an IStreamPlatformAdapter.
 
 #include <openssl/evp.h>
+#include <openssl/rand.h>
 
 #include "../include/zenomt/SimpleWebSocket.hpp"
 
@@ -19,4 +20,10 @@ void SimpleWebSocket_OpenSSL::sha1(void *dst, const void *msg, size_t len)
 	EVP_MD_CTX_free(ctx);
 }
 
+void SimpleWebSocket_OpenSSL::randomBytes(void *dst, size_t len)
+{
+	if(1 != RAND_bytes((unsigned char *)dst, int(len)))
+		SimpleWebSocket::randomBytes(dst, len); // not seeded? use the system's directly
+}
+
 } } } // namespace com::zenomt::websock
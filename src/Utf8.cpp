@@ -0,0 +1,390 @@
+// Copyright © 2026 Michael Thornburgh
+// SPDX-License-Identifier: MIT
+
+#include <algorithm>
+#include <cstring>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define ZENOMT_UTF8_X86 1
+#include <immintrin.h>
+#endif
+
+#include "../include/zenomt/Utf8.hpp"
+
+namespace {
+
+using ValidateFunction = bool (*)(const uint8_t *bytes, size_t len);
+
+bool validScalar(const uint8_t *bytes, size_t len)
+{
+	size_t x = 0;
+	while(x < len)
+	{
+		uint64_t word;
+		if(x + sizeof(word) <= len)
+		{
+			memcpy(&word, bytes + x, sizeof(word));
+			if(0 == (word & 0x8080808080808080ULL))
+			{
+				x += sizeof(word);
+				continue;
+			}
+		}
+
+		uint8_t c = bytes[x];
+		if(c < 0x80)
+		{
+			x++;
+			continue;
+		}
+
+		size_t need;
+		uint8_t lo = 0x80, hi = 0xbf; // the second byte's range
+		if((c >= 0xc2) and (c <= 0xdf))
+			need = 2;
+		else if((c & 0xf0) == 0xe0)
+		{
+			need = 3;
+			if(0xe0 == c)
+				lo = 0xa0; // overlong
+			else if(0xed == c)
+				hi = 0x9f; // surrogates
+		}
+		else if((c >= 0xf0) and (c <= 0xf4))
+		{
+			need = 4;
+			if(0xf0 == c)
+				lo = 0x90; // overlong
+			else if(0xf4 == c)
+				hi = 0x8f; // past U+10FFFF
+		}
+		else
+			return false;
+
+		if((len - x < need) or (bytes[x + 1] < lo) or (bytes[x + 1] > hi))
+			return false;
+		for(size_t each = 2; each < need; each++)
+			if((bytes[x + each] & 0xc0) != 0x80)
+				return false;
+		x += need;
+	}
+
+	return true;
+}
+
+#ifdef ZENOMT_UTF8_X86
+// Keiser & Lemire, "Validating UTF-8 In Less Than One Instruction Per Byte" (2021). each
+// byte and the one before it are classified by three nibble lookups whose AND is nonzero
+// only for an invalid pair; the 3rd and 4th bytes of long characters are checked by
+// looking back 2 and 3 bytes.
+
+const uint8_t TOO_SHORT      = 1 << 0; // 11______ 0_______, 11______ 11______
+const uint8_t TOO_LONG       = 1 << 1; // 0_______ 10______
+const uint8_t OVERLONG_3     = 1 << 2; // 11100000 100_____
+const uint8_t TOO_LARGE      = 1 << 3; // 11110100 1001____, 11110100 101_____, 11110101+ ________
+const uint8_t SURROGATE      = 1 << 4; // 11101101 101_____
+const uint8_t OVERLONG_2     = 1 << 5; // 1100000_ 10______
+const uint8_t TOO_LARGE_1000 = 1 << 6; // 11110101+ 1000____
+const uint8_t OVERLONG_4     = 1 << 6; // 11110000 1000____
+const uint8_t TWO_CONTS      = 1 << 7; // 10______ 10______
+const uint8_t CARRY          = TOO_SHORT | TOO_LONG | TWO_CONTS; // don't depend on the low nibble
+
+alignas(16) const uint8_t BYTE_1_HIGH[16] = {
+	TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,
+	TWO_CONTS, TWO_CONTS, TWO_CONTS, TWO_CONTS,
+	TOO_SHORT | OVERLONG_2,
+	TOO_SHORT,
+	TOO_SHORT | OVERLONG_3 | SURROGATE,
+	TOO_SHORT | TOO_LARGE | TOO_LARGE_1000 | OVERLONG_4
+};
+
+alignas(16) const uint8_t BYTE_1_LOW[16] = {
+	CARRY | OVERLONG_3 | OVERLONG_2 | OVERLONG_4,
+	CARRY | OVERLONG_2,
+	CARRY,
+	CARRY,
+	CARRY | TOO_LARGE,
+	CARRY | TOO_LARGE | TOO_LARGE_1000,
+	CARRY | TOO_LARGE | TOO_LARGE_1000,
+	CARRY | TOO_LARGE | TOO_LARGE_1000,
+	CARRY | TOO_LARGE | TOO_LARGE_1000,
+	CARRY | TOO_LARGE | TOO_LARGE_1000,
+	CARRY | TOO_LARGE | TOO_LARGE_1000,
+	CARRY | TOO_LARGE | TOO_LARGE_1000,
+	CARRY | TOO_LARGE | TOO_LARGE_1000,
+	CARRY | TOO_LARGE | TOO_LARGE_1000 | SURROGATE,
+	CARRY | TOO_LARGE | TOO_LARGE_1000,
+	CARRY | TOO_LARGE | TOO_LARGE_1000
+};
+
+alignas(16) const uint8_t BYTE_2_HIGH[16] = {
+	TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+	TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE_1000 | OVERLONG_4,
+	TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE,
+	TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+	TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+	TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT
+};
+
+// a block ending with any of these needs the next block to finish a character.
+alignas(32) const uint8_t INCOMPLETE_MAX[32] = {
+	255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+	255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 0xf0 - 1, 0xe0 - 1, 0xc0 - 1
+};
+
+__attribute__((target("ssse3")))
+__m128i checkBlockSSSE3(__m128i input, __m128i prev)
+{
+	const __m128i lowNibble = _mm_set1_epi8(0x0f);
+	__m128i prev1 = _mm_alignr_epi8(input, prev, 16 - 1);
+	__m128i byte1High = _mm_shuffle_epi8(_mm_load_si128((const __m128i *)BYTE_1_HIGH), _mm_and_si128(_mm_srli_epi16(prev1, 4), lowNibble));
+	__m128i byte1Low = _mm_shuffle_epi8(_mm_load_si128((const __m128i *)BYTE_1_LOW), _mm_and_si128(prev1, lowNibble));
+	__m128i byte2High = _mm_shuffle_epi8(_mm_load_si128((const __m128i *)BYTE_2_HIGH), _mm_and_si128(_mm_srli_epi16(input, 4), lowNibble));
+	__m128i special = _mm_and_si128(_mm_and_si128(byte1High, byte1Low), byte2High);
+
+	__m128i prev2 = _mm_alignr_epi8(input, prev, 16 - 2);
+	__m128i prev3 = _mm_alignr_epi8(input, prev, 16 - 3);
+	__m128i third = _mm_subs_epu8(prev2, _mm_set1_epi8(char(0xe0 - 0x80))); // only 111_____ stay >= 0x80
+	__m128i fourth = _mm_subs_epu8(prev3, _mm_set1_epi8(char(0xf0 - 0x80))); // only 1111____
+	__m128i mustBeContinuation = _mm_and_si128(_mm_or_si128(third, fourth), _mm_set1_epi8(char(0x80)));
+
+	return _mm_xor_si128(mustBeContinuation, special);
+}
+
+__attribute__((target("ssse3")))
+bool validSSSE3(const uint8_t *bytes, size_t len)
+{
+	const __m128i incompleteMax = _mm_loadu_si128((const __m128i *)(INCOMPLETE_MAX + 16));
+	__m128i error = _mm_setzero_si128();
+	__m128i prev = _mm_setzero_si128();
+	__m128i prevIncomplete = _mm_setzero_si128();
+	uint8_t padded[16];
+
+	for(size_t x = 0; x < len; x += 16)
+	{
+		__m128i input;
+		if(x + 16 <= len)
+			input = _mm_loadu_si128((const __m128i *)(bytes + x));
+		else
+		{
+			memset(padded, 0, sizeof(padded)); // the padding is ASCII, so it ends any character in progress
+			memcpy(padded, bytes + x, len - x);
+			input = _mm_loadu_si128((const __m128i *)padded);
+		}
+
+		if(0 == _mm_movemask_epi8(input))
+			error = _mm_or_si128(error, prevIncomplete);
+		else
+		{
+			error = _mm_or_si128(error, checkBlockSSSE3(input, prev));
+			prevIncomplete = _mm_subs_epu8(input, incompleteMax);
+		}
+		prev = input;
+	}
+	error = _mm_or_si128(error, prevIncomplete);
+
+	return 0xffff == _mm_movemask_epi8(_mm_cmpeq_epi8(error, _mm_setzero_si128()));
+}
+
+template <int N>
+__attribute__((target("avx2")))
+inline __m256i prevBytesAVX2(__m256i input, __m256i prev)
+{
+	// the last N bytes of prev, then input, across the 128-bit lanes.
+	return _mm256_alignr_epi8(input, _mm256_permute2x128_si256(prev, input, 0x21), 16 - N);
+}
+
+__attribute__((target("avx2")))
+__m256i checkBlockAVX2(__m256i input, __m256i prev)
+{
+	const __m256i lowNibble = _mm256_set1_epi8(0x0f);
+	__m256i prev1 = prevBytesAVX2<1>(input, prev);
+	__m256i byte1High = _mm256_shuffle_epi8(_mm256_broadcastsi128_si256(_mm_load_si128((const __m128i *)BYTE_1_HIGH)), _mm256_and_si256(_mm256_srli_epi16(prev1, 4), lowNibble));
+	__m256i byte1Low = _mm256_shuffle_epi8(_mm256_broadcastsi128_si256(_mm_load_si128((const __m128i *)BYTE_1_LOW)), _mm256_and_si256(prev1, lowNibble));
+	__m256i byte2High = _mm256_shuffle_epi8(_mm256_broadcastsi128_si256(_mm_load_si128((const __m128i *)BYTE_2_HIGH)), _mm256_and_si256(_mm256_srli_epi16(input, 4), lowNibble));
+	__m256i special = _mm256_and_si256(_mm256_and_si256(byte1High, byte1Low), byte2High);
+
+	__m256i prev2 = prevBytesAVX2<2>(input, prev);
+	__m256i prev3 = prevBytesAVX2<3>(input, prev);
+	__m256i third = _mm256_subs_epu8(prev2, _mm256_set1_epi8(char(0xe0 - 0x80)));
+	__m256i fourth = _mm256_subs_epu8(prev3, _mm256_set1_epi8(char(0xf0 - 0x80)));
+	__m256i mustBeContinuation = _mm256_and_si256(_mm256_or_si256(third, fourth), _mm256_set1_epi8(char(0x80)));
+
+	return _mm256_xor_si256(mustBeContinuation, special);
+}
+
+__attribute__((target("avx2")))
+bool validAVX2(const uint8_t *bytes, size_t len)
+{
+	const __m256i incompleteMax = _mm256_load_si256((const __m256i *)INCOMPLETE_MAX);
+	__m256i error = _mm256_setzero_si256();
+	__m256i prev = _mm256_setzero_si256();
+	__m256i prevIncomplete = _mm256_setzero_si256();
+	uint8_t padded[32];
+
+	for(size_t x = 0; x < len; x += 32)
+	{
+		__m256i input;
+		if(x + 32 <= len)
+			input = _mm256_loadu_si256((const __m256i *)(bytes + x));
+		else
+		{
+			memset(padded, 0, sizeof(padded));
+			memcpy(padded, bytes + x, len - x);
+			input = _mm256_loadu_si256((const __m256i *)padded);
+		}
+
+		if(0 == _mm256_movemask_epi8(input))
+			error = _mm256_or_si256(error, prevIncomplete);
+		else
+		{
+			error = _mm256_or_si256(error, checkBlockAVX2(input, prev));
+			prevIncomplete = _mm256_subs_epu8(input, incompleteMax);
+		}
+		prev = input;
+	}
+	error = _mm256_or_si256(error, prevIncomplete);
+
+	return _mm256_testz_si256(error, error);
+}
+#endif
+
+ValidateFunction getValidateFunction(com::zenomt::Utf8Implementation impl)
+{
+	switch(impl)
+	{
+#ifdef ZENOMT_UTF8_X86
+	case com::zenomt::UTF8_SSSE3: return validSSSE3;
+	case com::zenomt::UTF8_AVX2: return validAVX2;
+#endif
+	default: return validScalar;
+	}
+}
+
+ValidateFunction getBestValidateFunction()
+{
+	using namespace com::zenomt;
+	if(isUtf8ImplementationSupported(UTF8_AVX2))
+		return getValidateFunction(UTF8_AVX2);
+	if(isUtf8ImplementationSupported(UTF8_SSSE3))
+		return getValidateFunction(UTF8_SSSE3);
+	return getValidateFunction(UTF8_SCALAR);
+}
+
+size_t _sequenceLength(uint8_t lead)
+{
+	if(lead >= 0xf0)
+		return 4;
+	if(lead >= 0xe0)
+		return 3;
+	if(lead >= 0xc0)
+		return 2;
+	return 1;
+}
+
+// answer how many bytes at the end are a character that isn't finished yet.
+size_t _unfinishedTail(const uint8_t *bytes, size_t len)
+{
+	for(size_t back = 1; back <= std::min(len, size_t(3)); back++)
+	{
+		uint8_t c = bytes[len - back];
+		if((c & 0xc0) == 0x80)
+			continue;
+		return _sequenceLength(c) > back ? back : 0;
+	}
+	return 0;
+}
+
+}
+
+namespace com { namespace zenomt {
+
+bool isValidUtf8(const void *bytes, size_t len)
+{
+	static const ValidateFunction best = getBestValidateFunction();
+	return best((const uint8_t *)bytes, len);
+}
+
+bool isUtf8ImplementationSupported(Utf8Implementation impl)
+{
+	switch(impl)
+	{
+	case UTF8_SCALAR:
+		return true;
+#ifdef ZENOMT_UTF8_X86
+	case UTF8_SSSE3:
+	{
+		static const bool supported = (__builtin_cpu_init(), __builtin_cpu_supports("ssse3"));
+		return supported;
+	}
+	case UTF8_AVX2:
+	{
+		static const bool supported = (__builtin_cpu_init(), __builtin_cpu_supports("avx2"));
+		return supported;
+	}
+#endif
+	default:
+		return false;
+	}
+}
+
+bool isValidUtf8(Utf8Implementation impl, const void *bytes, size_t len)
+{
+	if(not isUtf8ImplementationSupported(impl))
+		impl = UTF8_SCALAR;
+
+	return getValidateFunction(impl)((const uint8_t *)bytes, len);
+}
+
+bool Utf8Validator::update(const void *bytes_, size_t len)
+{
+	const uint8_t *bytes = (const uint8_t *)bytes_;
+	if(0 == len)
+		return m_valid;
+
+	if(m_valid and m_partialLength)
+	{
+		size_t need = _sequenceLength(m_partial[0]);
+		size_t take = std::min(need - m_partialLength, len);
+		memcpy(m_partial + m_partialLength, bytes, take);
+		m_partialLength += take;
+		bytes += take;
+		len -= take;
+
+		if(m_partialLength < need)
+		{
+			for(size_t x = 1; x < m_partialLength; x++)
+				if((m_partial[x] & 0xc0) != 0x80)
+					m_valid = false;
+			return m_valid;
+		}
+
+		m_partialLength = 0;
+		m_valid = isValidUtf8(m_partial, need);
+	}
+
+	if(not m_valid)
+		return false;
+
+	size_t tail = _unfinishedTail(bytes, len);
+	m_valid = isValidUtf8(bytes, len - tail);
+	memcpy(m_partial, bytes + len - tail, tail);
+	m_partialLength = tail;
+
+	return m_valid;
+}
+
+bool Utf8Validator::finish()
+{
+	bool rv = m_valid and (0 == m_partialLength);
+	reset();
+	return rv;
+}
+
+void Utf8Validator::reset()
+{
+	m_partialLength = 0;
+	m_valid = true;
+}
+
+} } // namespace com::zenomt
@@ -0,0 +1,171 @@
+// Copyright © 2026 Michael Thornburgh
+// SPDX-License-Identifier: MIT
+
+#include <cstring>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define ZENOMT_MASK_X86 1
+#include <immintrin.h>
+#endif
+
+#include "../include/zenomt/WebSocketMask.hpp"
+
+namespace {
+
+using MaskFunction = void (*)(uint8_t *dst, const uint8_t *src, size_t len, uint32_t key);
+
+// the key as a word whose first byte in memory is key[offset % 4]. the kernels only advance
+// by multiples of 4, so it stays lined up. kept in a register and broadcast, rather than
+// built up in memory, so vector loads don't stall on narrower stores.
+uint32_t makeKeyWord(const uint8_t *key, size_t offset)
+{
+	uint32_t word;
+	memcpy(&word, key, sizeof(word));
+	unsigned shift = (offset % 4) * 8;
+	if(0 == shift)
+		return word;
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+	return (word << shift) | (word >> (32 - shift));
+#else
+	return (word >> shift) | (word << (32 - shift));
+#endif
+}
+
+void maskScalar(uint8_t *dst, const uint8_t *src, size_t len, uint32_t key)
+{
+	uint64_t pat = (uint64_t(key) << 32) | key;
+	uint64_t word;
+
+	size_t x = 0;
+	for(; x + sizeof(word) <= len; x += sizeof(word))
+	{
+		memcpy(&word, src + x, sizeof(word));
+		word ^= pat;
+		memcpy(dst + x, &word, sizeof(word));
+	}
+
+	uint8_t keyBytes[4];
+	memcpy(keyBytes, &key, sizeof(keyBytes));
+	for(; x < len; x++)
+		dst[x] = src[x] ^ keyBytes[x % 4];
+}
+
+#ifdef ZENOMT_MASK_X86
+__attribute__((target("sse2")))
+void maskSSE2(uint8_t *dst, const uint8_t *src, size_t len, uint32_t key)
+{
+	const __m128i pat = _mm_set1_epi32(int(key));
+
+	size_t x = 0;
+	for(; x + 32 <= len; x += 32)
+	{
+		__m128i a = _mm_loadu_si128((const __m128i *)(src + x));
+		__m128i b = _mm_loadu_si128((const __m128i *)(src + x + 16));
+		_mm_storeu_si128((__m128i *)(dst + x), _mm_xor_si128(a, pat));
+		_mm_storeu_si128((__m128i *)(dst + x + 16), _mm_xor_si128(b, pat));
+	}
+	if(x + 16 <= len)
+	{
+		__m128i a = _mm_loadu_si128((const __m128i *)(src + x));
+		_mm_storeu_si128((__m128i *)(dst + x), _mm_xor_si128(a, pat));
+		x += 16;
+	}
+
+	maskScalar(dst + x, src + x, len - x, key);
+}
+
+__attribute__((target("avx2")))
+void maskAVX2(uint8_t *dst, const uint8_t *src, size_t len, uint32_t key)
+{
+	const __m256i pat = _mm256_set1_epi32(int(key));
+
+	size_t x = 0;
+	for(; x + 64 <= len; x += 64)
+	{
+		__m256i a = _mm256_loadu_si256((const __m256i *)(src + x));
+		__m256i b = _mm256_loadu_si256((const __m256i *)(src + x + 32));
+		_mm256_storeu_si256((__m256i *)(dst + x), _mm256_xor_si256(a, pat));
+		_mm256_storeu_si256((__m256i *)(dst + x + 32), _mm256_xor_si256(b, pat));
+	}
+	if(x + 32 <= len)
+	{
+		__m256i a = _mm256_loadu_si256((const __m256i *)(src + x));
+		_mm256_storeu_si256((__m256i *)(dst + x), _mm256_xor_si256(a, pat));
+		x += 32;
+	}
+	if(x + 16 <= len)
+	{
+		// VEX-encoded here, so no SSE/AVX transition penalty.
+		__m128i a = _mm_loadu_si128((const __m128i *)(src + x));
+		_mm_storeu_si128((__m128i *)(dst + x), _mm_xor_si128(a, _mm256_castsi256_si128(pat)));
+		x += 16;
+	}
+
+	maskScalar(dst + x, src + x, len - x, key);
+}
+#endif
+
+MaskFunction getMaskFunction(com::zenomt::websock::MaskImplementation impl)
+{
+	switch(impl)
+	{
+#ifdef ZENOMT_MASK_X86
+	case com::zenomt::websock::MASK_SSE2: return maskSSE2;
+	case com::zenomt::websock::MASK_AVX2: return maskAVX2;
+#endif
+	default: return maskScalar;
+	}
+}
+
+MaskFunction getBestMaskFunction()
+{
+	using namespace com::zenomt::websock;
+	if(isMaskImplementationSupported(MASK_AVX2))
+		return getMaskFunction(MASK_AVX2);
+	if(isMaskImplementationSupported(MASK_SSE2))
+		return getMaskFunction(MASK_SSE2);
+	return getMaskFunction(MASK_SCALAR);
+}
+
+}
+
+namespace com { namespace zenomt { namespace websock {
+
+void applyMask(uint8_t *dst, const uint8_t *src, size_t len, const uint8_t *key, size_t offset)
+{
+	static const MaskFunction best = getBestMaskFunction();
+	best(dst, src, len, makeKeyWord(key, offset));
+}
+
+bool isMaskImplementationSupported(MaskImplementation impl)
+{
+	switch(impl)
+	{
+	case MASK_SCALAR:
+		return true;
+#ifdef ZENOMT_MASK_X86
+	case MASK_SSE2:
+	{
+		static const bool supported = (__builtin_cpu_init(), __builtin_cpu_supports("sse2"));
+		return supported;
+	}
+	case MASK_AVX2:
+	{
+		static const bool supported = (__builtin_cpu_init(), __builtin_cpu_supports("avx2"));
+		return supported;
+	}
+#endif
+	default:
+		return false;
+	}
+}
+
+void applyMask(MaskImplementation impl, uint8_t *dst, const uint8_t *src, size_t len, const uint8_t *key, size_t offset)
+{
+	if(not isMaskImplementationSupported(impl))
+		impl = MASK_SCALAR;
+
+	getMaskFunction(impl)(dst, src, len, makeKeyWord(key, offset));
+}
+
+} } } // namespace com::zenomt::websock
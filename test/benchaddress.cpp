@@ -0,0 +1,195 @@
+// Benchmark Address::toPresentation() and Address::setFromPresentation()
+// against the inet_ntop(3)/snprintf(3) and sscanf(3)/inet_pton(3)
+// implementations they replaced, and verify the output is identical.
+
+#include "zenomt/Address.hpp"
+
+#include <cassert>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <unistd.h>
+
+using namespace com::zenomt::rtmfp;
+
+static void legacyToPresentation(const Address &addr, char *dst, bool withPort)
+{
+	char buf[INET6_ADDRSTRLEN];
+
+	*dst = 0;
+
+	if(not inet_ntop(addr.getFamily(), addr.getIPAddressPtr(), buf, sizeof(buf)))
+		return;
+
+	if(not withPort)
+		snprintf(dst, Address::MAX_PRESENTATION_LENGTH, "%s", buf);
+	else
+	{
+		if(AF_INET == addr.getFamily())
+			snprintf(dst, Address::MAX_PRESENTATION_LENGTH, "%s:%u", buf, addr.getPort());
+		else
+			snprintf(dst, Address::MAX_PRESENTATION_LENGTH, "[%s]:%u", buf, addr.getPort());
+	}
+}
+
+static bool legacySetFromPresentation(Address &addr, const char *src)
+{
+	char ip[45+1];
+	int port = 0;
+	size_t colons = 0;
+	for(const char *cursor = src; *cursor; cursor++)
+		if(':' == *cursor)
+			colons++;
+	int family = colons > 1 ? AF_INET6 : AF_INET;
+
+	if(2 != sscanf(src, "[%45[0-9a-fA-F:.]]:%d", ip, &port))
+	{
+		if(AF_INET6 == family)
+			return false;
+		if(2 != sscanf(src, "%45[0-9.]:%d", ip, &port))
+			return false;
+	}
+
+	uint8_t ipaddr[16];
+	if(inet_pton(family, ip, ipaddr) < 1)
+		return false;
+
+	addr.setIPAddress(ipaddr, AF_INET6 == family ? 16 : 4);
+	addr.setPort(port);
+
+	return true;
+}
+
+static double now()
+{
+	using namespace std::chrono;
+	return duration_cast<duration<double>>(steady_clock::now().time_since_epoch()).count();
+}
+
+static void usage(const char *name)
+{
+	printf("usage: %s [-n count] [-r rounds] [-h]\n", name);
+	printf("  -n count  -- number of distinct random addresses (default 10000)\n");
+	printf("  -r rounds -- passes over the addresses per timed run (default 100)\n");
+	printf("  -h        -- show this help\n");
+}
+
+int main(int argc, char **argv)
+{
+	size_t count = 10000;
+	int rounds = 100;
+	int ch;
+
+	while((ch = getopt(argc, argv, "n:r:h")) != -1)
+	{
+		switch(ch)
+		{
+		case 'n':
+			count = atol(optarg);
+			break;
+		case 'r':
+			rounds = atoi(optarg);
+			break;
+		case 'h':
+		default:
+			usage(argv[0]);
+			return 'h' == ch ? 0 : 1;
+		}
+	}
+
+	std::vector<Address> addresses(count);
+	unsigned seed = 1;
+	for(size_t x = 0; x < count; x++)
+	{
+		uint8_t ip[16];
+		size_t len = (x % 2) ? 16 : 4;
+		for(size_t y = 0; y < len; y++)
+		{
+			seed = seed * 1103515245 + 12345;
+			unsigned r = (seed >> 16) & 0xff;
+			ip[y] = ((16 == len) and (r < 100)) ? 0 : r;
+		}
+		addresses[x].setIPAddress(ip, len);
+		addresses[x].setPort(seed % 65536);
+	}
+
+	std::vector<std::vector<char>> presentations(count, std::vector<char>(Address::MAX_PRESENTATION_LENGTH));
+
+	// equivalence
+	for(size_t x = 0; x < count; x++)
+	{
+		for(int withPort = 0; withPort < 2; withPort++)
+		{
+			char fast[Address::MAX_PRESENTATION_LENGTH];
+			char legacy[Address::MAX_PRESENTATION_LENGTH];
+			addresses[x].toPresentation(fast, withPort);
+			legacyToPresentation(addresses[x], legacy, withPort);
+			if(strcmp(fast, legacy))
+			{
+				printf("MISMATCH toPresentation: %s != %s\n", fast, legacy);
+				return 1;
+			}
+		}
+
+		addresses[x].toPresentation(presentations[x].data());
+
+		Address fast, legacy;
+		bool fastOk = fast.setFromPresentation(presentations[x].data());
+		bool legacyOk = legacySetFromPresentation(legacy, presentations[x].data());
+		if((fastOk != legacyOk) or not (fast == legacy))
+		{
+			printf("MISMATCH setFromPresentation: %s\n", presentations[x].data());
+			return 1;
+		}
+	}
+	printf("equivalence: %lu addresses formatted and parsed identically\n", (unsigned long)count);
+
+	size_t ops = count * rounds;
+	char buf[Address::MAX_PRESENTATION_LENGTH];
+	unsigned long sink = 0;
+	double begin, legacyTime, fastTime;
+
+	begin = now();
+	for(int r = 0; r < rounds; r++)
+		for(size_t x = 0; x < count; x++)
+		{
+			legacyToPresentation(addresses[x], buf, true);
+			sink += buf[1];
+		}
+	legacyTime = now() - begin;
+
+	begin = now();
+	for(int r = 0; r < rounds; r++)
+		for(size_t x = 0; x < count; x++)
+		{
+			addresses[x].toPresentation(buf, true);
+			sink += buf[1];
+		}
+	fastTime = now() - begin;
+
+	printf("toPresentation:      legacy %7.1f ns/op  fast %7.1f ns/op  speedup %.2fx\n",
+		legacyTime * 1e9 / ops, fastTime * 1e9 / ops, legacyTime / fastTime);
+
+	Address scratch;
+
+	begin = now();
+	for(int r = 0; r < rounds; r++)
+		for(size_t x = 0; x < count; x++)
+			sink += legacySetFromPresentation(scratch, presentations[x].data());
+	legacyTime = now() - begin;
+
+	begin = now();
+	for(int r = 0; r < rounds; r++)
+		for(size_t x = 0; x < count; x++)
+			sink += scratch.setFromPresentation(presentations[x].data());
+	fastTime = now() - begin;
+
+	printf("setFromPresentation: legacy %7.1f ns/op  fast %7.1f ns/op  speedup %.2fx\n",
+		legacyTime * 1e9 / ops, fastTime * 1e9 / ops, legacyTime / fastTime);
+
+	return sink ? 0 : 2;
+}
@@ -0,0 +1,183 @@
+// Benchmark fanning the same binary message out to many server SimpleWebSockets, on in-memory
+// platforms that throw away what's written. Compares sendBinaryMessage() with a copied payload,
+// sendBinaryMessage() with a shared payload (the header is still encoded for each socket),
+// and sendFrame() with one pre-encoded WebSocketFrame. Reports time per recipient and how many
+// bytes were copied versus handed to the platform shared.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include "zenomt/SimpleWebSocket.hpp"
+
+using namespace com::zenomt;
+using namespace com::zenomt::websock;
+
+namespace {
+
+struct Counts {
+	size_t m_copied { 0 };
+	size_t m_shared { 0 };
+};
+
+class NullPlatformAdapter : public IStreamPlatformAdapter {
+public:
+	NullPlatformAdapter(Counts *counts) : m_counts(counts) {}
+
+	Time getCurrentTime() override { return 0; }
+	void notifyWhenWritable(const onwritable_f &onwritable) override { m_onwritable = onwritable; }
+	void setOnReceiveBytesCallback(const onreceivebytes_f &onreceivebytes) override { m_onreceivebytes = onreceivebytes; }
+	void setOnStreamDidCloseCallback(const Task &onstreamdidclose) override {}
+	void doLater(const Task &task) override {}
+	void onClientClosed() override {}
+
+	bool writeBytes(const void *bytes, size_t len) override
+	{
+		m_counts->m_copied += len;
+		return true;
+	}
+
+	bool writeSharedBytes(const std::shared_ptr<const void> &owner, const void *bytes, size_t len) override
+	{
+		m_counts->m_shared += len;
+		return true;
+	}
+
+	void pump()
+	{
+		while(m_onwritable and m_onwritable())
+			;
+		m_onwritable = nullptr;
+	}
+
+	Counts *m_counts;
+	onwritable_f m_onwritable;
+	onreceivebytes_f m_onreceivebytes;
+};
+
+class BenchWebSocket : public SimpleWebSocket {
+public:
+	using SimpleWebSocket::SimpleWebSocket;
+	void sha1(void *dst, const void *msg, size_t len) override { memset(dst, 0, 20); } // not checked here
+};
+
+struct Subscriber {
+	std::shared_ptr<NullPlatformAdapter> m_platform;
+	std::shared_ptr<SimpleWebSocket> m_ws;
+};
+
+enum Method { COPY, SHARED_PAYLOAD, SHARED_FRAME };
+
+void measure(Method method, std::vector<Subscriber> &subscribers, Counts &counts, size_t numMessages, size_t messageSize)
+{
+	auto payload = std::make_shared<const Bytes>(messageSize, 'x');
+	counts = Counts();
+
+	auto begin = std::chrono::steady_clock::now();
+	for(size_t m = 0; m < numMessages; m++)
+	{
+		std::shared_ptr<const WebSocketFrame> frame;
+		if(SHARED_FRAME == method)
+			frame = share_ref(new WebSocketFrame(payload->data(), payload->size()), false);
+
+		for(auto it = subscribers.begin(); it != subscribers.end(); it++)
+		{
+			if(COPY == method)
+				it->m_ws->sendBinaryMessage(payload->data(), payload->size());
+			else if(SHARED_PAYLOAD == method)
+				it->m_ws->sendBinaryMessage(payload);
+			else
+				it->m_ws->sendFrame(frame);
+		}
+
+		for(auto it = subscribers.begin(); it != subscribers.end(); it++)
+			it->m_platform->pump();
+	}
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - begin;
+
+	const char *names[] = { "copy", "shared payload", "shared frame" };
+	double sends = double(numMessages) * subscribers.size();
+	printf("%-15s %10.1f ns/recipient %12.1f MB copied %12.1f MB shared\n", names[method],
+		elapsed.count() / sends * 1e9, counts.m_copied / 1e6, counts.m_shared / 1e6);
+}
+
+void usage(const char *name)
+{
+	printf("usage: %s [-c subscribers] [-n messages] [-s bytes] [-h]\n", name);
+	printf("  -c subscribers -- sockets each message is sent to (default 10000)\n");
+	printf("  -n messages    -- messages to send (default 200)\n");
+	printf("  -s bytes       -- message size (default 4096)\n");
+	printf("  -h             -- show this help\n");
+}
+
+}
+
+int main(int argc, char **argv)
+{
+	size_t numSubscribers = 10000;
+	size_t numMessages = 200;
+	size_t messageSize = 4096;
+	int ch;
+
+	while((ch = getopt(argc, argv, "c:n:s:h")) != -1)
+	{
+		switch(ch)
+		{
+		case 'c':
+			numSubscribers = atol(optarg);
+			break;
+		case 'n':
+			numMessages = atol(optarg);
+			break;
+		case 's':
+			messageSize = atol(optarg);
+			break;
+		case 'h':
+		default:
+			usage(argv[0]);
+			return 'h' == ch ? 0 : 1;
+		}
+	}
+
+	if((0 == numSubscribers) or (0 == numMessages))
+	{
+		usage(argv[0]);
+		return 1;
+	}
+
+	const std::string upgrade =
+		"GET /feed HTTP/1.1\r\n"
+		"Host: example.com\r\n"
+		"Upgrade: websocket\r\n"
+		"Connection: Upgrade\r\n"
+		"Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n"
+		"Sec-WebSocket-Version: 13\r\n"
+		"\r\n";
+
+	Counts counts;
+	std::vector<Subscriber> subscribers(numSubscribers);
+	for(auto it = subscribers.begin(); it != subscribers.end(); it++)
+	{
+		it->m_platform = std::make_shared<NullPlatformAdapter>(&counts);
+		it->m_ws = share_ref(new BenchWebSocket(it->m_platform), false);
+		it->m_ws->init();
+		it->m_platform->m_onreceivebytes(upgrade.data(), upgrade.size());
+		it->m_platform->pump();
+	}
+
+	printf("%lu subscribers, %lu messages of %lu bytes\n",
+		(unsigned long)numSubscribers, (unsigned long)numMessages, (unsigned long)messageSize);
+	measure(COPY, subscribers, counts, numMessages, messageSize);
+	measure(SHARED_PAYLOAD, subscribers, counts, numMessages, messageSize);
+	measure(SHARED_FRAME, subscribers, counts, numMessages, messageSize);
+
+	for(auto it = subscribers.begin(); it != subscribers.end(); it++)
+		it->m_ws->close();
+
+	return 0;
+}
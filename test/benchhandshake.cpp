@@ -0,0 +1,156 @@
+// Benchmark parsing HTTP request headers like a browser's WebSocket upgrade, on in-memory
+// platforms that throw away what's written. Measures SimpleHttpStream alone (parse and look up
+// a few headers) and whole SimpleWebSocket server handshakes (without SHA-1, which is stubbed
+// out), with the request arriving in one read or in small pieces, and reports requests per second.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include <unistd.h>
+
+#include "zenomt/SimpleWebSocket.hpp"
+
+using namespace com::zenomt;
+using namespace com::zenomt::websock;
+
+namespace {
+
+class NullPlatformAdapter : public IStreamPlatformAdapter {
+public:
+	Time getCurrentTime() override { return 0; }
+	void notifyWhenWritable(const onwritable_f &onwritable) override { m_onwritable = onwritable; }
+	void setOnReceiveBytesCallback(const onreceivebytes_f &onreceivebytes) override { m_onreceivebytes = onreceivebytes; }
+	void setOnStreamDidCloseCallback(const Task &onstreamdidclose) override {}
+	void doLater(const Task &task) override {}
+	bool writeBytes(const void *bytes, size_t len) override { return true; }
+	void onClientClosed() override {}
+
+	void pump()
+	{
+		while(m_onwritable and m_onwritable())
+			;
+		m_onwritable = nullptr;
+	}
+
+	onwritable_f m_onwritable;
+	onreceivebytes_f m_onreceivebytes;
+};
+
+class BenchWebSocket : public SimpleWebSocket {
+public:
+	using SimpleWebSocket::SimpleWebSocket;
+	void sha1(void *dst, const void *msg, size_t len) override { memset(dst, 0, 20); }
+};
+
+const std::string REQUEST =
+	"GET /socket/v2/feed?session=8d1f0c HTTP/1.1\r\n"
+	"Host: stream.example.com\r\n"
+	"Connection: Upgrade\r\n"
+	"Pragma: no-cache\r\n"
+	"Cache-Control: no-cache\r\n"
+	"User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/124.0.0.0 Safari/537.36\r\n"
+	"Upgrade: websocket\r\n"
+	"Origin: https://www.example.com\r\n"
+	"Sec-WebSocket-Version: 13\r\n"
+	"Accept-Encoding: gzip, deflate, br, zstd\r\n"
+	"Accept-Language: en-US,en;q=0.9\r\n"
+	"Cookie: session=2b7e151628aed2a6abf7158809cf4f3c; theme=dark; consent=yes\r\n"
+	"Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n"
+	"Sec-WebSocket-Extensions: permessage-deflate; client_max_window_bits\r\n"
+	"\r\n";
+
+void feed(NullPlatformAdapter *platform, size_t piece)
+{
+	for(size_t offset = 0; offset < REQUEST.size(); offset += piece)
+		platform->m_onreceivebytes(REQUEST.data() + offset, std::min(piece, REQUEST.size() - offset));
+}
+
+void measure(bool websocket, size_t piece, size_t count)
+{
+	size_t good = 0;
+
+	auto begin = std::chrono::steady_clock::now();
+	for(size_t x = 0; x < count; x++)
+	{
+		auto platform = std::make_shared<NullPlatformAdapter>();
+		if(websocket)
+		{
+			auto ws = share_ref(new BenchWebSocket(platform), false);
+			ws->onOpen = [&] { good++; };
+			ws->init();
+			feed(platform.get(), piece);
+			platform->pump();
+			ws->close();
+		}
+		else
+		{
+			auto http = share_ref(new SimpleHttpStream(platform), false);
+			http->onHttpHeadersReceived = [&] {
+				if( http->hasHeader("origin")
+				 and (http->getHeader("Sec-WebSocket-Version").size() == 2)
+				 and (http->getHeaderValues("COOKIE").size() == 1)
+				)
+					good++;
+			};
+			http->init();
+			feed(platform.get(), piece);
+			http->close();
+		}
+	}
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - begin;
+
+	if(good != count)
+		printf("failed?\n");
+
+	printf("%-10s %6lu %12.0f requests/s %8.2f us each\n", websocket ? "websocket" : "http", (unsigned long)piece,
+		count / elapsed.count(), elapsed.count() / count * 1e6);
+}
+
+void usage(const char *name)
+{
+	printf("usage: %s [-n requests] [-h]\n", name);
+	printf("  -n requests -- requests to parse for each measurement (default 200000)\n");
+	printf("  -h          -- show this help\n");
+}
+
+}
+
+int main(int argc, char **argv)
+{
+	size_t count = 200000;
+	int ch;
+
+	while((ch = getopt(argc, argv, "n:h")) != -1)
+	{
+		switch(ch)
+		{
+		case 'n':
+			count = atol(optarg);
+			break;
+		case 'h':
+		default:
+			usage(argv[0]);
+			return 'h' == ch ? 0 : 1;
+		}
+	}
+
+	if(0 == count)
+	{
+		usage(argv[0]);
+		return 1;
+	}
+
+	printf("%lu byte request, %lu times\n", (unsigned long)REQUEST.size(), (unsigned long)count);
+	printf("%-10s %6s\n", "", "piece");
+	const size_t pieces[] = { 4096, 64, 1 };
+	for(size_t piece : pieces)
+	{
+		measure(false, piece, count / (1 == piece ? 4 : 1));
+		measure(true, piece, count / (1 == piece ? 4 : 1));
+	}
+
+	return 0;
+}
@@ -0,0 +1,129 @@
+// Bulk ingest benchmark for PosixStreamPlatformAdapter's receive path. A writer thread
+// sends as fast as it can over a socketpair while the adapter reads with each of several
+// configurations; reports throughput and system calls per megabyte, counting each
+// readable event as one run loop wait.
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "zenomt/PosixStreamPlatformAdapter.hpp"
+#include "zenomt/RunLoops.hpp"
+
+using namespace com::zenomt;
+
+struct Mode {
+	const char *m_name;
+	size_t m_budget;
+	bool m_fionread;
+	bool m_pool;
+};
+
+static bool runOnce(const Mode &mode, size_t total, size_t writeSize)
+{
+	int fds[2];
+	if(socketpair(AF_UNIX, SOCK_STREAM, 0, fds))
+	{
+		perror("socketpair");
+		return false;
+	}
+
+	std::thread writer([fds, total, writeSize] {
+		std::vector<uint8_t> buf(writeSize, 'w');
+		size_t sent = 0;
+		while(sent < total)
+		{
+			ssize_t rv = ::write(fds[1], buf.data(), std::min(writeSize, total - sent));
+			if(rv <= 0)
+				break;
+			sent += rv;
+		}
+	});
+
+	PreferredRunLoop rl;
+	auto adapter = share_ref(new PosixStreamPlatformAdapter(&rl), false);
+	if(mode.m_pool)
+		adapter->setReceiveBufferPool(share_ref(new ReceiveBufferPool(), false));
+	adapter->setReadBudget(mode.m_budget);
+	adapter->setUseFIONREAD(mode.m_fionread);
+	adapter->setSocketFd(fds[0]);
+
+	size_t received = 0;
+	adapter->setOnReceiveBytesCallback([&] (const void *bytes, size_t len) {
+		received += len;
+		if(received >= total)
+			rl.stop();
+		return true;
+	});
+
+	Time begin = rl.getCurrentTimeNoCache();
+	rl.run();
+	double elapsed = rl.getCurrentTimeNoCache() - begin;
+
+	writer.join();
+	auto stats = adapter->getIOStats();
+	adapter->close();
+	rl.clear();
+	::close(fds[1]);
+
+	double megabytes = total / (1024.0 * 1024.0);
+	printf("%-22s %9.1f %10.1f %12.1f %10.1f\n", mode.m_name, megabytes / elapsed,
+		stats.m_readableEvents / megabytes,
+		(stats.m_readCalls + stats.m_ioctlCalls) / megabytes,
+		(stats.m_readableEvents + stats.m_readCalls + stats.m_ioctlCalls) / megabytes);
+
+	return true;
+}
+
+static void usage(const char *name)
+{
+	printf("usage: %s [-m megabytes] [-w writesize] [-h]\n", name);
+	printf("  -m megabytes -- bytes to transfer per configuration (default 2048)\n");
+	printf("  -w writesize -- bytes per write by the sender (default 65536)\n");
+	printf("  -h           -- show this help\n");
+}
+
+int main(int argc, char **argv)
+{
+	size_t megabytes = 2048;
+	size_t writeSize = 65536;
+	int ch;
+
+	while((ch = getopt(argc, argv, "m:w:h")) != -1)
+	{
+		switch(ch)
+		{
+		case 'm':
+			megabytes = atol(optarg);
+			break;
+		case 'w':
+			writeSize = atol(optarg);
+			break;
+		case 'h':
+		default:
+			usage(argv[0]);
+			return 'h' == ch ? 0 : 1;
+		}
+	}
+
+	const Mode modes[] = {
+		{ "one read per event", 0, false, false },
+		{ "budget 256K", 256 * 1024, false, false },
+		{ "budget 1M", 1024 * 1024, false, false },
+		{ "budget 1M + FIONREAD", 1024 * 1024, true, false },
+		{ "budget 1M + pool", 1024 * 1024, false, true },
+	};
+
+	printf("%-22s %9s %10s %12s %10s\n", "", "MB/s", "events/MB", "rd+ioctl/MB", "syscall/MB");
+	for(auto &each : modes)
+		if(not runOnce(each, megabytes * 1024 * 1024, writeSize))
+			return 1;
+
+	return 0;
+}
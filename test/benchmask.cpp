@@ -0,0 +1,106 @@
+// Benchmark the WebSocket masking kernels. For each payload size, masks the same buffer
+// repeatedly with each implementation (and with the byte-at-a-time loop SimpleWebSocket
+// used to use) and reports GB/s.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include <unistd.h>
+
+#include "zenomt/WebSocketMask.hpp"
+
+using namespace com::zenomt::websock;
+
+static const uint8_t KEY[4] = { 0x37, 0xfa, 0x21, 0x3d };
+
+static void maskBytewise(std::vector<uint8_t> &dst, const uint8_t *src, size_t len)
+{
+	uint32_t mask = (uint32_t(KEY[0]) << 24) | (KEY[1] << 16) | (KEY[2] << 8) | KEY[3];
+	int maskShift = 24;
+	dst.clear();
+	for(size_t x = 0; x < len; x++)
+	{
+		dst.push_back(src[x] ^ ((mask >> maskShift) & 0xff));
+		maskShift -= 8;
+		if(maskShift < 0)
+			maskShift = 24;
+	}
+}
+
+static double measure(int impl, size_t size, size_t total)
+{
+	std::vector<uint8_t> src(size);
+	for(size_t x = 0; x < size; x++)
+		src[x] = uint8_t(x);
+	std::vector<uint8_t> dst(size);
+
+	size_t rounds = std::max(total / size, size_t(1));
+	auto begin = std::chrono::steady_clock::now();
+	for(size_t r = 0; r < rounds; r++)
+	{
+		if(impl < 0)
+			maskBytewise(dst, src.data(), size);
+		else
+			applyMask(MaskImplementation(impl), dst.data(), src.data(), size, KEY, r);
+	}
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - begin;
+
+	volatile uint8_t sink = dst[size / 2]; // don't let the work be optimized away
+	(void)sink;
+
+	return double(rounds) * size / elapsed.count() / 1e9;
+}
+
+static void usage(const char *name)
+{
+	printf("usage: %s [-m megabytes] [-h]\n", name);
+	printf("  -m megabytes -- bytes to mask per measurement (default 1024)\n");
+	printf("  -h           -- show this help\n");
+}
+
+int main(int argc, char **argv)
+{
+	size_t megabytes = 1024;
+	int ch;
+
+	while((ch = getopt(argc, argv, "m:h")) != -1)
+	{
+		switch(ch)
+		{
+		case 'm':
+			megabytes = atol(optarg);
+			break;
+		case 'h':
+		default:
+			usage(argv[0]);
+			return 'h' == ch ? 0 : 1;
+		}
+	}
+
+	size_t total = megabytes * 1024 * 1024;
+	const size_t sizes[] = { 16, 64, 256, 1024, 4096, 65536, 1048576 };
+	const char *names[] = { "scalar", "sse2", "avx2" };
+
+	printf("%10s %10s", "size", "bytewise");
+	for(int impl = MASK_SCALAR; impl <= MASK_AVX2; impl++)
+		printf(" %10s", names[impl]);
+	printf("   (GB/s)\n");
+
+	for(size_t size : sizes)
+	{
+		printf("%10lu %10.2f", (unsigned long)size, measure(-1, size, total / 8)); // it's slow
+		for(int impl = MASK_SCALAR; impl <= MASK_AVX2; impl++)
+		{
+			if(isMaskImplementationSupported(MaskImplementation(impl)))
+				printf(" %10.2f", measure(impl, size, total));
+			else
+				printf(" %10s", "-");
+		}
+		printf("\n");
+	}
+
+	return 0;
+}
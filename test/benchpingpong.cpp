@@ -0,0 +1,190 @@
+// Round trip latency benchmark for PosixStreamPlatformAdapter. A client and an echo
+// server, each with its own RunLoop and thread, bounce a small message back and forth
+// over TCP loopback, with and without optimistic writes. Reports microseconds per round
+// trip and the writable events (each a trip through the RunLoop, plus epoll_ctl()s to
+// register and unregister) the two sides needed per round trip.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "zenomt/PosixStreamPlatformAdapter.hpp"
+#include "zenomt/RunLoops.hpp"
+
+using namespace com::zenomt;
+
+static bool makeLoopbackPair(int *client, int *server)
+{
+	int listener = socket(AF_INET, SOCK_STREAM, 0);
+	struct sockaddr_in sin;
+	memset(&sin, 0, sizeof(sin));
+	sin.sin_family = AF_INET;
+	sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	socklen_t sinlen = sizeof(sin);
+	if( (listener < 0)
+	 or bind(listener, (struct sockaddr *)&sin, sizeof(sin))
+	 or listen(listener, 1)
+	 or getsockname(listener, (struct sockaddr *)&sin, &sinlen)
+	)
+		return false;
+
+	*client = socket(AF_INET, SOCK_STREAM, 0);
+	if(connect(*client, (struct sockaddr *)&sin, sizeof(sin)))
+		return false;
+	*server = accept(listener, nullptr, nullptr);
+	::close(listener);
+	return *server >= 0;
+}
+
+struct Result {
+	double m_seconds;
+	uint64_t m_writableEvents;
+	uint64_t m_optimisticWrites;
+};
+
+static void runServer(int fd, bool optimistic, Result &result)
+{
+	PreferredRunLoop rl;
+	auto adapter = share_ref(new PosixStreamPlatformAdapter(&rl), false);
+	adapter->setSocketFd(fd);
+	adapter->setOptimisticWrites(optimistic);
+
+	std::vector<uint8_t> pending;
+	adapter->setOnReceiveBytesCallback([&] (const void *bytes, size_t len) {
+		pending.insert(pending.end(), (const uint8_t *)bytes, (const uint8_t *)bytes + len);
+		adapter->notifyWhenWritable([&] {
+			adapter->writeBytes(pending.data(), pending.size());
+			pending.clear();
+			return false;
+		});
+		return true;
+	});
+	adapter->setOnStreamDidCloseCallback([&] { rl.stop(); });
+
+	rl.run();
+
+	auto stats = adapter->getIOStats();
+	result.m_writableEvents = stats.m_writableEvents;
+	result.m_optimisticWrites = stats.m_optimisticWrites;
+	adapter->close();
+	rl.clear();
+}
+
+static bool runOnce(size_t messageSize, size_t rounds, bool optimistic, Result &result)
+{
+	int client, server;
+	if(not makeLoopbackPair(&client, &server))
+	{
+		perror("loopback");
+		return false;
+	}
+
+	Result serverResult;
+	std::thread serverThread([=, &serverResult] { runServer(server, optimistic, serverResult); });
+
+	PreferredRunLoop rl;
+	auto adapter = share_ref(new PosixStreamPlatformAdapter(&rl), false);
+	adapter->setSocketFd(client);
+	adapter->setOptimisticWrites(optimistic);
+
+	std::vector<uint8_t> message(messageSize, 'm');
+	size_t completed = 0;
+	size_t received = 0;
+
+	auto sendMessage = [&] {
+		adapter->notifyWhenWritable([&] {
+			adapter->writeBytes(message.data(), message.size());
+			return false;
+		});
+	};
+
+	adapter->setOnReceiveBytesCallback([&] (const void *bytes, size_t len) {
+		received += len;
+		if(received < messageSize)
+			return true;
+		received -= messageSize;
+		if(++completed < rounds)
+			sendMessage();
+		else
+		{
+			adapter->onClientClosed();
+			rl.stop();
+		}
+		return true;
+	});
+
+	Time begin = rl.getCurrentTimeNoCache();
+	sendMessage();
+	rl.run();
+	result.m_seconds = rl.getCurrentTimeNoCache() - begin;
+
+	auto stats = adapter->getIOStats();
+
+	rl.run(0.01); // let the shutdown go out
+	adapter->close();
+	rl.clear();
+	serverThread.join();
+
+	result.m_writableEvents = stats.m_writableEvents + serverResult.m_writableEvents;
+	result.m_optimisticWrites = stats.m_optimisticWrites + serverResult.m_optimisticWrites;
+
+	return true;
+}
+
+static void usage(const char *name)
+{
+	printf("usage: %s [-n rounds] [-s bytes] [-h]\n", name);
+	printf("  -n rounds -- round trips per run (default 20000)\n");
+	printf("  -s bytes  -- message size (default 64)\n");
+	printf("  -h        -- show this help\n");
+}
+
+int main(int argc, char **argv)
+{
+	size_t rounds = 20000;
+	size_t messageSize = 64;
+	int ch;
+
+	while((ch = getopt(argc, argv, "n:s:h")) != -1)
+	{
+		switch(ch)
+		{
+		case 'n':
+			rounds = atol(optarg);
+			break;
+		case 's':
+			messageSize = atol(optarg);
+			break;
+		case 'h':
+		default:
+			usage(argv[0]);
+			return 'h' == ch ? 0 : 1;
+		}
+	}
+
+	if((0 == rounds) or (0 == messageSize))
+	{
+		usage(argv[0]);
+		return 1;
+	}
+
+	printf("%12s %12s %16s %16s\n", "mode", "usec/rtt", "writable/rtt", "optimistic/rtt");
+	for(int optimistic = 0; optimistic < 2; optimistic++)
+	{
+		Result result;
+		if(not runOnce(messageSize, rounds, optimistic, result))
+			return 1;
+		printf("%12s %12.2f %16.2f %16.2f\n", optimistic ? "optimistic" : "registered",
+			result.m_seconds * 1000000.0 / rounds,
+			double(result.m_writableEvents) / rounds,
+			double(result.m_optimisticWrites) / rounds);
+	}
+
+	return 0;
+}
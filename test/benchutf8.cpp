@@ -0,0 +1,142 @@
+// Benchmark UTF-8 validation. For each kind of text and size, validates the same buffer
+// repeatedly with each implementation (and with a byte-at-a-time decoding loop like an
+// application might use) and reports GB/s.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include "zenomt/Utf8.hpp"
+
+using namespace com::zenomt;
+
+static bool validBytewise(const uint8_t *s, size_t len)
+{
+	size_t x = 0;
+	while(x < len)
+	{
+		uint8_t c = s[x];
+		size_t need;
+		uint32_t cp;
+		if(c < 0x80) { need = 1; cp = c; }
+		else if((c & 0xe0) == 0xc0) { need = 2; cp = c & 0x1f; }
+		else if((c & 0xf0) == 0xe0) { need = 3; cp = c & 0x0f; }
+		else if((c & 0xf8) == 0xf0) { need = 4; cp = c & 0x07; }
+		else return false;
+
+		if(len - x < need)
+			return false;
+		for(size_t each = 1; each < need; each++)
+		{
+			if((s[x + each] & 0xc0) != 0x80)
+				return false;
+			cp = (cp << 6) | (s[x + each] & 0x3f);
+		}
+
+		const uint32_t minimum[5] = { 0, 0, 0x80, 0x800, 0x10000 };
+		if((cp < minimum[need]) or (cp > 0x10ffff) or ((cp >= 0xd800) and (cp <= 0xdfff)))
+			return false;
+		x += need;
+	}
+	return true;
+}
+
+static std::string makeText(const char *sample, size_t size)
+{
+	std::string rv;
+	size_t sampleLength = strlen(sample);
+	while(rv.size() + sampleLength <= size)
+		rv += sample;
+	rv.resize(size, ' '); // without cutting a character in half
+	return rv;
+}
+
+static double measure(int impl, const std::string &text, size_t total)
+{
+	const uint8_t *bytes = (const uint8_t *)text.data();
+	size_t size = text.size();
+	size_t rounds = std::max(total / std::max(size, size_t(1)), size_t(1));
+	size_t valid = 0;
+
+	auto begin = std::chrono::steady_clock::now();
+	for(size_t r = 0; r < rounds; r++)
+	{
+		if(impl < 0)
+			valid += validBytewise(bytes, size);
+		else
+			valid += isValidUtf8(Utf8Implementation(impl), bytes, size);
+	}
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - begin;
+
+	if(valid != rounds)
+		printf("invalid?\n");
+
+	return double(rounds) * size / elapsed.count() / 1e9;
+}
+
+static void usage(const char *name)
+{
+	printf("usage: %s [-m megabytes] [-h]\n", name);
+	printf("  -m megabytes -- bytes to validate per measurement (default 1024)\n");
+	printf("  -h           -- show this help\n");
+}
+
+int main(int argc, char **argv)
+{
+	size_t megabytes = 1024;
+	int ch;
+
+	while((ch = getopt(argc, argv, "m:h")) != -1)
+	{
+		switch(ch)
+		{
+		case 'm':
+			megabytes = atol(optarg);
+			break;
+		case 'h':
+		default:
+			usage(argv[0]);
+			return 'h' == ch ? 0 : 1;
+		}
+	}
+
+	size_t total = megabytes * 1024 * 1024;
+	const size_t sizes[] = { 64, 1024, 65536 };
+	const struct { const char *name; const char *sample; } kinds[] = {
+		{ "ascii", "{\"id\":12345,\"name\":\"example\",\"tags\":[\"a\",\"b\"],\"ok\":true} " },
+		{ "latin", "Fran\xc3\xa7ois a \xc3\xa9t\xc3\xa9 \xc3\xa0 la f\xc3\xaate, tr\xc3\xa8s s\xc3\xbbr. " },
+		{ "cjk",   "\xe4\xb8\xad\xe6\x96\x87\xe6\xb5\x8b\xe8\xaf\x95\xe6\x96\x87\xe6\x9c\xac\xe3\x80\x82" },
+		{ "emoji", "ok \xf0\x9f\x98\x80\xf0\x9f\x8e\x89 \xf0\x9f\x91\x8d done " }
+	};
+	const char *names[] = { "scalar", "ssse3", "avx2" };
+
+	printf("%6s %8s %10s", "text", "size", "bytewise");
+	for(int impl = UTF8_SCALAR; impl <= UTF8_AVX2; impl++)
+		printf(" %10s", names[impl]);
+	printf("   (GB/s)\n");
+
+	for(const auto &kind : kinds)
+	{
+		for(size_t size : sizes)
+		{
+			std::string text = makeText(kind.sample, size);
+			printf("%6s %8lu %10.2f", kind.name, (unsigned long)size, measure(-1, text, total / 8)); // it's slow
+			for(int impl = UTF8_SCALAR; impl <= UTF8_AVX2; impl++)
+			{
+				if(isUtf8ImplementationSupported(Utf8Implementation(impl)))
+					printf(" %10.2f", measure(impl, text, total));
+				else
+					printf(" %10s", "-");
+			}
+			printf("\n");
+		}
+	}
+
+	return 0;
+}
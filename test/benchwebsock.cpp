@@ -0,0 +1,215 @@
+// End to end WebSocket echo benchmark over TCP loopback. A server RunLoop on its own thread
+// answers any number of connections from SimpleWebSocket clients on the main thread's RunLoop,
+// echoing each binary message back. Each client keeps a number of messages in flight until it
+// has sent its share. Reports messages per second and payload throughput in each direction.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "zenomt/PosixStreamPlatformAdapter.hpp"
+#include "zenomt/RunLoops.hpp"
+#include "zenomt/SimpleWebSocket.hpp"
+
+using namespace com::zenomt;
+using namespace com::zenomt::websock;
+
+static bool makeLoopbackPair(int *client, int *server)
+{
+	int listener = socket(AF_INET, SOCK_STREAM, 0);
+	struct sockaddr_in sin;
+	memset(&sin, 0, sizeof(sin));
+	sin.sin_family = AF_INET;
+	sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	socklen_t sinlen = sizeof(sin);
+	if( (listener < 0)
+	 or bind(listener, (struct sockaddr *)&sin, sizeof(sin))
+	 or listen(listener, 1)
+	 or getsockname(listener, (struct sockaddr *)&sin, &sinlen)
+	)
+		return false;
+
+	*client = socket(AF_INET, SOCK_STREAM, 0);
+	if(connect(*client, (struct sockaddr *)&sin, sizeof(sin)))
+		return false;
+	*server = accept(listener, nullptr, nullptr);
+	::close(listener);
+	return *server >= 0;
+}
+
+struct Connection {
+	std::shared_ptr<PosixStreamPlatformAdapter> m_adapter;
+	std::shared_ptr<SimpleWebSocket> m_ws;
+	size_t m_sent { 0 };
+	size_t m_received { 0 };
+};
+
+static std::shared_ptr<SimpleWebSocket> makeWebSocket(RunLoop *rl, int fd, std::shared_ptr<PosixStreamPlatformAdapter> *adapter)
+{
+	*adapter = share_ref(new PosixStreamPlatformAdapter(rl), false);
+	(*adapter)->setSocketFd(fd);
+	return share_ref(new SimpleWebSocket_OpenSSL(*adapter), false);
+}
+
+static void runServer(std::vector<int> fds)
+{
+	PreferredRunLoop rl;
+	std::vector<Connection> connections(fds.size());
+	size_t open = fds.size();
+
+	for(size_t x = 0; x < fds.size(); x++)
+	{
+		Connection &each = connections[x];
+		each.m_ws = makeWebSocket(&rl, fds[x], &each.m_adapter);
+		SimpleWebSocket *ws = each.m_ws.get();
+		each.m_ws->onBinaryMessage = [ws] (const uint8_t *bytes, size_t len) { ws->sendBinaryMessage(bytes, len); };
+		each.m_ws->onError = [&] { if(0 == --open) rl.stop(); };
+		each.m_ws->init();
+	}
+
+	rl.run();
+
+	for(auto it = connections.begin(); it != connections.end(); it++)
+	{
+		it->m_ws->close();
+		it->m_adapter->close();
+	}
+	rl.clear();
+}
+
+static void usage(const char *name)
+{
+	printf("usage: %s [-c connections] [-n messages] [-s bytes] [-p depth] [-h]\n", name);
+	printf("  -c connections -- concurrent client connections (default 4)\n");
+	printf("  -n messages    -- messages each connection sends (default 50000)\n");
+	printf("  -s bytes       -- message size (default 1024)\n");
+	printf("  -p depth       -- messages each connection keeps in flight (default 8)\n");
+	printf("  -h             -- show this help\n");
+}
+
+int main(int argc, char **argv)
+{
+	size_t numConnections = 4;
+	size_t numMessages = 50000;
+	size_t messageSize = 1024;
+	size_t depth = 8;
+	int ch;
+
+	while((ch = getopt(argc, argv, "c:n:s:p:h")) != -1)
+	{
+		switch(ch)
+		{
+		case 'c':
+			numConnections = atol(optarg);
+			break;
+		case 'n':
+			numMessages = atol(optarg);
+			break;
+		case 's':
+			messageSize = atol(optarg);
+			break;
+		case 'p':
+			depth = atol(optarg);
+			break;
+		case 'h':
+		default:
+			usage(argv[0]);
+			return 'h' == ch ? 0 : 1;
+		}
+	}
+
+	if((0 == numConnections) or (0 == numMessages) or (0 == depth))
+	{
+		usage(argv[0]);
+		return 1;
+	}
+
+	std::vector<int> clientFds, serverFds;
+	for(size_t x = 0; x < numConnections; x++)
+	{
+		int client, server;
+		if(not makeLoopbackPair(&client, &server))
+		{
+			perror("loopback");
+			return 1;
+		}
+		clientFds.push_back(client);
+		serverFds.push_back(server);
+	}
+
+	std::thread serverThread([=] { runServer(serverFds); });
+
+	PreferredRunLoop rl;
+	std::vector<Connection> connections(numConnections);
+	Bytes message(messageSize);
+	for(size_t x = 0; x < messageSize; x++)
+		message[x] = uint8_t(x * 31);
+	size_t opened = 0;
+	size_t finished = 0;
+	size_t failed = 0;
+	Time begin = 0;
+
+	auto sendMore = [&] (Connection &each) {
+		while((each.m_sent < numMessages) and (each.m_sent - each.m_received < depth))
+		{
+			each.m_ws->sendBinaryMessage(message);
+			each.m_sent++;
+		}
+	};
+
+	for(size_t x = 0; x < numConnections; x++)
+	{
+		Connection &each = connections[x];
+		each.m_ws = makeWebSocket(&rl, clientFds[x], &each.m_adapter);
+
+		each.m_ws->onOpen = [&] {
+			if(++opened < numConnections)
+				return;
+			begin = rl.getCurrentTimeNoCache(); // everyone starts together
+			for(auto it = connections.begin(); it != connections.end(); it++)
+				sendMore(*it);
+		};
+		each.m_ws->onBinaryMessage = [&] (const uint8_t *bytes, size_t len) {
+			if(len != messageSize)
+				failed++;
+			if(++each.m_received < numMessages)
+				sendMore(each);
+			else if(++finished == numConnections)
+				rl.stop();
+		};
+		each.m_ws->onError = [&] { failed++; rl.stop(); };
+		each.m_ws->initClient("localhost", "/echo");
+	}
+
+	rl.run();
+	double seconds = rl.getCurrentTimeNoCache() - begin;
+
+	for(auto it = connections.begin(); it != connections.end(); it++)
+	{
+		it->m_ws->close();
+		it->m_adapter->close();
+	}
+	rl.run(0.01); // let the shutdowns go out
+	rl.clear();
+	serverThread.join();
+
+	if(failed or (finished != numConnections))
+	{
+		printf("failed: %lu connections finished, %lu errors\n", (unsigned long)finished, (unsigned long)failed);
+		return 1;
+	}
+
+	double total = double(numConnections) * numMessages;
+	printf("%lu connections, %lu messages of %lu bytes each, depth %lu\n",
+		(unsigned long)numConnections, (unsigned long)numMessages, (unsigned long)messageSize, (unsigned long)depth);
+	printf("%.3f seconds, %.0f messages/s, %.1f MB/s each way\n",
+		seconds, total / seconds, total * messageSize / seconds / 1e6);
+
+	return 0;
+}
@@ -0,0 +1,161 @@
+// Benchmark PosixStreamPlatformAdapter throughput over a TCP loopback connection
+// with ordinary copying sends versus MSG_ZEROCOPY, for a range of write sizes, to
+// find the crossover above which zerocopy is worthwhile.
+//
+// Note that on loopback the kernel must copy zerocopy sends anyway (the receiver
+// would otherwise see the sender's pages), so "copied" completions are expected and
+// the numbers here show the bookkeeping overhead rather than the savings available
+// on a real NIC.
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "zenomt/PosixStreamPlatformAdapter.hpp"
+#include "zenomt/RunLoops.hpp"
+
+using namespace com::zenomt;
+
+static bool makeLoopbackPair(int *sender, int *receiver)
+{
+	int listener = socket(AF_INET, SOCK_STREAM, 0);
+	struct sockaddr_in sin;
+	memset(&sin, 0, sizeof(sin));
+	sin.sin_family = AF_INET;
+	sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	socklen_t sinlen = sizeof(sin);
+	if( (listener < 0)
+	 or bind(listener, (struct sockaddr *)&sin, sizeof(sin))
+	 or listen(listener, 1)
+	 or getsockname(listener, (struct sockaddr *)&sin, &sinlen)
+	)
+		return false;
+
+	*sender = socket(AF_INET, SOCK_STREAM, 0);
+	if(connect(*sender, (struct sockaddr *)&sin, sizeof(sin)))
+		return false;
+	*receiver = accept(listener, nullptr, nullptr);
+	::close(listener);
+	return *receiver >= 0;
+}
+
+struct Result {
+	double m_seconds;
+	PosixStreamPlatformAdapter::ZeroCopyStats m_stats;
+	bool m_zerocopy;
+};
+
+static bool runOnce(size_t writeSize, size_t total, bool zerocopy, Result &result)
+{
+	int sender, receiver;
+	if(not makeLoopbackPair(&sender, &receiver))
+	{
+		perror("loopback");
+		return false;
+	}
+
+	std::thread reader([receiver, total] {
+		std::vector<uint8_t> buf(1024 * 1024);
+		size_t count = 0;
+		ssize_t rv;
+		while((rv = ::read(receiver, buf.data(), buf.size())) > 0)
+			count += rv;
+		if(count != total)
+			printf("short read %lu != %lu\n", (unsigned long)count, (unsigned long)total);
+		::close(receiver);
+	});
+
+	PreferredRunLoop rl;
+	auto adapter = share_ref(new PosixStreamPlatformAdapter(&rl, 4096, 4 * writeSize), false);
+	adapter->setSocketFd(sender);
+	result.m_zerocopy = zerocopy and adapter->setZeroCopyThreshold(writeSize);
+
+	// a few distinct payloads, shared (not copied into the adapter) so zerocopy can pin them.
+	std::vector<std::shared_ptr<std::vector<uint8_t>>> payloads;
+	for(int x = 0; x < 4; x++)
+		payloads.push_back(std::make_shared<std::vector<uint8_t>>(writeSize, uint8_t('a' + x)));
+
+	size_t queued = 0;
+	Time begin = rl.getCurrentTimeNoCache();
+
+	adapter->notifyWhenWritable([&] {
+		auto &payload = payloads[(queued / writeSize) % payloads.size()];
+		size_t len = std::min(writeSize, total - queued);
+		adapter->writeSharedBytes(payload, payload->data(), len);
+		queued += len;
+		if(queued < total)
+			return true;
+		adapter->onClientClosed();
+		return false;
+	});
+
+	rl.scheduleRel(0, 0.001)->action = [&] (const std::shared_ptr<Timer> &sender, Time now) {
+		if((queued == total) and (0 == adapter->getOutputQueueSize()) and (0 == adapter->getPinnedSegmentCount()))
+			rl.stop();
+	};
+
+	rl.run();
+	result.m_seconds = rl.getCurrentTimeNoCache() - begin;
+	result.m_stats = adapter->getZeroCopyStats();
+
+	adapter->close();
+	rl.clear();
+	reader.join();
+
+	return true;
+}
+
+static void usage(const char *name)
+{
+	printf("usage: %s [-m megabytes] [-h]\n", name);
+	printf("  -m megabytes -- bytes to send per run (default 1024)\n");
+	printf("  -h           -- show this help\n");
+}
+
+int main(int argc, char **argv)
+{
+	size_t megabytes = 1024;
+	int ch;
+
+	while((ch = getopt(argc, argv, "m:h")) != -1)
+	{
+		switch(ch)
+		{
+		case 'm':
+			megabytes = atol(optarg);
+			break;
+		case 'h':
+		default:
+			usage(argv[0]);
+			return 'h' == ch ? 0 : 1;
+		}
+	}
+
+	size_t total = megabytes * 1024 * 1024;
+	const size_t sizes[] = { 4096, 16384, 65536, 262144, 1048576 };
+
+	printf("%10s %12s %12s %8s %10s\n", "write", "copy MB/s", "zcopy MB/s", "ratio", "zc copied");
+	for(size_t each : sizes)
+	{
+		Result copy, zc;
+		if(not (runOnce(each, total, false, copy) and runOnce(each, total, true, zc)))
+			return 1;
+
+		double copyRate = megabytes / copy.m_seconds;
+		double zcRate = megabytes / zc.m_seconds;
+		if(not zc.m_zerocopy)
+			printf("%10lu %12.1f %12s\n", (unsigned long)each, copyRate, "unsupported");
+		else
+			printf("%10lu %12.1f %12.1f %7.2fx %4lu/%-5lu\n", (unsigned long)each, copyRate, zcRate, zcRate / copyRate,
+				(unsigned long)zc.m_stats.m_copied, (unsigned long)zc.m_stats.m_completions);
+	}
+
+	return 0;
+}
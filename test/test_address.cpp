@@ -1,5 +1,9 @@
 #include <gtest/gtest.h>
+#include <cstdio>
 #include <cstring>
+
+#include <arpa/inet.h>
+
 #include "zenomt/Address.hpp"
 
 using namespace com::zenomt;
@@ -97,3 +101,124 @@ TEST(AddressTest, Inequality) {
 	EXPECT_FALSE(addr1 == addr2);
 }
 
+
+static std::string referencePresentation(const Address &addr, bool withPort) {
+	// what toPresentation() answered when it used inet_ntop(3) and snprintf(3)
+	char buf[INET6_ADDRSTRLEN];
+	char dst[Address::MAX_PRESENTATION_LENGTH] = { 0 };
+	if(not inet_ntop(addr.getFamily(), addr.getIPAddressPtr(), buf, sizeof(buf)))
+		return std::string();
+	if(not withPort)
+		snprintf(dst, sizeof(dst), "%s", buf);
+	else if(AF_INET == addr.getFamily())
+		snprintf(dst, sizeof(dst), "%s:%u", buf, addr.getPort());
+	else
+		snprintf(dst, sizeof(dst), "[%s]:%u", buf, addr.getPort());
+	return std::string(dst);
+}
+
+TEST(AddressTest, PresentationMatchesInetNtop) {
+	std::vector<std::vector<uint8_t>> ips = {
+		{ 0, 0, 0, 0 },
+		{ 255, 255, 255, 255 },
+		{ 10, 0, 100, 9 },
+		{ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+		{ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1 },
+		{ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 2, 3, 4 },
+		{ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xff, 0xff, 1, 2, 3, 4 },
+		{ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xff, 0xff, 0, 0, 0, 0 },
+		{ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xff, 0xfe, 1, 2, 3, 4 },
+		{ 0x20, 0x01, 0x0d, 0xb8, 0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 1 },
+		{ 0x20, 0x01, 0x0d, 0xb8, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 1 },
+		{ 0x20, 0x01, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+		{ 0xfe, 0x80, 0, 0, 0, 0, 0, 0, 0x0a, 0xbc, 0x0d, 0xef, 0x00, 0x10, 0xff, 0xff },
+		{ 0x20, 0x01, 0x0d, 0xb8, 0, 1, 0, 2, 0, 3, 0, 4, 0, 5, 0, 6 },
+	};
+
+	unsigned seed = 1;
+	for(int x = 0; x < 20000; x++)
+	{
+		std::vector<uint8_t> ip(x % 2 ? 16 : 4);
+		for(auto it = ip.begin(); it != ip.end(); it++)
+		{
+			seed = seed * 1103515245 + 12345;
+			unsigned r = (seed >> 16) & 0xff;
+			*it = (r < 128) ? 0 : r; // lots of zero words
+		}
+		ips.push_back(ip);
+	}
+
+	unsigned port = 0;
+	for(auto it = ips.begin(); it != ips.end(); it++)
+	{
+		Address addr;
+		ASSERT_TRUE(addr.setIPAddress(it->data(), it->size()));
+		addr.setPort(port);
+		port = (port * 7 + 13) % 65536;
+
+		for(int withPort = 0; withPort < 2; withPort++)
+		{
+			std::string expected = referencePresentation(addr, withPort);
+			ASSERT_EQ(addr.toPresentation(withPort), expected);
+
+			Address parsed;
+			ASSERT_TRUE(parsed.setFromPresentation(expected.c_str(), withPort)) << expected;
+			EXPECT_EQ(parsed.getFamily(), addr.getFamily()) << expected;
+			EXPECT_EQ(0, memcmp(parsed.getIPAddressPtr(), addr.getIPAddressPtr(), addr.getIPAddressLength())) << expected;
+			if(withPort)
+			{
+				EXPECT_EQ(parsed.getPort(), addr.getPort()) << expected;
+			}
+		}
+	}
+}
+
+TEST(AddressTest, PresentationOfEmptyAddress) {
+	Address addr;
+	EXPECT_EQ(addr.toPresentation(), "");
+}
+
+TEST(AddressTest, ParsePresentation) {
+	struct { const char *src; bool withPort; bool valid; const char *canonical; } cases[] = {
+		{ "2001:470:8192::2", false, true, "2001:470:8192::2" },
+		{ "[2001:470:8192::2]", false, true, "2001:470:8192::2" },
+		{ "[::127.0.0.1]", false, true, "::127.0.0.1" },
+		{ "[ffff:ffff:FFFF:ffff:ffff:ffff:255.255.255.255]", false, true, "ffff:ffff:ffff:ffff:ffff:ffff:ffff:ffff" },
+		{ "0:0:0:0:0:0:0:1", false, true, "::1" },
+		{ "10.10.10.255", false, true, "10.10.10.255" },
+		{ "::gh2", false, false, nullptr },
+		{ "1.2.3.4:5678", false, false, nullptr },
+		{ "01.2.3.4", false, false, nullptr },
+		{ "1.2.3.256", false, false, nullptr },
+		{ "1.2.3", false, false, nullptr },
+		{ "1:2:3:4:5:6:7:8:9", false, false, nullptr },
+		{ "1::2::3", false, false, nullptr },
+		{ ":::", false, false, nullptr },
+		{ "1:2:3:4:5:6:7::8", false, false, nullptr },
+		{ "12345::", false, false, nullptr },
+		{ "not an ip address", false, false, nullptr },
+		{ "10.1.1.1:12345", true, true, "10.1.1.1:12345" },
+		{ "[10.1.2.3]:12345", true, true, "10.1.2.3:12345" },
+		{ "[::]:54321", true, true, "[::]:54321" },
+		{ "[2001::1]:12345", true, true, "[2001::1]:12345" },
+		{ "[ffff:ffff:FFFF:ffff:ffff:ffff:255.255.255.255]:55555", true, true, "[ffff:ffff:ffff:ffff:ffff:ffff:ffff:ffff]:55555" },
+		{ "10.1.1.1:0080", true, true, "10.1.1.1:80" },
+		{ "10.1.1.1: 80", true, true, "10.1.1.1:80" }, // historically accepted by sscanf
+		{ "[::]", true, false, nullptr },
+		{ "10.1.1.11", true, false, nullptr },
+		{ "not an ip address", true, false, nullptr },
+		{ ":1234", true, false, nullptr },
+		{ "::1234", true, false, nullptr },
+		{ "::12345", true, false, nullptr },
+	};
+
+	for(size_t x = 0; x < sizeof(cases) / sizeof(cases[0]); x++)
+	{
+		Address addr;
+		EXPECT_EQ(addr.setFromPresentation(cases[x].src, cases[x].withPort), cases[x].valid) << cases[x].src;
+		if(cases[x].valid)
+		{
+			EXPECT_EQ(addr.toPresentation(cases[x].withPort), cases[x].canonical) << cases[x].src;
+		}
+	}
+}
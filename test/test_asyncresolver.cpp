@@ -0,0 +1,157 @@
+#include <gtest/gtest.h>
+#include <atomic>
+#include <cstring>
+#include <chrono>
+#include <thread>
+
+#include <netdb.h>
+
+#include "zenomt/AsyncResolver.hpp"
+#include "zenomt/RunLoops.hpp"
+
+using namespace com::zenomt;
+using namespace com::zenomt::rtmfp;
+
+class AsyncResolverTest : public ::testing::Test {
+protected:
+	void SetUp() override {
+		runLoop = std::make_shared<PreferredRunLoop>();
+		resolver = share_ref(new AsyncResolver(runLoop.get()), false);
+		lookups = std::make_shared<std::atomic<int>>(0);
+
+		auto counter = lookups;
+		resolver->setLookupFunction([counter] (const char *hostname, const char *servname, int *err, int ai_flags, int ai_family, int ai_protocol) {
+			(*counter)++;
+			std::this_thread::sleep_for(std::chrono::milliseconds(20));
+
+			std::vector<Address> rv;
+			if(hostname and (0 == strcmp(hostname, "stub.example")))
+			{
+				Address addr;
+				addr.setFromPresentation("192.0.2.1:1935");
+				rv.push_back(addr);
+				*err = 0;
+			}
+			else
+				*err = EAI_NONAME;
+			return rv;
+		});
+	}
+
+	void TearDown() override {
+		resolver->close();
+		runLoop->clear();
+	}
+
+	std::shared_ptr<RunLoop> runLoop;
+	std::shared_ptr<AsyncResolver> resolver;
+	std::shared_ptr<std::atomic<int>> lookups;
+};
+
+TEST_F(AsyncResolverTest, StubLookup) {
+	std::vector<Address> result;
+	int result_err = -1;
+
+	resolver->resolve("stub.example", "1935", [&] (const std::vector<Address> &addresses, int err) {
+		result = addresses;
+		result_err = err;
+		runLoop->stop();
+	});
+
+	runLoop->run(5.0);
+
+	EXPECT_EQ(result_err, 0);
+	ASSERT_EQ(result.size(), 1u);
+	EXPECT_EQ(result[0].toPresentation(), "192.0.2.1:1935");
+}
+
+TEST_F(AsyncResolverTest, CoalescesConcurrentQueries) {
+	int answers = 0;
+	auto onresult = [&] (const std::vector<Address> &addresses, int err) {
+		EXPECT_EQ(addresses.size(), 1u);
+		if(++answers == 3)
+			runLoop->stop();
+	};
+
+	resolver->resolve("stub.example", "1935", onresult);
+	resolver->resolve("stub.example", "1935", onresult);
+	resolver->resolve("stub.example", "1935", onresult);
+
+	runLoop->run(5.0);
+
+	EXPECT_EQ(answers, 3);
+	EXPECT_EQ(*lookups, 1);
+}
+
+TEST_F(AsyncResolverTest, CachesPositiveAndNegative) {
+	int answers = 0;
+	int failures = 0;
+
+	resolver->resolve("stub.example", "1935", [&] (const std::vector<Address> &addresses, int err) {
+		answers++;
+		resolver->resolve("nothere.example", "1935", [&] (const std::vector<Address> &addresses, int err) {
+			EXPECT_NE(err, 0);
+			failures++;
+			runLoop->stop();
+		});
+	});
+	runLoop->run(5.0);
+
+	EXPECT_EQ(*lookups, 2);
+	EXPECT_EQ(resolver->getCacheSize(), 2u);
+
+	resolver->resolve("stub.example", "1935", [&] (const std::vector<Address> &addresses, int err) { answers++; });
+	resolver->resolve("nothere.example", "1935", [&] (const std::vector<Address> &addresses, int err) {
+		failures++;
+		runLoop->stop();
+	});
+	runLoop->run(5.0);
+
+	EXPECT_EQ(answers, 2);
+	EXPECT_EQ(failures, 2);
+	EXPECT_EQ(*lookups, 2); // both answered from cache
+}
+
+TEST_F(AsyncResolverTest, CacheExpires) {
+	resolver->setCacheTTL(0.05, 0.05);
+
+	auto onresult = [&] (const std::vector<Address> &addresses, int err) { runLoop->stop(); };
+
+	resolver->resolve("stub.example", "1935", onresult);
+	runLoop->run(5.0);
+	EXPECT_EQ(*lookups, 1);
+
+	runLoop->run(0.1);
+
+	resolver->resolve("stub.example", "1935", onresult);
+	runLoop->run(5.0);
+	EXPECT_EQ(*lookups, 2);
+}
+
+TEST_F(AsyncResolverTest, NoCallbacksAfterClose) {
+	bool called = false;
+	resolver->resolve("stub.example", "1935", [&] (const std::vector<Address> &addresses, int err) { called = true; });
+	resolver->close();
+	runLoop->run(0.1);
+	EXPECT_FALSE(called);
+}
+
+TEST_F(AsyncResolverTest, LocalhostFromHosts) {
+	resolver->setLookupFunction([] (const char *hostname, const char *servname, int *err, int ai_flags, int ai_family, int ai_protocol) {
+		return Address::lookup(hostname, servname, err, ai_flags, ai_family, ai_protocol);
+	});
+
+	std::vector<Address> result;
+	int result_err = -1;
+	resolver->resolve("localhost", "1935", [&] (const std::vector<Address> &addresses, int err) {
+		result = addresses;
+		result_err = err;
+		runLoop->stop();
+	});
+	runLoop->run(10.0);
+
+	EXPECT_EQ(result_err, 0);
+	ASSERT_FALSE(result.empty());
+	for(auto it = result.begin(); it != result.end(); it++)
+		EXPECT_EQ(it->getPort(), 1935u);
+}
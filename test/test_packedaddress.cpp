@@ -0,0 +1,115 @@
+#include <gtest/gtest.h>
+#include <cstring>
+#include <set>
+#include <unordered_set>
+#include "zenomt/PackedAddress.hpp"
+
+using namespace com::zenomt;
+using namespace com::zenomt::rtmfp;
+
+static Address makeAddress(const char *presentation, Address::Origin origin = Address::ORIGIN_UNKNOWN) {
+	Address addr;
+	EXPECT_TRUE(addr.setFromPresentation(presentation));
+	addr.setOrigin(origin);
+	return addr;
+}
+
+TEST(PackedAddressTest, Size) {
+	EXPECT_EQ(sizeof(PackedAddress), 20u);
+}
+
+TEST(PackedAddressTest, DefaultIsEmpty) {
+	PackedAddress packed;
+	EXPECT_EQ(packed.getFamily(), 0);
+	EXPECT_EQ(packed.getPort(), 0u);
+
+	Address::in_sockaddr tmp;
+	EXPECT_EQ(packed.getSockaddr(&tmp.s), 0u);
+}
+
+TEST(PackedAddressTest, IPv4RoundTrip) {
+	Address addr = makeAddress("192.168.1.2:1935", Address::ORIGIN_OBSERVED);
+	PackedAddress packed(addr);
+
+	EXPECT_EQ(packed.getFamily(), AF_INET);
+	EXPECT_EQ(packed.getPort(), 1935u);
+	EXPECT_EQ(packed.getOrigin(), Address::ORIGIN_OBSERVED);
+
+	const uint8_t mapped[16] = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xff, 0xff, 192, 168, 1, 2 };
+	EXPECT_EQ(memcmp(packed.getMappedIPAddressPtr(), mapped, 16), 0);
+
+	Address back = packed.getAddress();
+	EXPECT_EQ(back, addr);
+	EXPECT_EQ(back.getFamily(), AF_INET);
+	EXPECT_EQ(back.getOrigin(), Address::ORIGIN_OBSERVED);
+	EXPECT_EQ(back.toPresentation(), "192.168.1.2:1935");
+}
+
+TEST(PackedAddressTest, IPv6RoundTrip) {
+	Address addr = makeAddress("[2001:db8::1]:65535", Address::ORIGIN_RELAY);
+	PackedAddress packed(addr.getSockaddr(), addr.getOrigin());
+
+	EXPECT_EQ(packed.getFamily(), AF_INET6);
+	EXPECT_EQ(packed.getPort(), 65535u);
+
+	Address::in_sockaddr tmp;
+	EXPECT_EQ(packed.getSockaddr(&tmp.s), sizeof(struct sockaddr_in6));
+	EXPECT_EQ(Address(&tmp.s), addr);
+	EXPECT_EQ(packed.getAddress().getOrigin(), Address::ORIGIN_RELAY);
+}
+
+TEST(PackedAddressTest, EqualityIgnoresOrigin) {
+	PackedAddress a(makeAddress("10.0.0.1:1", Address::ORIGIN_REPORTED));
+	PackedAddress b(makeAddress("10.0.0.1:1", Address::ORIGIN_OBSERVED));
+	PackedAddress c(makeAddress("10.0.0.1:2"));
+
+	EXPECT_TRUE(a == b);
+	EXPECT_EQ(a.hash(), b.hash());
+	EXPECT_TRUE(a != c);
+}
+
+TEST(PackedAddressTest, MappedIPv6IsNotIPv4) {
+	PackedAddress v4(makeAddress("10.0.0.1:1"));
+	PackedAddress v6(makeAddress("[::ffff:10.0.0.1]:1"));
+
+	EXPECT_FALSE(v4 == v6);
+	EXPECT_TRUE(v4 < v6);
+	EXPECT_FALSE(v6 < v4);
+}
+
+TEST(PackedAddressTest, OrderMatchesAddress) {
+	const char *presentations[] = {
+		"10.0.0.1:2", "10.0.0.1:1", "9.255.255.255:65535", "10.0.1.0:0", "255.0.0.0:1",
+		"[2001:db8::1]:1", "[::1]:80", "[2001:db8::1]:0", "[fe80::1]:5", "[::]:0"
+	};
+	const size_t count = sizeof(presentations) / sizeof(presentations[0]);
+
+	for(size_t i = 0; i < count; i++)
+		for(size_t j = 0; j < count; j++)
+		{
+			Address a = makeAddress(presentations[i]);
+			Address b = makeAddress(presentations[j]);
+			EXPECT_EQ(PackedAddress(a) < PackedAddress(b), a < b) << presentations[i] << " " << presentations[j];
+			EXPECT_EQ(PackedAddress(a) == PackedAddress(b), a == b) << presentations[i] << " " << presentations[j];
+		}
+}
+
+TEST(PackedAddressTest, Containers) {
+	std::set<PackedAddress> ordered;
+	std::unordered_set<PackedAddress> hashed;
+
+	for(int i = 0; i < 1000; i++)
+	{
+		Address addr;
+		uint8_t ip[4] = { 10, 0, uint8_t(i >> 8), uint8_t(i) };
+		addr.setIPAddress(ip, sizeof(ip));
+		addr.setPort(1000 + (i % 7));
+		ordered.insert(addr);
+		hashed.insert(addr);
+		hashed.insert(addr);
+	}
+
+	EXPECT_EQ(ordered.size(), 1000u);
+	EXPECT_EQ(hashed.size(), 1000u);
+	EXPECT_TRUE(hashed.count(PackedAddress(makeAddress("10.0.3.231:1005")))); // 999 = 0x3e7, 999 % 7 = 5
+}
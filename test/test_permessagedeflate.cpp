@@ -0,0 +1,298 @@
+#include <gtest/gtest.h>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <zlib.h>
+
+#include "zenomt/PerMessageDeflate.hpp"
+
+using namespace com::zenomt;
+using namespace com::zenomt::websock;
+
+namespace {
+
+const uint8_t TAIL[4] = { 0x00, 0x00, 0xff, 0xff };
+
+// the client's side of the connection, straight from zlib.
+class Peer {
+public:
+	Peer(int windowBits = 15)
+	{
+		memset(&m_deflater, 0, sizeof(m_deflater));
+		memset(&m_inflater, 0, sizeof(m_inflater));
+		deflateInit2(&m_deflater, 6, Z_DEFLATED, -windowBits, 8, Z_DEFAULT_STRATEGY);
+		inflateInit2(&m_inflater, -15);
+	}
+
+	~Peer()
+	{
+		deflateEnd(&m_deflater);
+		inflateEnd(&m_inflater);
+	}
+
+	Bytes compress(const std::string &message)
+	{
+		if(m_noContextTakeover)
+			deflateReset(&m_deflater);
+
+		Bytes rv(message.size() + 64);
+		m_deflater.next_in = (Bytef *)message.data();
+		m_deflater.avail_in = message.size();
+		m_deflater.next_out = rv.data();
+		m_deflater.avail_out = rv.size();
+		EXPECT_EQ(Z_OK, deflate(&m_deflater, Z_SYNC_FLUSH));
+		rv.resize(rv.size() - m_deflater.avail_out);
+		EXPECT_EQ(0, memcmp(rv.data() + rv.size() - 4, TAIL, 4));
+		rv.resize(rv.size() - 4);
+		return rv;
+	}
+
+	std::string decompress(Bytes message)
+	{
+		message.insert(message.end(), TAIL, TAIL + 4);
+		std::string rv(1 << 20, 0);
+		m_inflater.next_in = message.data();
+		m_inflater.avail_in = message.size();
+		m_inflater.next_out = (Bytef *)&rv[0];
+		m_inflater.avail_out = rv.size();
+		EXPECT_EQ(Z_OK, inflate(&m_inflater, Z_SYNC_FLUSH));
+		rv.resize(rv.size() - m_inflater.avail_out);
+		return rv;
+	}
+
+	z_stream m_deflater;
+	z_stream m_inflater;
+	bool m_noContextTakeover { false };
+};
+
+std::string jsonish(int n)
+{
+	std::string rv = "[";
+	for(int x = 0; x < n; x++)
+		rv += "{\"id\":" + std::to_string(x) + ",\"name\":\"item\",\"tags\":[\"a\",\"b\"],\"ok\":true},";
+	rv += "{}]";
+	return rv;
+}
+
+}
+
+TEST(PerMessageDeflateTest, NegotiateDefaults) {
+	auto pmd = share_ref(new PerMessageDeflate(DeflateOptions()), false);
+	EXPECT_EQ(pmd->negotiate("permessage-deflate; client_max_window_bits"),
+		"permessage-deflate; server_no_context_takeover; client_no_context_takeover");
+	EXPECT_EQ(pmd->getServerWindowBits(), 15);
+	EXPECT_EQ(pmd->getClientWindowBits(), 15);
+	EXPECT_TRUE(pmd->isServerNoContextTakeover());
+	EXPECT_TRUE(pmd->isClientNoContextTakeover());
+}
+
+TEST(PerMessageDeflateTest, NegotiateWindowBits) {
+	DeflateOptions options;
+	options.m_serverMaxWindowBits = 12;
+	options.m_clientMaxWindowBits = 10;
+	options.m_serverNoContextTakeover = false;
+	options.m_clientNoContextTakeover = false;
+	auto pmd = share_ref(new PerMessageDeflate(options), false);
+
+	EXPECT_EQ(pmd->negotiate("permessage-deflate; server_max_window_bits=\"11\"; client_max_window_bits"),
+		"permessage-deflate; server_max_window_bits=11; client_max_window_bits=10");
+	EXPECT_EQ(pmd->getServerWindowBits(), 11);
+	EXPECT_EQ(pmd->getClientWindowBits(), 10);
+
+	// the client didn't say it could limit its window, so we can't ask it to.
+	EXPECT_EQ(pmd->negotiate("permessage-deflate"), "permessage-deflate; server_max_window_bits=12");
+	EXPECT_EQ(pmd->getClientWindowBits(), 15);
+
+	// and if it says it will, we know.
+	EXPECT_EQ(pmd->negotiate("permessage-deflate; client_no_context_takeover"),
+		"permessage-deflate; client_no_context_takeover; server_max_window_bits=12");
+}
+
+TEST(PerMessageDeflateTest, NegotiateSkipsUnacceptableOffers) {
+	auto pmd = share_ref(new PerMessageDeflate(DeflateOptions()), false);
+	EXPECT_EQ(pmd->negotiate(""), "");
+	EXPECT_EQ(pmd->negotiate("x-webkit-deflate-frame"), "");
+	EXPECT_EQ(pmd->negotiate("permessage-deflate; server_max_window_bits=8"), "");
+	EXPECT_EQ(pmd->negotiate("permessage-deflate; server_max_window_bits=16"), "");
+	EXPECT_EQ(pmd->negotiate("permessage-deflate; server_no_context_takeover; server_no_context_takeover"), "");
+	EXPECT_EQ(pmd->negotiate("permessage-deflate; mystery=1, permessage-deflate; server_max_window_bits=10"),
+		"permessage-deflate; server_no_context_takeover; client_no_context_takeover; server_max_window_bits=10");
+}
+
+TEST(PerMessageDeflateTest, MemoryCapShrinksOrDeclines) {
+	DeflateOptions options;
+	options.m_maxMemory = PerMessageDeflate::deflateMemory(10, 8) + PerMessageDeflate::inflateMemory(15);
+	auto pmd = share_ref(new PerMessageDeflate(options), false);
+	EXPECT_NE(pmd->negotiate("permessage-deflate"), "");
+	EXPECT_EQ(pmd->getServerWindowBits(), 10);
+	EXPECT_EQ(pmd->getClientWindowBits(), 15);
+
+	// the client's window can only shrink if it allows.
+	options.m_maxMemory = PerMessageDeflate::deflateMemory(9, 8) + PerMessageDeflate::inflateMemory(12);
+	pmd = share_ref(new PerMessageDeflate(options), false);
+	EXPECT_EQ(pmd->negotiate("permessage-deflate; client_max_window_bits"),
+		"permessage-deflate; server_no_context_takeover; client_no_context_takeover; server_max_window_bits=9; client_max_window_bits=12");
+	EXPECT_EQ(pmd->getServerWindowBits(), 9);
+	EXPECT_EQ(pmd->getClientWindowBits(), 12);
+
+	options.m_maxMemory = 1000;
+	pmd = share_ref(new PerMessageDeflate(options), false);
+	EXPECT_EQ(pmd->negotiate("permessage-deflate; client_max_window_bits"), "");
+}
+
+TEST(PerMessageDeflateTest, RoundTripWithPeer) {
+	const bool takeovers[] = { true, false };
+	for(bool noContextTakeover : takeovers)
+	{
+		DeflateOptions options;
+		options.m_serverNoContextTakeover = noContextTakeover;
+		options.m_clientNoContextTakeover = noContextTakeover;
+		auto pmd = share_ref(new PerMessageDeflate(options), false);
+		ASSERT_NE(pmd->negotiate("permessage-deflate"), "");
+
+		Peer peer;
+		peer.m_noContextTakeover = noContextTakeover;
+		for(int x = 0; x < 5; x++)
+		{
+			std::string message = jsonish(50 + x);
+			Bytes compressed, decompressed;
+
+			ASSERT_TRUE(pmd->compress((const uint8_t *)message.data(), message.size(), compressed));
+			EXPECT_LT(compressed.size() * 5, message.size());
+			EXPECT_EQ(peer.decompress(compressed), message);
+
+			Bytes fromPeer = peer.compress(message);
+			ASSERT_TRUE(pmd->decompress(fromPeer.data(), fromPeer.size(), decompressed, 1 << 20));
+			EXPECT_EQ(std::string(decompressed.begin(), decompressed.end()), message);
+		}
+	}
+}
+
+TEST(PerMessageDeflateTest, ContextTakeoverCompressesRepeatsBetter) {
+	DeflateOptions options;
+	options.m_serverNoContextTakeover = false;
+	auto pmd = share_ref(new PerMessageDeflate(options), false);
+	ASSERT_NE(pmd->negotiate("permessage-deflate"), "");
+
+	std::string message = jsonish(20);
+	Bytes first, second;
+	ASSERT_TRUE(pmd->compress((const uint8_t *)message.data(), message.size(), first));
+	ASSERT_TRUE(pmd->compress((const uint8_t *)message.data(), message.size(), second));
+	EXPECT_LT(second.size() * 4, first.size());
+	EXPECT_GT(pmd->getMemoryInUse(), 0u); // the context stays
+}
+
+TEST(PerMessageDeflateTest, NoContextTakeoverHoldsNoStateBetweenMessages) {
+	auto pool = share_ref(new DeflatePool(), false);
+	auto pmd = share_ref(new PerMessageDeflate(DeflateOptions(), pool), false);
+	ASSERT_NE(pmd->negotiate("permessage-deflate"), "");
+
+	Peer peer;
+	std::string message = jsonish(30);
+	Bytes compressed, decompressed;
+	ASSERT_TRUE(pmd->compress((const uint8_t *)message.data(), message.size(), compressed));
+	Bytes fromPeer = peer.compress(message);
+	ASSERT_TRUE(pmd->decompress(fromPeer.data(), fromPeer.size(), decompressed, 1 << 20));
+
+	EXPECT_EQ(pmd->getMemoryInUse(), 0u);
+	EXPECT_EQ(pool->getIdleCount(), 2u);
+
+	// another connection re-uses them.
+	auto other = share_ref(new PerMessageDeflate(DeflateOptions(), pool), false);
+	ASSERT_NE(other->negotiate("permessage-deflate"), "");
+	ASSERT_TRUE(other->compress((const uint8_t *)message.data(), message.size(), compressed));
+	EXPECT_EQ(peer.decompress(compressed), message);
+	EXPECT_EQ(pool->getIdleCount(), 2u);
+}
+
+TEST(PerMessageDeflateTest, SmallOrIncompressibleSentAsIs) {
+	auto pmd = share_ref(new PerMessageDeflate(DeflateOptions()), false);
+	ASSERT_NE(pmd->negotiate("permessage-deflate"), "");
+	Bytes dst;
+
+	EXPECT_FALSE(pmd->compress((const uint8_t *)"tiny", 4, dst));
+
+	Bytes noise(2000);
+	uint32_t state = 12345;
+	for(auto &each : noise)
+	{
+		state = state * 1103515245 + 12345;
+		each = uint8_t(state >> 16);
+	}
+	EXPECT_FALSE(pmd->compress(noise.data(), noise.size(), dst));
+}
+
+TEST(PerMessageDeflateTest, DecompressRefusesTooLongAndInvalid) {
+	auto pmd = share_ref(new PerMessageDeflate(DeflateOptions()), false);
+	ASSERT_NE(pmd->negotiate("permessage-deflate"), "");
+	Peer peer;
+	Bytes dst;
+
+	Bytes bomb = peer.compress(std::string(100000, 'z'));
+	EXPECT_FALSE(pmd->decompress(bomb.data(), bomb.size(), dst, 65536));
+	EXPECT_LE(dst.size(), 65537u);
+
+	const uint8_t garbage[] = { 0xff, 0xff, 0xff, 0xff, 0x12, 0x34 };
+	EXPECT_FALSE(pmd->decompress(garbage, sizeof(garbage), dst, 65536));
+}
+
+TEST(PerMessageDeflateTest, ClientOffersAndAccepts) {
+	DeflateOptions options;
+	options.m_serverMaxWindowBits = 12;
+	options.m_clientNoContextTakeover = false;
+	auto pmd = share_ref(new PerMessageDeflate(options), false);
+	EXPECT_EQ(pmd->offer(), "permessage-deflate; client_max_window_bits; server_max_window_bits=12; server_no_context_takeover");
+
+	EXPECT_FALSE(pmd->accept("permessage-deflate; server_max_window_bits=12")); // we asked for no context takeover
+	EXPECT_FALSE(pmd->accept("permessage-deflate; server_no_context_takeover")); // and a window limit
+	EXPECT_FALSE(pmd->accept("permessage-deflate; server_no_context_takeover; server_max_window_bits=13"));
+	EXPECT_FALSE(pmd->accept("permessage-deflate; server_no_context_takeover; server_max_window_bits=12; client_max_window_bits=8"));
+	EXPECT_FALSE(pmd->accept("permessage-deflate; server_no_context_takeover; server_max_window_bits=12; mystery"));
+	EXPECT_FALSE(pmd->accept("x-webkit-deflate-frame"));
+
+	EXPECT_TRUE(pmd->accept("permessage-deflate; server_no_context_takeover; server_max_window_bits=10; client_max_window_bits=11"));
+	EXPECT_EQ(pmd->getServerWindowBits(), 10);
+	EXPECT_EQ(pmd->getClientWindowBits(), 11);
+	EXPECT_TRUE(pmd->isServerNoContextTakeover());
+	EXPECT_FALSE(pmd->isClientNoContextTakeover());
+
+	auto server = share_ref(new PerMessageDeflate(DeflateOptions()), false);
+	EXPECT_FALSE(server->accept("permessage-deflate")); // without an offer
+}
+
+TEST(PerMessageDeflateTest, ClientAndServerRoundTrip) {
+	DeflateOptions clientOptions;
+	clientOptions.m_serverNoContextTakeover = false;
+	clientOptions.m_clientNoContextTakeover = false;
+	clientOptions.m_clientMaxWindowBits = 11;
+	auto client = share_ref(new PerMessageDeflate(clientOptions), false);
+
+	DeflateOptions serverOptions;
+	serverOptions.m_serverNoContextTakeover = false;
+	serverOptions.m_clientNoContextTakeover = false;
+	serverOptions.m_serverMaxWindowBits = 10;
+	auto server = share_ref(new PerMessageDeflate(serverOptions), false);
+
+	std::string response = server->negotiate(client->offer());
+	ASSERT_NE(response, "");
+	ASSERT_TRUE(client->accept(response));
+	EXPECT_EQ(client->getServerWindowBits(), 10);
+	EXPECT_EQ(server->getServerWindowBits(), 10);
+	EXPECT_EQ(client->getClientWindowBits(), 11);
+	EXPECT_EQ(server->getClientWindowBits(), 11);
+
+	for(int x = 0; x < 5; x++)
+	{
+		std::string message = jsonish(40 + x);
+		Bytes compressed, decompressed;
+
+		ASSERT_TRUE(client->compress((const uint8_t *)message.data(), message.size(), compressed));
+		ASSERT_TRUE(server->decompress(compressed.data(), compressed.size(), decompressed, 1 << 20));
+		EXPECT_EQ(std::string(decompressed.begin(), decompressed.end()), message);
+
+		ASSERT_TRUE(server->compress((const uint8_t *)message.data(), message.size(), compressed));
+		ASSERT_TRUE(client->decompress(compressed.data(), compressed.size(), decompressed, 1 << 20));
+		EXPECT_EQ(std::string(decompressed.begin(), decompressed.end()), message);
+	}
+}
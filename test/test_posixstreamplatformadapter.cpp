@@ -0,0 +1,1007 @@
+#include <gtest/gtest.h>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include "zenomt/PosixStreamPlatformAdapter.hpp"
+#include "zenomt/RunLoops.hpp"
+
+using namespace com::zenomt;
+
+static bool makeLoopbackTCPPair(int *client, int *server)
+{
+	int listener = socket(AF_INET, SOCK_STREAM, 0);
+	struct sockaddr_in sin;
+	memset(&sin, 0, sizeof(sin));
+	sin.sin_family = AF_INET;
+	sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	socklen_t sinlen = sizeof(sin);
+	if( (listener < 0)
+	 or bind(listener, (struct sockaddr *)&sin, sizeof(sin))
+	 or listen(listener, 1)
+	 or getsockname(listener, (struct sockaddr *)&sin, &sinlen)
+	)
+		return false;
+
+	*client = socket(AF_INET, SOCK_STREAM, 0);
+	if(connect(*client, (struct sockaddr *)&sin, sizeof(sin)))
+		return false;
+	*server = accept(listener, nullptr, nullptr);
+	::close(listener);
+	return *server >= 0;
+}
+
+class PosixStreamPlatformAdapterTest : public ::testing::Test {
+protected:
+	void SetUp() override {
+		ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+		runLoop = std::make_shared<PreferredRunLoop>();
+		adapter = share_ref(new PosixStreamPlatformAdapter(runLoop.get()), false);
+		ASSERT_TRUE(adapter->setSocketFd(fds[0]));
+
+		int flags = fcntl(fds[1], F_GETFL);
+		fcntl(fds[1], F_SETFL, flags | O_NONBLOCK);
+		runLoop->registerDescriptor(fds[1], RunLoop::READABLE, [this] {
+			uint8_t buf[65536];
+			ssize_t rv = ::read(fds[1], buf, sizeof(buf));
+			if(rv > 0)
+				received.insert(received.end(), buf, buf + rv);
+			else
+			{
+				sawEOF = (0 == rv);
+				runLoop->unregisterDescriptor(fds[1]);
+				runLoop->stop();
+			}
+		});
+	}
+
+	void TearDown() override {
+		adapter->close();
+		runLoop->clear();
+		::close(fds[1]);
+	}
+
+	int fds[2];
+	std::shared_ptr<RunLoop> runLoop;
+	std::shared_ptr<PosixStreamPlatformAdapter> adapter;
+	std::vector<uint8_t> received;
+	bool sawEOF = false;
+};
+
+TEST_F(PosixStreamPlatformAdapterTest, CopiedAndSharedWritesInOrder) {
+	auto shared = std::make_shared<std::string>(10000, 'S');
+	std::string expected;
+	int step = 0;
+
+	adapter->notifyWhenWritable([&] {
+		std::string small = "copy" + std::to_string(step);
+		adapter->writeBytes(small.data(), small.size());
+		expected += small;
+		if(step % 3 == 0)
+		{
+			adapter->writeSharedBytes(shared, shared->data(), shared->size());
+			expected += *shared;
+		}
+		if(++step < 20)
+			return true;
+		adapter->onClientClosed();
+		return false;
+	});
+
+	runLoop->run(5.0);
+
+	EXPECT_TRUE(sawEOF);
+	EXPECT_EQ(std::string(received.begin(), received.end()), expected);
+	EXPECT_EQ(adapter->getOutputQueueSize(), 0u);
+}
+
+TEST_F(PosixStreamPlatformAdapterTest, LargeBacklogAndOwnerRelease) {
+	int sndbuf = 4096;
+	setsockopt(fds[0], SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf));
+
+	const size_t total = 8 * 1024 * 1024;
+	std::vector<uint8_t> pattern(total);
+	for(size_t x = 0; x < total; x++)
+		pattern[x] = uint8_t(x * 7 + (x >> 12));
+
+	std::weak_ptr<std::vector<uint8_t>> weakOwner;
+	bool wrote = false;
+
+	adapter->notifyWhenWritable([&] {
+		// queue the whole thing at once, half copied in small pieces and half shared.
+		size_t half = total / 2;
+		for(size_t offset = 0; offset < half; offset += 1000)
+			adapter->writeBytes(pattern.data() + offset, std::min(size_t(1000), half - offset));
+
+		auto owner = std::make_shared<std::vector<uint8_t>>(pattern.begin() + half, pattern.end());
+		weakOwner = owner;
+		adapter->writeSharedBytes(owner, owner->data(), owner->size());
+		wrote = true;
+		adapter->onClientClosed();
+		return false;
+	});
+
+	runLoop->run(30.0);
+
+	ASSERT_TRUE(wrote);
+	EXPECT_TRUE(sawEOF);
+	ASSERT_EQ(received.size(), total);
+	EXPECT_TRUE(0 == memcmp(received.data(), pattern.data(), total));
+	EXPECT_TRUE(weakOwner.expired());
+}
+
+TEST_F(PosixStreamPlatformAdapterTest, WritesFailAfterClose) {
+	adapter->close();
+	auto owner = std::make_shared<int>(0);
+	EXPECT_FALSE(adapter->writeBytes("x", 1));
+	EXPECT_FALSE(adapter->writeSharedBytes(owner, owner.get(), sizeof(int)));
+	EXPECT_EQ(owner.use_count(), 1);
+}
+
+TEST(PosixStreamPlatformAdapterZeroCopyTest, LoopbackZeroCopyReleasesOwners) {
+	int client, server;
+	ASSERT_TRUE(makeLoopbackTCPPair(&client, &server));
+
+	auto runLoop = std::make_shared<PreferredRunLoop>();
+	auto adapter = share_ref(new PosixStreamPlatformAdapter(runLoop.get()), false);
+	adapter->setSocketFd(client);
+	if(not adapter->setZeroCopyThreshold(65536))
+	{
+		adapter->close();
+		::close(server);
+		GTEST_SKIP() << "SO_ZEROCOPY not supported";
+	}
+
+	const size_t total = 4 * 1024 * 1024;
+	std::vector<uint8_t> received;
+	std::weak_ptr<std::vector<uint8_t>> weakOwner;
+	bool sawEOF = false;
+
+	auto owner = std::make_shared<std::vector<uint8_t>>(total);
+	for(size_t x = 0; x < total; x++)
+		(*owner)[x] = uint8_t(x * 13 + (x >> 10));
+	std::vector<uint8_t> expected = *owner;
+	weakOwner = owner;
+
+	adapter->notifyWhenWritable([&] {
+		adapter->writeBytes("head", 4);
+		adapter->writeSharedBytes(owner, owner->data(), owner->size());
+		adapter->writeBytes("tail", 4);
+		owner.reset();
+		adapter->onClientClosed();
+		return false;
+	});
+
+	fcntl(server, F_SETFL, fcntl(server, F_GETFL) | O_NONBLOCK);
+	runLoop->registerDescriptor(server, RunLoop::READABLE, [&] {
+		uint8_t buf[65536];
+		ssize_t rv = ::read(server, buf, sizeof(buf));
+		if(rv > 0)
+			received.insert(received.end(), buf, buf + rv);
+		else if(0 == rv)
+		{
+			sawEOF = true;
+			runLoop->unregisterDescriptor(server);
+		}
+	});
+
+	runLoop->scheduleRel(0, 0.01)->action = [&] (const std::shared_ptr<Timer> &sender, Time now) {
+		if(sawEOF and (0 == adapter->getPinnedSegmentCount()))
+			runLoop->stop();
+	};
+
+	runLoop->run(30.0);
+
+	ASSERT_TRUE(sawEOF);
+	ASSERT_EQ(received.size(), total + 8);
+	EXPECT_EQ(0, memcmp(received.data(), "head", 4));
+	EXPECT_EQ(0, memcmp(received.data() + 4, expected.data(), total));
+	EXPECT_EQ(0, memcmp(received.data() + 4 + total, "tail", 4));
+
+	auto stats = adapter->getZeroCopyStats();
+	EXPECT_GT(stats.m_sends, 0u);
+	EXPECT_EQ(stats.m_completions, stats.m_sends);
+	EXPECT_EQ(adapter->getPinnedSegmentCount(), 0u);
+	EXPECT_TRUE(weakOwner.expired());
+
+	adapter->close();
+	runLoop->clear();
+	::close(server);
+}
+
+TEST(PosixStreamPlatformAdapterPoolTest, AdaptersShareReceiveBuffer) {
+	auto runLoop = std::make_shared<PreferredRunLoop>();
+	auto pool = share_ref(new ReceiveBufferPool(4096, 1), false);
+
+	const int count = 50;
+	std::vector<int> peers;
+	std::vector<std::shared_ptr<PosixStreamPlatformAdapter>> adapters;
+	std::vector<std::string> received(count);
+	int done = 0;
+
+	for(int x = 0; x < count; x++)
+	{
+		int fds[2];
+		ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+		auto adapter = share_ref(new PosixStreamPlatformAdapter(runLoop.get()), false);
+		adapter->setReceiveBufferPool(pool);
+		adapter->setSocketFd(fds[0]);
+		adapter->setOnReceiveBytesCallback([&, x] (const void *bytes, size_t len) {
+			received[x].append((const char *)bytes, len);
+			if(received[x].size() == 10000)
+				done++;
+			if(done == count)
+				runLoop->stop();
+			return true;
+		});
+		adapters.push_back(adapter);
+		peers.push_back(fds[1]);
+
+		std::string message(10000, char('A' + x % 26));
+		ASSERT_EQ(ssize_t(message.size()), ::write(fds[1], message.data(), message.size()));
+	}
+
+	runLoop->run(5.0);
+
+	EXPECT_EQ(done, count);
+	for(int x = 0; x < count; x++)
+	{
+		EXPECT_EQ(received[x], std::string(10000, char('A' + x % 26)));
+		EXPECT_FALSE(adapters[x]->hasPrivateReceiveBuffer());
+	}
+	EXPECT_EQ(pool->getAllocatedCount(), 1u);
+	EXPECT_EQ(pool->getInUseCount(), 0u);
+
+	for(int x = 0; x < count; x++)
+	{
+		adapters[x]->close();
+		::close(peers[x]);
+	}
+	runLoop->clear();
+}
+
+TEST(PosixStreamPlatformAdapterPoolTest, ExhaustedPoolFallsBackToPrivateBuffer) {
+	auto runLoop = std::make_shared<PreferredRunLoop>();
+	auto pool = share_ref(new ReceiveBufferPool(4096, 1), false);
+
+	int outer[2], inner[2];
+	ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, outer));
+	ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, inner));
+
+	auto outerAdapter = share_ref(new PosixStreamPlatformAdapter(runLoop.get()), false);
+	auto innerAdapter = share_ref(new PosixStreamPlatformAdapter(runLoop.get()), false);
+	outerAdapter->setReceiveBufferPool(pool);
+	innerAdapter->setReceiveBufferPool(pool);
+	outerAdapter->setSocketFd(outer[0]);
+	innerAdapter->setSocketFd(inner[0]);
+
+	std::string innerReceived;
+	innerAdapter->setOnReceiveBytesCallback([&] (const void *bytes, size_t len) {
+		innerReceived.append((const char *)bytes, len);
+		runLoop->stop();
+		return true;
+	});
+
+	bool outerReceived = false;
+	outerAdapter->setOnReceiveBytesCallback([&] (const void *bytes, size_t len) {
+		outerReceived = true;
+		EXPECT_EQ(pool->getInUseCount(), 1u);
+		::write(inner[1], "inner", 5);
+		runLoop->run(5.0); // inner reads while outer still holds the pool's only buffer
+		EXPECT_EQ(std::string((const char *)bytes, len), "outer");
+		runLoop->stop();
+		return true;
+	});
+
+	::write(outer[1], "outer", 5);
+	runLoop->run(5.0);
+
+	EXPECT_TRUE(outerReceived);
+	EXPECT_EQ(innerReceived, "inner");
+	EXPECT_FALSE(outerAdapter->hasPrivateReceiveBuffer());
+	EXPECT_TRUE(innerAdapter->hasPrivateReceiveBuffer());
+	EXPECT_EQ(pool->getInUseCount(), 0u);
+
+	outerAdapter->close();
+	innerAdapter->close();
+	::close(outer[1]);
+	::close(inner[1]);
+	runLoop->clear();
+}
+
+TEST_F(PosixStreamPlatformAdapterTest, DefaultReadIsWhole64K) {
+	std::string message(50000, 'w');
+	ASSERT_EQ(ssize_t(message.size()), ::write(fds[1], message.data(), message.size()));
+
+	std::vector<size_t> reads;
+	adapter->setOnReceiveBytesCallback([&] (const void *bytes, size_t len) {
+		reads.push_back(len);
+		runLoop->stop();
+		return true;
+	});
+
+	runLoop->run(5.0);
+
+	ASSERT_EQ(reads.size(), 1u);
+	EXPECT_EQ(reads[0], message.size()); // not a small first read that has to grow
+}
+
+TEST_F(PosixStreamPlatformAdapterTest, ReadBudgetDrainsInOneEvent) {
+	std::string message(150000, 'x');
+	ASSERT_EQ(ssize_t(message.size()), ::write(fds[1], message.data(), message.size()));
+
+	size_t received = 0;
+	adapter->setReadBudget(1024 * 1024);
+	adapter->setOnReceiveBytesCallback([&] (const void *bytes, size_t len) {
+		received += len;
+		if(received == message.size())
+			runLoop->stop();
+		return true;
+	});
+
+	runLoop->run(5.0);
+
+	auto stats = adapter->getIOStats();
+	EXPECT_EQ(received, message.size());
+	EXPECT_EQ(stats.m_readBytes, message.size());
+	EXPECT_EQ(stats.m_readableEvents, 1u);
+	EXPECT_GT(stats.m_readCalls, 1u);
+	EXPECT_LT(stats.m_readCalls, 150000u / 4096); // read size grew
+}
+
+TEST_F(PosixStreamPlatformAdapterTest, FIONREADSizesReads) {
+	std::string message(40000, 'y');
+	ASSERT_EQ(ssize_t(message.size()), ::write(fds[1], message.data(), message.size()));
+
+	size_t received = 0;
+	adapter->setReadBudget(1024 * 1024);
+	adapter->setUseFIONREAD(true);
+	adapter->setOnReceiveBytesCallback([&] (const void *bytes, size_t len) {
+		received += len;
+		if(received == message.size())
+			runLoop->stop();
+		return true;
+	});
+
+	runLoop->run(5.0);
+
+	auto stats = adapter->getIOStats();
+	EXPECT_EQ(received, message.size());
+	EXPECT_EQ(stats.m_readableEvents, 1u);
+	EXPECT_EQ(stats.m_readCalls, 2u); // the first read and one sized by FIONREAD
+	EXPECT_EQ(stats.m_ioctlCalls, 2u); // the second finds the socket drained
+}
+
+TEST_F(PosixStreamPlatformAdapterTest, FileRangeInOrderWithWrites) {
+	char path[] = "/tmp/zenomt_test_XXXXXX";
+	int file = mkstemp(path);
+	ASSERT_GE(file, 0);
+	unlink(path);
+
+	std::string contents;
+	for(int x = 0; x < 300000; x++)
+		contents += char('a' + x % 23);
+	ASSERT_EQ(ssize_t(contents.size()), ::write(file, contents.data(), contents.size()));
+
+	adapter->notifyWhenWritable([&] {
+		adapter->writeBytes("head", 4);
+		EXPECT_TRUE(adapter->writeFileRange(file, 1000, 250000));
+		::close(file); // the adapter has its own descriptor
+		adapter->writeBytes("tail", 4);
+		adapter->onClientClosed();
+		return false;
+	});
+
+	runLoop->run(5.0);
+
+	EXPECT_TRUE(sawEOF);
+	EXPECT_EQ(received.size(), 250008u);
+	EXPECT_TRUE(std::string(received.begin(), received.end()) == "head" + contents.substr(1000, 250000) + "tail");
+}
+
+TEST(PosixStreamPlatformAdapterFileTest, FileRangeWithoutSendfile) {
+	// as on platforms without (Linux's) sendfile(2).
+	struct PreadAdapter : public PosixStreamPlatformAdapter {
+		using PosixStreamPlatformAdapter::PosixStreamPlatformAdapter;
+		void disableSendfile() { m_sendfileUnsupported = true; }
+	};
+
+	int fds[2];
+	ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+	auto runLoop = std::make_shared<PreferredRunLoop>();
+	auto adapter = share_ref(new PreadAdapter(runLoop.get()), false);
+	adapter->disableSendfile();
+	ASSERT_TRUE(adapter->setSocketFd(fds[0]));
+
+	char path[] = "/tmp/zenomt_test_XXXXXX";
+	int file = mkstemp(path);
+	ASSERT_GE(file, 0);
+	unlink(path);
+	std::string contents;
+	for(int x = 0; x < 200000; x++)
+		contents += char('A' + x % 19);
+	ASSERT_EQ(ssize_t(contents.size()), ::write(file, contents.data(), contents.size()));
+
+	adapter->notifyWhenWritable([&] {
+		EXPECT_TRUE(adapter->writeFileRange(file, 5, 150000));
+		::close(file);
+		adapter->onClientClosed();
+		return false;
+	});
+
+	std::string received;
+	fcntl(fds[1], F_SETFL, fcntl(fds[1], F_GETFL) | O_NONBLOCK);
+	runLoop->registerDescriptor(fds[1], RunLoop::READABLE, [&] {
+		char buf[65536];
+		ssize_t rv = ::read(fds[1], buf, sizeof(buf));
+		if(rv > 0)
+			received.append(buf, rv);
+		else
+			runLoop->stop();
+	});
+	runLoop->run(5.0);
+
+	EXPECT_TRUE(received == contents.substr(5, 150000));
+	EXPECT_GT(adapter->getIOStats().m_writeCalls, 1u); // in INPUT_BUFFER_SIZE pieces
+
+	adapter->close();
+	runLoop->clear();
+	::close(fds[1]);
+}
+
+TEST(PosixStreamPlatformAdapterFileTest, SendfileRefusalIsPerFile) {
+	// as when sendfile(2) fails with EINVAL for one file (say, one that can't be mmapped).
+	struct RefusingAdapter : public PosixStreamPlatformAdapter {
+		using PosixStreamPlatformAdapter::PosixStreamPlatformAdapter;
+		void refuseLastFile() { m_outputChain.back().m_pread = true; }
+		bool lastFileRefused() const { return m_outputChain.back().m_pread; }
+		bool sendfileUnsupported() const { return m_sendfileUnsupported; }
+	};
+
+	int fds[2];
+	ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+	auto runLoop = std::make_shared<PreferredRunLoop>();
+	auto adapter = share_ref(new RefusingAdapter(runLoop.get()), false);
+	ASSERT_TRUE(adapter->setSocketFd(fds[0]));
+
+	char path[] = "/tmp/zenomt_test_XXXXXX";
+	int file = mkstemp(path);
+	ASSERT_GE(file, 0);
+	unlink(path);
+	std::string contents;
+	for(int x = 0; x < 200000; x++)
+		contents += char('a' + x % 17);
+	ASSERT_EQ(ssize_t(contents.size()), ::write(file, contents.data(), contents.size()));
+
+	adapter->notifyWhenWritable([&] {
+		EXPECT_TRUE(adapter->writeFileRange(file, 0, 100000));
+		adapter->refuseLastFile();
+		EXPECT_TRUE(adapter->writeFileRange(file, 100000, 100000));
+		EXPECT_FALSE(adapter->lastFileRefused());
+		::close(file);
+		adapter->onClientClosed();
+		return false;
+	});
+
+	std::string received;
+	fcntl(fds[1], F_SETFL, fcntl(fds[1], F_GETFL) | O_NONBLOCK);
+	runLoop->registerDescriptor(fds[1], RunLoop::READABLE, [&] {
+		char buf[65536];
+		ssize_t rv = ::read(fds[1], buf, sizeof(buf));
+		if(rv > 0)
+			received.append(buf, rv);
+		else
+			runLoop->stop();
+	});
+	runLoop->run(5.0);
+
+	EXPECT_TRUE(received == contents);
+#ifdef __linux__
+	EXPECT_FALSE(adapter->sendfileUnsupported());
+#endif
+
+	adapter->close();
+	runLoop->clear();
+	::close(fds[1]);
+}
+
+TEST(StreamPlatformAdapterTest, DefaultFileRangeCopies) {
+	struct CopyingAdapter : public IStreamPlatformAdapter {
+		Time getCurrentTime() override { return 0; }
+		void notifyWhenWritable(const onwritable_f &onwritable) override {}
+		void setOnReceiveBytesCallback(const onreceivebytes_f &onreceivebytes) override {}
+		void setOnStreamDidCloseCallback(const Task &onstreamdidclose) override {}
+		void doLater(const Task &task) override {}
+		bool writeBytes(const void *bytes, size_t len) override { written.append((const char *)bytes, len); return true; }
+		void onClientClosed() override {}
+		std::string written;
+	} adapter;
+
+	char path[] = "/tmp/zenomt_test_XXXXXX";
+	int file = mkstemp(path);
+	ASSERT_GE(file, 0);
+	unlink(path);
+	std::string contents(40000, 'q');
+	contents[20000] = 'Z';
+	ASSERT_EQ(ssize_t(contents.size()), ::write(file, contents.data(), contents.size()));
+
+	EXPECT_TRUE(adapter.writeFileRange(file, 10000, 20001));
+	EXPECT_EQ(adapter.written, contents.substr(10000, 20001));
+	EXPECT_FALSE(adapter.writeFileRange(file, 39000, 2000)); // past the end of the file
+	::close(file);
+}
+
+TEST_F(PosixStreamPlatformAdapterTest, NotifyWhenQueuedBelow) {
+	std::vector<uint8_t> payload(1024 * 1024, 'q');
+	size_t queuedAfterWrite = 0;
+	bool below = false;
+
+	adapter->notifyWhenWritable([&] {
+		adapter->writeBytes(payload.data(), payload.size());
+		queuedAfterWrite = adapter->getQueuedByteCount(true);
+		adapter->notifyWhenQueuedBelow(1000, [&] {
+			below = true;
+			EXPECT_LE(adapter->getQueuedByteCount(), 1000u);
+			adapter->onClientClosed();
+		});
+		return false;
+	});
+
+	runLoop->run(5.0);
+
+	EXPECT_EQ(queuedAfterWrite, payload.size());
+	EXPECT_TRUE(below);
+	EXPECT_TRUE(sawEOF);
+	EXPECT_EQ(received.size(), payload.size());
+}
+
+TEST(PosixStreamPlatformAdapterAutoTuneTest, ComputeSizes) {
+	size_t lowat, writeSize;
+
+	// 100 Mbit/s at 80 ms: 1 MB BDP, so a quarter of it
+	PosixStreamPlatformAdapter::computeAutoTuneSizes(0.080, 12.5e6, 1448, &lowat, &writeSize);
+	EXPECT_EQ(lowat, 250000u);
+	EXPECT_EQ(writeSize, 250000u);
+
+	// 1 Mbit/s at 20 ms: less than a couple of segments
+	PosixStreamPlatformAdapter::computeAutoTuneSizes(0.020, 125e3, 1448, &lowat, &writeSize);
+	EXPECT_EQ(lowat, 2896u);
+	EXPECT_EQ(writeSize, 2896u);
+
+	// 10 Gbit/s at 200 ms: capped
+	PosixStreamPlatformAdapter::computeAutoTuneSizes(0.200, 1.25e9, 1448, &lowat, &writeSize);
+	EXPECT_EQ(lowat, 8u * 1024 * 1024);
+	EXPECT_EQ(writeSize, 1024u * 1024);
+}
+
+TEST(PosixStreamPlatformAdapterAutoTuneTest, TunesFromTCPInfo) {
+	int client, server;
+	ASSERT_TRUE(makeLoopbackTCPPair(&client, &server));
+
+	auto runLoop = std::make_shared<PreferredRunLoop>();
+	auto adapter = share_ref(new PosixStreamPlatformAdapter(runLoop.get()), false);
+	adapter->setSocketFd(client);
+	adapter->setAutoTune(true);
+	EXPECT_EQ(adapter->getUnsentLowat(), 4096);
+	EXPECT_EQ(adapter->getWriteSizePerSelect(), 2048u);
+
+	std::vector<uint8_t> chunk(65536, 'z');
+	size_t sent = 0;
+	adapter->notifyWhenWritable([&] {
+		adapter->writeBytes(chunk.data(), chunk.size());
+		sent += chunk.size();
+		return sent < 64 * 1024 * 1024;
+	});
+
+	size_t received = 0;
+	fcntl(server, F_SETFL, fcntl(server, F_GETFL) | O_NONBLOCK);
+	runLoop->registerDescriptor(server, RunLoop::READABLE, [&] {
+		uint8_t buf[65536];
+		ssize_t rv = ::read(server, buf, sizeof(buf));
+		if(rv > 0)
+			received += rv;
+		if(received >= 64 * 1024 * 1024)
+			runLoop->stop();
+	});
+
+	runLoop->run(30.0);
+
+	// loopback's large MSS puts even the floor well above the defaults.
+	EXPECT_GT(adapter->getUnsentLowat(), 4096);
+	EXPECT_GT(adapter->getWriteSizePerSelect(), 2048u);
+
+	adapter->close();
+	runLoop->clear();
+	::close(server);
+}
+
+TEST_F(PosixStreamPlatformAdapterTest, NoTCPInfoForUnixSockets) {
+	TCPInfo info;
+	EXPECT_FALSE(adapter->getTCPInfo(&info));
+}
+
+TEST(PosixStreamPlatformAdapterTCPInfoTest, SnapshotAndSampling) {
+	int client, server;
+	ASSERT_TRUE(makeLoopbackTCPPair(&client, &server));
+
+	auto runLoop = std::make_shared<PreferredRunLoop>();
+	auto adapter = share_ref(new PosixStreamPlatformAdapter(runLoop.get()), false);
+	adapter->setSocketFd(client);
+
+	std::vector<uint8_t> chunk(65536, 't');
+	adapter->notifyWhenWritable([&] {
+		adapter->writeBytes(chunk.data(), chunk.size());
+		return true;
+	});
+
+	fcntl(server, F_SETFL, fcntl(server, F_GETFL) | O_NONBLOCK);
+	runLoop->registerDescriptor(server, RunLoop::READABLE, [&] {
+		uint8_t buf[65536];
+		while(::read(server, buf, sizeof(buf)) > 0)
+			;
+	});
+
+	int samples = 0;
+	adapter->onTCPInfoSample = [&] (const TCPInfo &info) {
+		if(++samples == 6)
+			runLoop->stop();
+	};
+	adapter->startTCPInfoSampling(0.01, 4);
+
+	runLoop->run(5.0);
+
+	EXPECT_EQ(samples, 6);
+	auto history = adapter->getTCPInfoHistory();
+	ASSERT_EQ(history.size(), 4u);
+	for(size_t x = 1; x < history.size(); x++)
+	{
+		EXPECT_GT(history[x].m_time, history[x - 1].m_time);
+		EXPECT_GE(history[x].m_bytesAcked, history[x - 1].m_bytesAcked);
+	}
+
+	TCPInfo info;
+	ASSERT_TRUE(adapter->getTCPInfo(&info));
+	EXPECT_GT(info.m_rtt, 0);
+	EXPECT_GT(info.m_mss, 0u);
+	EXPECT_GT(info.m_cwnd, 0u);
+	EXPECT_GT(info.m_bytesAcked, 0u);
+
+	adapter->close();
+	runLoop->run(0.05);
+	EXPECT_EQ(samples, 6); // stopped by close()
+
+	runLoop->clear();
+	::close(server);
+}
+
+TEST_F(PosixStreamPlatformAdapterTest, TokenBucketPacing) {
+	const double rate = 200000;
+	EXPECT_FALSE(adapter->setPacingRate(rate)); // not TCP, so no kernel pacing
+	EXPECT_FALSE(adapter->isKernelPacing());
+	EXPECT_EQ(adapter->getPacingRate(), rate);
+
+	const size_t total = 60000;
+	std::vector<uint8_t> payload(total, 'p');
+	adapter->notifyWhenWritable([&] {
+		adapter->writeBytes(payload.data(), payload.size());
+		adapter->onClientClosed();
+		return false;
+	});
+
+	double begin = runLoop->getCurrentTimeNoCache();
+	runLoop->run(5.0);
+	double elapsed = runLoop->getCurrentTimeNoCache() - begin;
+
+	EXPECT_TRUE(sawEOF);
+	EXPECT_EQ(received.size(), total);
+	EXPECT_GE(elapsed, (total - 4096) / rate * 0.9); // all but the first burst is paced
+	EXPECT_LT(elapsed, 2.0);
+	EXPECT_GT(adapter->getAchievedRate(), 0);
+	EXPECT_LT(adapter->getAchievedRate(), rate * 1.5);
+}
+
+TEST_F(PosixStreamPlatformAdapterTest, UnpacingResumesImmediately) {
+	adapter->setPacingRate(1000);
+
+	const size_t total = 60000;
+	std::vector<uint8_t> payload(total, 'q');
+	adapter->notifyWhenWritable([&] {
+		adapter->writeBytes(payload.data(), payload.size());
+		adapter->onClientClosed();
+		return false;
+	});
+
+	runLoop->run(0.2);
+	EXPECT_LT(received.size(), size_t(8192));
+	EXPECT_GT(adapter->getOutputQueueSize(), 0u);
+
+	adapter->setPacingRate(0);
+	runLoop->run(5.0);
+	EXPECT_TRUE(sawEOF);
+	EXPECT_EQ(received.size(), total);
+}
+
+TEST(PosixStreamPlatformAdapterPacingTest, KernelPacesTCP) {
+	int client, server;
+	ASSERT_TRUE(makeLoopbackTCPPair(&client, &server));
+
+	auto runLoop = std::make_shared<PreferredRunLoop>();
+	auto adapter = share_ref(new PosixStreamPlatformAdapter(runLoop.get()), false);
+	adapter->setSocketFd(client);
+
+	const double rate = 4000000;
+	if(not adapter->setPacingRate(rate))
+	{
+		adapter->close();
+		::close(server);
+		GTEST_SKIP() << "SO_MAX_PACING_RATE not supported";
+	}
+	EXPECT_TRUE(adapter->isKernelPacing());
+
+	const size_t total = 2 * 1024 * 1024;
+	std::vector<uint8_t> chunk(65536, 'k');
+	size_t sent = 0;
+	adapter->notifyWhenWritable([&] {
+		adapter->writeBytes(chunk.data(), chunk.size());
+		sent += chunk.size();
+		return sent < total;
+	});
+
+	size_t received = 0;
+	fcntl(server, F_SETFL, fcntl(server, F_GETFL) | O_NONBLOCK);
+	runLoop->registerDescriptor(server, RunLoop::READABLE, [&] {
+		uint8_t buf[65536];
+		ssize_t rv;
+		while((rv = ::read(server, buf, sizeof(buf))) > 0)
+			received += rv;
+		if(received >= total)
+			runLoop->stop();
+	});
+
+	double begin = runLoop->getCurrentTimeNoCache();
+	runLoop->run(10.0);
+	double elapsed = runLoop->getCurrentTimeNoCache() - begin;
+
+	EXPECT_EQ(received, total);
+	EXPECT_GE(elapsed, total / rate * 0.5);
+
+	TCPInfo info;
+	ASSERT_TRUE(adapter->getTCPInfo(&info));
+	EXPECT_LE(info.m_pacingRate, rate);
+
+	EXPECT_FALSE(adapter->setPacingRate(0));
+	EXPECT_FALSE(adapter->isKernelPacing());
+
+	adapter->close();
+	runLoop->clear();
+	::close(server);
+}
+
+TEST_F(PosixStreamPlatformAdapterTest, OptimisticWriteSkipsWritable) {
+	adapter->setOptimisticWrites(true);
+	adapter->setOnReceiveBytesCallback([&] (const void *bytes, size_t len) {
+		adapter->notifyWhenWritable([&] {
+			adapter->writeBytes("pong", 4);
+			adapter->onClientClosed();
+			return false;
+		});
+		return true;
+	});
+
+	ASSERT_EQ(4, ::write(fds[1], "ping", 4));
+	runLoop->run(5.0);
+
+	auto stats = adapter->getIOStats();
+	EXPECT_TRUE(sawEOF);
+	EXPECT_EQ(std::string(received.begin(), received.end()), "pong");
+	EXPECT_EQ(stats.m_optimisticWrites, 1u);
+	EXPECT_EQ(stats.m_writableEvents, 0u);
+}
+
+TEST_F(PosixStreamPlatformAdapterTest, OptimisticWriteFallsBackWhenFull) {
+	int sndbuf = 4096;
+	setsockopt(fds[0], SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf));
+	adapter->setOptimisticWrites(true);
+
+	const size_t total = 1024 * 1024;
+	std::vector<uint8_t> payload(total, 'o');
+	adapter->notifyWhenWritable([&] {
+		adapter->writeBytes(payload.data(), payload.size());
+		adapter->onClientClosed();
+		return false;
+	});
+
+	runLoop->run(5.0);
+
+	auto stats = adapter->getIOStats();
+	EXPECT_TRUE(sawEOF);
+	EXPECT_EQ(received.size(), total);
+	EXPECT_EQ(stats.m_optimisticWrites, 1u);
+	EXPECT_GT(stats.m_writableEvents, 0u);
+}
+
+TEST_F(PosixStreamPlatformAdapterTest, CorkedWritesGoOutAtEndOfCycle) {
+	adapter->setCorked(true);
+
+	std::string expected;
+	runLoop->doLater([&] {
+		for(int x = 0; x < 100; x++)
+		{
+			std::string each = "message" + std::to_string(x) + ";";
+			adapter->writeBytes(each.data(), each.size());
+			expected += each;
+		}
+
+		adapter->notifyWhenWritable([&] {
+			adapter->writeBytes("last", 4);
+			expected += "last";
+			adapter->onClientClosed();
+			return false;
+		});
+	});
+
+	runLoop->run(5.0);
+
+	auto stats = adapter->getIOStats();
+	EXPECT_TRUE(sawEOF);
+	EXPECT_EQ(std::string(received.begin(), received.end()), expected);
+	EXPECT_EQ(stats.m_corkedFlushes, 1u);
+	EXPECT_EQ(stats.m_writeCalls, 1u);
+	EXPECT_EQ(stats.m_writableEvents, 0u);
+}
+
+TEST_F(PosixStreamPlatformAdapterTest, CorkedWriteFromPrepareObserverIsNotDelayed) {
+	adapter->setCorked(true);
+
+	Time wrote = -1;
+	auto observer = runLoop->addCycleObserver(RunLoop::PREPARE, [&] {
+		if(wrote >= 0)
+			return;
+		wrote = runLoop->getCurrentTimeNoCache();
+		adapter->writeBytes("prepared", 8); // schedules the cork flush during PREPARE
+		adapter->onClientClosed();
+	});
+
+	runLoop->run(5.0); // until EOF; nothing else would wake it up
+
+	EXPECT_TRUE(sawEOF);
+	EXPECT_EQ(std::string(received.begin(), received.end()), "prepared");
+	EXPECT_LT(runLoop->getCurrentTimeNoCache() - wrote, 1.0);
+	EXPECT_EQ(adapter->getIOStats().m_corkedFlushes, 1u);
+	observer->cancel();
+}
+
+TEST(PosixStreamPlatformAdapterZeroCopyTest, CloseKeepsPinnedOwnersUntilCompleted) {
+	int client, server;
+	ASSERT_TRUE(makeLoopbackTCPPair(&client, &server));
+
+	auto runLoop = std::make_shared<PreferredRunLoop>();
+	auto adapter = share_ref(new PosixStreamPlatformAdapter(runLoop.get()), false);
+	adapter->setSocketFd(client);
+	if(not adapter->setZeroCopyThreshold(65536))
+	{
+		adapter->close();
+		::close(server);
+		GTEST_SKIP() << "SO_ZEROCOPY not supported";
+	}
+
+	// more than the socket buffers hold, so some is still waiting to be sent from our memory.
+	const size_t total = 32 * 1024 * 1024;
+	auto owner = std::make_shared<std::vector<uint8_t>>(total);
+	for(size_t x = 0; x < total; x++)
+		(*owner)[x] = uint8_t(x * 7 + (x >> 12));
+	std::weak_ptr<std::vector<uint8_t>> weakOwner = owner;
+
+	adapter->notifyWhenWritable([&] {
+		adapter->writeSharedBytes(owner, owner->data(), owner->size());
+		return false;
+	});
+	runLoop->scheduleRel(0, 0.01)->action = [&] (const std::shared_ptr<Timer> &sender, Time now) {
+		if(adapter->getPinnedSegmentCount())
+		{
+			sender->cancel();
+			runLoop->stop();
+		}
+	};
+	runLoop->run(5.0);
+	ASSERT_GT(adapter->getPinnedSegmentCount(), 0u);
+
+	std::vector<uint8_t> expected = *owner;
+	owner.reset();
+	adapter->close();
+	EXPECT_EQ(adapter->getPinnedSegmentCount(), 0u);
+	adapter.reset(); // and anything not yet sent goes with it
+	EXPECT_FALSE(weakOwner.expired()); // the kernel might still be sending from it
+
+	std::vector<uint8_t> received;
+	bool sawEOF = false;
+	fcntl(server, F_SETFL, fcntl(server, F_GETFL) | O_NONBLOCK);
+	runLoop->registerDescriptor(server, RunLoop::READABLE, [&] {
+		uint8_t buf[65536];
+		ssize_t rv = ::read(server, buf, sizeof(buf));
+		if(rv > 0)
+			received.insert(received.end(), buf, buf + rv);
+		else if(0 == rv)
+		{
+			sawEOF = true;
+			runLoop->unregisterDescriptor(server);
+		}
+	});
+	runLoop->scheduleRel(0, 0.01)->action = [&] (const std::shared_ptr<Timer> &sender, Time now) {
+		if(sawEOF and weakOwner.expired())
+			runLoop->stop();
+	};
+	runLoop->run(30.0);
+
+	EXPECT_TRUE(sawEOF); // only once the socket is finally closed
+	EXPECT_TRUE(weakOwner.expired());
+	ASSERT_GT(received.size(), 0u);
+	ASSERT_LE(received.size(), total);
+	EXPECT_EQ(0, memcmp(received.data(), expected.data(), received.size()));
+
+	runLoop->clear();
+	::close(server);
+}
+
+TEST(PosixStreamPlatformAdapterZeroCopyTest, CloseLingerGivesUpAfterTimeout) {
+	int client, server;
+	ASSERT_TRUE(makeLoopbackTCPPair(&client, &server));
+
+	auto runLoop = std::make_shared<PreferredRunLoop>();
+	auto adapter = share_ref(new PosixStreamPlatformAdapter(runLoop.get()), false);
+	adapter->setSocketFd(client);
+	if(not adapter->setZeroCopyThreshold(65536))
+	{
+		adapter->close();
+		::close(server);
+		GTEST_SKIP() << "SO_ZEROCOPY not supported";
+	}
+	adapter->setZeroCopyLingerTimeout(0.2);
+
+	// the peer never reads, so what's beyond its window stays pinned.
+	auto owner = std::make_shared<std::vector<uint8_t>>(32 * 1024 * 1024);
+	std::weak_ptr<std::vector<uint8_t>> weakOwner = owner;
+	adapter->notifyWhenWritable([&] {
+		adapter->writeSharedBytes(owner, owner->data(), owner->size());
+		return false;
+	});
+	runLoop->scheduleRel(0, 0.01)->action = [&] (const std::shared_ptr<Timer> &sender, Time now) {
+		if(adapter->getPinnedSegmentCount())
+		{
+			sender->cancel();
+			runLoop->stop();
+		}
+	};
+	runLoop->run(5.0);
+	ASSERT_GT(adapter->getPinnedSegmentCount(), 0u);
+
+	owner.reset();
+	adapter->close();
+	adapter.reset();
+	EXPECT_FALSE(weakOwner.expired());
+
+	Time closed = runLoop->getCurrentTimeNoCache();
+	runLoop->scheduleRel(0, 0.01)->action = [&] (const std::shared_ptr<Timer> &sender, Time now) {
+		if(weakOwner.expired())
+			runLoop->stop();
+	};
+	runLoop->run(10.0);
+
+	EXPECT_TRUE(weakOwner.expired());
+	EXPECT_LT(runLoop->getCurrentTimeNoCache() - closed, 5.0);
+
+	uint8_t buf[65536];
+	ssize_t rv;
+	while((rv = ::read(server, buf, sizeof(buf))) > 0)
+		;
+	EXPECT_LT(rv, 0); // reset, not an orderly close
+	EXPECT_EQ(errno, ECONNRESET);
+
+	runLoop->clear();
+	::close(server);
+}
@@ -0,0 +1,269 @@
+#include <gtest/gtest.h>
+#include <atomic>
+#include <string>
+#include <thread>
+#include "zenomt/PrefixTable.hpp"
+
+using namespace com::zenomt;
+using namespace com::zenomt::rtmfp;
+
+static Address makeAddress(const char *presentation) {
+	Address addr;
+	EXPECT_TRUE(addr.setFromPresentation(presentation, false)) << presentation;
+	return addr;
+}
+
+TEST(PrefixTableTest, Empty) {
+	PrefixTable<int> table;
+	EXPECT_TRUE(table.empty());
+	EXPECT_EQ(table.lookup(makeAddress("10.0.0.1")), nullptr);
+	EXPECT_EQ(table.lookup(Address()), nullptr);
+}
+
+TEST(PrefixTableTest, ParseCIDR) {
+	Address prefix;
+	unsigned length = 0;
+
+	EXPECT_TRUE(PrefixTable<int>::parseCIDR("10.0.0.0/8", prefix, length));
+	EXPECT_EQ(length, 8u);
+	EXPECT_EQ(prefix.getFamily(), AF_INET);
+
+	EXPECT_TRUE(PrefixTable<int>::parseCIDR("2001:db8::/32", prefix, length));
+	EXPECT_EQ(length, 32u);
+	EXPECT_EQ(prefix.getFamily(), AF_INET6);
+
+	EXPECT_TRUE(PrefixTable<int>::parseCIDR("192.0.2.1", prefix, length));
+	EXPECT_EQ(length, 32u);
+
+	EXPECT_FALSE(PrefixTable<int>::parseCIDR("10.0.0.0/33", prefix, length));
+	EXPECT_FALSE(PrefixTable<int>::parseCIDR("10.0.0.0/", prefix, length));
+	EXPECT_FALSE(PrefixTable<int>::parseCIDR("10.0.0.0/8x", prefix, length));
+	EXPECT_FALSE(PrefixTable<int>::parseCIDR("2001:db8::/129", prefix, length));
+	EXPECT_FALSE(PrefixTable<int>::parseCIDR("example.com/8", prefix, length));
+}
+
+TEST(PrefixTableTest, LongestMatch) {
+	PrefixTable<std::string> table;
+	EXPECT_TRUE(table.add("10.0.0.0/8", "ten"));
+	EXPECT_TRUE(table.add("10.1.0.0/16", "ten-one"));
+	EXPECT_TRUE(table.add("10.1.2.3", "host"));
+	EXPECT_TRUE(table.add("2001:db8::/32", "doc"));
+	EXPECT_TRUE(table.add("2001:db8:1::/48", "doc-one"));
+	EXPECT_EQ(table.size(), 5u);
+
+	unsigned length = 0;
+	const std::string *found;
+
+	found = table.lookup(makeAddress("10.200.0.1"), &length);
+	ASSERT_NE(found, nullptr);
+	EXPECT_EQ(*found, "ten");
+	EXPECT_EQ(length, 8u);
+
+	found = table.lookup(makeAddress("10.1.9.9"), &length);
+	ASSERT_NE(found, nullptr);
+	EXPECT_EQ(*found, "ten-one");
+	EXPECT_EQ(length, 16u);
+
+	found = table.lookup(makeAddress("10.1.2.3"), &length);
+	ASSERT_NE(found, nullptr);
+	EXPECT_EQ(*found, "host");
+	EXPECT_EQ(length, 32u);
+
+	found = table.lookup(makeAddress("::ffff:10.1.2.3"), &length);
+	ASSERT_NE(found, nullptr);
+	EXPECT_EQ(*found, "host");
+	EXPECT_EQ(length, 128u);
+
+	found = table.lookup(makeAddress("2001:db8:1:2::1"), &length);
+	ASSERT_NE(found, nullptr);
+	EXPECT_EQ(*found, "doc-one");
+	EXPECT_EQ(length, 48u);
+
+	found = table.lookup(makeAddress("2001:db8:2::1"));
+	ASSERT_NE(found, nullptr);
+	EXPECT_EQ(*found, "doc");
+
+	EXPECT_EQ(table.lookup(makeAddress("11.0.0.1")), nullptr);
+	EXPECT_EQ(table.lookup(makeAddress("2001:db9::1")), nullptr);
+
+	EXPECT_TRUE(table.add("0.0.0.0/0", "any-v4"));
+	found = table.lookup(makeAddress("11.0.0.1"));
+	ASSERT_NE(found, nullptr);
+	EXPECT_EQ(*found, "any-v4");
+	EXPECT_EQ(table.lookup(makeAddress("2001:db9::1")), nullptr);
+}
+
+TEST(PrefixTableTest, ShortIPv6PrefixMatchesIPv4) {
+	PrefixTable<std::string> table;
+	EXPECT_TRUE(table.add("::/0", "any"));
+	EXPECT_TRUE(table.add("::ffff:0:0/80", "mapped-ish"));
+
+	unsigned length = 99;
+	const std::string *found = table.lookup(makeAddress("10.1.2.3"), &length);
+	ASSERT_NE(found, nullptr);
+	EXPECT_EQ(*found, "mapped-ish");
+	EXPECT_EQ(length, 0u); // not 80 - 96
+
+	found = table.lookup(makeAddress("::ffff:10.1.2.3"), &length);
+	ASSERT_NE(found, nullptr);
+	EXPECT_EQ(length, 80u);
+
+	EXPECT_TRUE(table.remove("::ffff:0:0/80"));
+	found = table.lookup(makeAddress("10.1.2.3"), &length);
+	ASSERT_NE(found, nullptr);
+	EXPECT_EQ(*found, "any");
+	EXPECT_EQ(length, 0u);
+
+	EXPECT_TRUE(table.add("10.0.0.0/8", "ten"));
+	found = table.lookup(makeAddress("10.1.2.3"), &length);
+	ASSERT_NE(found, nullptr);
+	EXPECT_EQ(*found, "ten");
+	EXPECT_EQ(length, 8u);
+}
+
+TEST(PrefixTableTest, ReplaceAndRemove) {
+	PrefixTable<int> table;
+	table.add("192.0.2.0/24", 1);
+	table.add("192.0.2.0/25", 2);
+	table.add("192.0.2.77/24", 3); // host bits are ignored, replaces the first
+
+	EXPECT_EQ(table.size(), 2u);
+	EXPECT_EQ(*table.lookup(makeAddress("192.0.2.200")), 3);
+	EXPECT_EQ(*table.lookup(makeAddress("192.0.2.100")), 2);
+
+	EXPECT_TRUE(table.remove("192.0.2.0/25"));
+	EXPECT_FALSE(table.remove("192.0.2.0/25"));
+	EXPECT_EQ(table.size(), 1u);
+	EXPECT_EQ(*table.lookup(makeAddress("192.0.2.100")), 3);
+
+	table.clear();
+	EXPECT_EQ(table.lookup(makeAddress("192.0.2.100")), nullptr);
+}
+
+TEST(PrefixTableTest, MatchesLinearScan) {
+	struct Entry { uint8_t ip[16]; unsigned length; int value; };
+	std::vector<Entry> entries;
+	PrefixTable<int> table;
+	unsigned seed = 7;
+
+	auto rnd = [&seed] { seed = seed * 1103515245 + 12345; return (seed >> 16) & 0x7fff; };
+
+	auto matches = [] (const uint8_t *prefix, unsigned length, const uint8_t *ip) {
+		for(unsigned bit = 0; bit < length; bit++)
+		{
+			int mask = 0x80 >> (bit % 8);
+			if((prefix[bit / 8] & mask) != (ip[bit / 8] & mask))
+				return false;
+		}
+		return true;
+	};
+
+	for(int x = 0; x < 2000; x++)
+	{
+		Entry entry;
+		for(int y = 0; y < 16; y++)
+			entry.ip[y] = (y < 2) ? 0x20 : rnd() & 0xff;
+		entry.ip[2] = rnd() & 0x03; // cluster so prefixes nest and collide
+		entry.length = 8 + rnd() % 57;
+		entry.value = x;
+
+		Address prefix;
+		prefix.setIPAddress(entry.ip, 16);
+		table.add(prefix, entry.length, entry.value);
+
+		bool replaced = false;
+		for(auto it = entries.begin(); it != entries.end(); it++)
+			if((it->length == entry.length) and matches(it->ip, it->length, entry.ip))
+			{
+				it->value = entry.value;
+				replaced = true;
+			}
+		if(not replaced)
+			entries.push_back(entry);
+	}
+
+	for(int x = 0; x < 5000; x++)
+	{
+		uint8_t ip[16];
+		if(x % 2)
+			memcpy(ip, entries[rnd() % entries.size()].ip, 16);
+		else
+			for(int y = 0; y < 16; y++)
+				ip[y] = (y < 2) ? 0x20 : rnd() & 0xff;
+		ip[15] ^= rnd() & 0xff;
+		if(x % 3 == 0)
+			ip[2] = rnd() & 0x03;
+
+		const Entry *best = nullptr;
+		for(auto it = entries.begin(); it != entries.end(); it++)
+			if(matches(it->ip, it->length, ip) and ((not best) or (it->length > best->length)))
+				best = &*it;
+
+		Address addr;
+		addr.setIPAddress(ip, 16);
+		unsigned length = 0;
+		const int *found = table.lookup(addr, &length);
+
+		if(best)
+		{
+			ASSERT_NE(found, nullptr);
+			EXPECT_EQ(length, best->length);
+			EXPECT_EQ(*found, best->value);
+		}
+		else
+			EXPECT_EQ(found, nullptr);
+	}
+}
+
+TEST(PrefixTableTest, ConcurrentReadersDuringPublish) {
+	ConcurrentPrefixTable<int> shared;
+	std::atomic<bool> stop(false);
+	std::atomic<long> lookups(0);
+	std::atomic<long> inconsistent(0);
+
+	Address probe = makeAddress("10.1.2.3");
+
+	{
+		PrefixTable<int> table;
+		table.add("10.0.0.0/8", 0);
+		table.add("10.1.0.0/16", 0);
+		shared.publish(table);
+	}
+
+	std::vector<std::thread> readers;
+	for(int x = 0; x < 4; x++)
+		readers.emplace_back([&] {
+			while(not stop)
+			{
+				int value = -1;
+				unsigned length = 0;
+				if(not shared.lookup(probe, &value, &length) or (16 != length) or (value < 0))
+					inconsistent++;
+				lookups++;
+			}
+		});
+
+	while(0 == lookups)
+		std::this_thread::yield(); // let the readers get going first
+
+	// keep publishing until the readers have done plenty of lookups while tables changed.
+	int generation = 0;
+	while((generation < 2000) or (lookups < 20000))
+	{
+		generation++;
+		PrefixTable<int> table = shared.getTable();
+		table.add("10.0.0.0/8", generation);
+		table.add("10.1.0.0/16", generation);
+		shared.publish(table);
+	}
+
+	stop = true;
+	for(auto it = readers.begin(); it != readers.end(); it++)
+		it->join();
+
+	int value = 0;
+	EXPECT_TRUE(shared.lookup(probe, &value));
+	EXPECT_EQ(value, generation);
+	EXPECT_EQ(inconsistent, 0);
+	EXPECT_GE(lookups, 20000);
+}
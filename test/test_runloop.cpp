@@ -1,6 +1,10 @@
 #include <gtest/gtest.h>
 #include <thread>
 #include <chrono>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
 
 #include "zenomt/RunLoops.hpp"
 #include "zenomt/Timer.hpp"
@@ -121,6 +125,82 @@ TEST_F(RunLoopTest, OnEveryCycle) {
 	EXPECT_GE(cycleCount, 5);
 }
 
+TEST_F(RunLoopTest, CycleObserversInOrder) {
+	std::vector<int> calls;
+	auto a = runLoop->addCycleObserver(RunLoop::PREPARE, [&] { calls.push_back(1); }, 5);
+	auto b = runLoop->addCycleObserver(RunLoop::PREPARE, [&] { calls.push_back(2); });
+	auto c = runLoop->addCycleObserver(RunLoop::PREPARE, [&] { calls.push_back(3); }, -1);
+	auto d = runLoop->addCycleObserver(RunLoop::PREPARE, [&] { calls.push_back(4); });
+	std::shared_ptr<RunLoop::CycleObserver> added;
+	auto e = runLoop->addCycleObserver(RunLoop::PREPARE, [&] {
+		calls.push_back(5);
+		b->cancel();
+		if(not added)
+			added = runLoop->addCycleObserver(RunLoop::PREPARE, [&] { calls.push_back(6); runLoop->stop(); }, 10);
+	}, 1);
+
+	runLoop->doLater([] {}); // so the first cycle doesn't wait
+	runLoop->run(1.0);
+
+	// c, b, d, e, a; then b is canceled and the one e added runs last.
+	std::vector<int> expected { 3, 2, 4, 5, 1, 3, 4, 5, 1, 6 };
+	EXPECT_EQ(calls, expected);
+	EXPECT_TRUE(b->isCanceled());
+	EXPECT_FALSE(a->isCanceled());
+
+	runLoop->clear();
+	EXPECT_TRUE(a->isCanceled());
+}
+
+TEST_F(RunLoopTest, PrepareObserverAddedDuringPrepareDoesNotWait) {
+	Time added = -1;
+	Time ran = -1;
+	std::shared_ptr<RunLoop::CycleObserver> second;
+	auto first = runLoop->addCycleObserver(RunLoop::PREPARE, [&] {
+		if(second)
+			return;
+		added = runLoop->getCurrentTimeNoCache();
+		second = runLoop->addCycleObserver(RunLoop::PREPARE, [&] {
+			ran = runLoop->getCurrentTimeNoCache();
+			runLoop->stop();
+		});
+	});
+
+	runLoop->run(2.0); // nothing else to wake it up
+
+	ASSERT_GE(ran, 0);
+	EXPECT_LT(ran - added, 0.5);
+}
+
+TEST_F(RunLoopTest, CycleObserverPhases) {
+	int fds[2];
+	ASSERT_EQ(0, pipe(fds));
+
+	std::vector<std::string> calls;
+	runLoop->addCycleObserver(RunLoop::CHECK, [&] { calls.push_back("check"); });
+	runLoop->addCycleObserver(RunLoop::PREPARE, [&] {
+		calls.push_back("prepare");
+		if(calls.size() > 1)
+			runLoop->stop();
+	});
+	runLoop->registerDescriptor(fds[0], RunLoop::READABLE, [&] {
+		char buf[16];
+		if(::read(fds[0], buf, sizeof(buf)) > 0)
+			calls.push_back("read");
+		runLoop->doLater([&] { calls.push_back("later"); });
+	});
+	ASSERT_EQ(1, ::write(fds[1], "x", 1));
+
+	runLoop->run(1.0);
+
+	std::vector<std::string> expected { "prepare", "read", "check", "later", "prepare" };
+	EXPECT_EQ(calls, expected);
+
+	runLoop->unregisterDescriptor(fds[0]);
+	::close(fds[0]);
+	::close(fds[1]);
+}
+
 TEST_F(RunLoopTest, TimeFunctions) {
 	Time t1 = runLoop->getCurrentTime();
 	std::this_thread::sleep_for(std::chrono::milliseconds(10));
@@ -0,0 +1,1107 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <regex>
+#include <string>
+#include <vector>
+
+#include "zenomt/SimpleWebSocket.hpp"
+#include "zenomt/URIParse.hpp"
+
+using namespace com::zenomt;
+using namespace com::zenomt::websock;
+
+namespace {
+
+// an in-memory platform. the test decides when the stream is writable and when queued
+// bytes are sent.
+class MockStreamPlatformAdapter : public IStreamPlatformAdapter {
+public:
+	Time getCurrentTime() override { return m_now; }
+	void notifyWhenWritable(const onwritable_f &onwritable) override { m_onwritable = onwritable; }
+	void setOnReceiveBytesCallback(const onreceivebytes_f &onreceivebytes) override { m_onreceivebytes = onreceivebytes; }
+	bool isReceiveBufferWritable() override { return m_receiveBufferWritable; }
+	void setOnStreamDidCloseCallback(const Task &onstreamdidclose) override { m_onstreamdidclose = onstreamdidclose; }
+	void doLater(const Task &task) override { m_later.push_back(task); }
+
+	bool writeBytes(const void *bytes, size_t len) override
+	{
+		m_written.append((const char *)bytes, len);
+		m_queued += len;
+		return true;
+	}
+
+	bool writeSharedBytes(const std::shared_ptr<const void> &owner, const void *bytes, size_t len) override
+	{
+		m_shared.push_back(bytes);
+		return writeBytes(bytes, len);
+	}
+
+	size_t getQueuedByteCount(bool includeOS) override { return m_queued; }
+
+	void notifyWhenQueuedBelow(size_t threshold, const Task &task) override
+	{
+		m_queuedBelowThreshold = threshold;
+		m_onqueuedbelow = task;
+	}
+
+	void onClientClosed() override { m_clientClosed = true; }
+
+	// call onwritable up to count times
+	void pumpWritable(int count = 1)
+	{
+		while(m_onwritable and (count-- > 0))
+			if(not m_onwritable())
+				m_onwritable = nullptr;
+	}
+
+	// pretend len queued bytes were sent
+	void drain(size_t len)
+	{
+		m_queued -= std::min(len, m_queued);
+		if(m_onqueuedbelow and (m_queued <= m_queuedBelowThreshold))
+		{
+			Task task;
+			swap(task, m_onqueuedbelow);
+			task();
+		}
+	}
+
+	void runLater()
+	{
+		std::vector<Task> tasks;
+		swap(tasks, m_later);
+		for(auto it = tasks.begin(); it != tasks.end(); it++)
+			(*it)();
+	}
+
+	Time m_now { 0 };
+	onwritable_f m_onwritable;
+	onreceivebytes_f m_onreceivebytes;
+	bool m_receiveBufferWritable { false };
+	Task m_onstreamdidclose;
+	std::vector<Task> m_later;
+	std::string m_written;
+	std::vector<const void *> m_shared; // where writeSharedBytes() bytes were
+	size_t m_queued { 0 };
+	size_t m_queuedBelowThreshold { 0 };
+	Task m_onqueuedbelow;
+	bool m_clientClosed { false };
+};
+
+}
+
+class HeaderBodyStreamTest : public ::testing::Test {
+protected:
+	void SetUp() override {
+		platform = std::make_shared<MockStreamPlatformAdapter>();
+		stream = share_ref(new HeaderBodyStream(platform), false);
+		stream->init();
+	}
+
+	void TearDown() override {
+		stream->close();
+	}
+
+	std::shared_ptr<MockStreamPlatformAdapter> platform;
+	std::shared_ptr<HeaderBodyStream> stream;
+};
+
+TEST_F(HeaderBodyStreamTest, QueuedByteCountSpansLayers) {
+	stream->writeBytes(std::string(100, 'a'));
+	EXPECT_EQ(stream->getQueuedByteCount(), 100u);
+	EXPECT_EQ(platform->m_queued, 0u);
+
+	platform->pumpWritable();
+	EXPECT_EQ(platform->m_queued, 100u);
+	EXPECT_EQ(stream->getQueuedByteCount(), 100u);
+
+	stream->writeBytes(std::string(50, 'b'));
+	EXPECT_EQ(stream->getQueuedByteCount(), 150u);
+
+	platform->drain(100);
+	EXPECT_EQ(stream->getQueuedByteCount(), 50u);
+}
+
+TEST_F(HeaderBodyStreamTest, Watermarks) {
+	int highs = 0;
+	int lows = 0;
+	stream->onHighWatermark = [&] { highs++; };
+	stream->onLowWatermark = [&] { lows++; };
+	stream->setWatermarks(1000, 200);
+
+	stream->writeBytes(std::string(600, 'a'));
+	EXPECT_EQ(highs, 0);
+	stream->writeBytes(std::string(600, 'b'));
+	EXPECT_EQ(highs, 1);
+	EXPECT_TRUE(stream->isAboveHighWatermark());
+
+	stream->writeBytes(std::string(600, 'c'));
+	EXPECT_EQ(highs, 1); // only on crossing
+
+	platform->pumpWritable();
+	EXPECT_EQ(platform->m_queued, 1800u);
+	EXPECT_EQ(lows, 0);
+
+	platform->drain(1000);
+	EXPECT_EQ(lows, 0);
+	platform->drain(600);
+	EXPECT_EQ(lows, 1);
+	EXPECT_FALSE(stream->isAboveHighWatermark());
+
+	stream->writeBytes(std::string(1000, 'd'));
+	EXPECT_EQ(highs, 2);
+}
+
+TEST_F(HeaderBodyStreamTest, LowWatermarkWhenBufferHandedOffAlreadyDrained) {
+	int lows = 0;
+	stream->onLowWatermark = [&] { lows++; };
+	stream->setWatermarks(100, 0);
+
+	stream->writeBytes(std::string(150, 'a'));
+	EXPECT_TRUE(stream->isAboveHighWatermark());
+
+	// the platform sends immediately, so there's nothing queued anywhere after handoff.
+	platform->pumpWritable();
+	platform->drain(150);
+	EXPECT_EQ(lows, 1);
+}
+
+TEST_F(HeaderBodyStreamTest, HardCapDropsWholeWrites) {
+	stream->setMaxQueuedBytes(1000);
+
+	EXPECT_TRUE(stream->writeBytes(std::string(800, 'a')));
+	EXPECT_FALSE(stream->writeBytes(std::string(300, 'b')));
+	EXPECT_TRUE(stream->writeBytes(std::string(200, 'c')));
+	EXPECT_EQ(stream->getDroppedByteCount(), 300u);
+
+	platform->pumpWritable();
+	EXPECT_EQ(platform->m_written, std::string(800, 'a') + std::string(200, 'c'));
+
+	platform->drain(1000);
+	EXPECT_TRUE(stream->writeBytes(std::string(300, 'b')));
+}
+
+TEST_F(HeaderBodyStreamTest, HardCapCanAbandon) {
+	bool errored = false;
+	stream->onError = [&] { errored = true; };
+	stream->setMaxQueuedBytes(1000, HeaderBodyStream::OVERFLOW_CLOSE);
+
+	EXPECT_TRUE(stream->writeBytes(std::string(800, 'a')));
+	EXPECT_FALSE(stream->writeBytes(std::string(300, 'b')));
+	EXPECT_FALSE(errored); // not from inside writeBytes()
+	EXPECT_FALSE(stream->writeBytes(std::string(10, 'c')));
+
+	platform->runLater();
+	EXPECT_TRUE(errored);
+	EXPECT_TRUE(platform->m_clientClosed);
+	EXPECT_FALSE(stream->writeBytes(std::string(10, 'c')));
+}
+
+TEST_F(HeaderBodyStreamTest, HardCapAbandonOutlivesLastReference) {
+	int errors = 0;
+	stream->onError = [&] { errors++; };
+	stream->setMaxQueuedBytes(100, HeaderBodyStream::OVERFLOW_CLOSE);
+	platform->m_onreceivebytes = nullptr; // only the pending close still refers to the stream
+	platform->m_onstreamdidclose = nullptr;
+
+	EXPECT_FALSE(stream->writeBytes(std::string(300, 'a')));
+	EXPECT_FALSE(stream->writeBytes(std::string(300, 'b')));
+	stream.reset();
+	platform->runLater();
+	EXPECT_EQ(errors, 1);
+	EXPECT_TRUE(platform->m_clientClosed);
+	stream = share_ref(new HeaderBodyStream(platform), false); // for TearDown
+}
+
+TEST_F(HeaderBodyStreamTest, SharedBytesGoInOrderWithoutCopying) {
+	auto shared = std::make_shared<std::string>(5000, 's');
+	stream->writeBytes(std::string("before"));
+	EXPECT_TRUE(stream->writeSharedBytes(shared, shared->data(), shared->size(), "[", 1));
+	stream->writeBytes(std::string("after"));
+	EXPECT_EQ(stream->getQueuedByteCount(), 6u + 1 + 5000 + 5);
+
+	platform->pumpWritable();
+	EXPECT_EQ(platform->m_written, "before[" + *shared + "after");
+	ASSERT_EQ(platform->m_shared.size(), 1u);
+	EXPECT_EQ(platform->m_shared[0], shared->data());
+}
+
+TEST_F(HeaderBodyStreamTest, HardCapCountsSharedBytesAndPrefixTogether) {
+	stream->setMaxQueuedBytes(1000);
+	auto shared = std::make_shared<std::string>(998, 's');
+
+	EXPECT_FALSE(stream->writeSharedBytes(shared, shared->data(), shared->size(), "abc", 3));
+	EXPECT_EQ(stream->getDroppedByteCount(), 1001u);
+	EXPECT_EQ(stream->getQueuedByteCount(), 0u);
+	EXPECT_TRUE(stream->writeSharedBytes(shared, shared->data(), shared->size(), "ab", 2));
+}
+
+TEST_F(HeaderBodyStreamTest, TCPInfoFromPlatform) {
+	TCPInfo info;
+	EXPECT_FALSE(stream->getTCPInfo(&info)); // the mock doesn't have any
+}
+
+namespace {
+
+class TestHttpStream : public SimpleHttpStream {
+public:
+	using SimpleHttpStream::SimpleHttpStream;
+
+	const uint8_t * onBodyBytes(const uint8_t *bytes, const uint8_t *limit) override
+	{
+		m_body.append((const char *)bytes, limit - bytes);
+		return limit;
+	}
+
+	std::string m_body;
+};
+
+// the header block unfolded and split the slow obvious way, with lowercased names. answer
+// false if a field is malformed.
+bool referenceHeaders(const std::string &block, std::map<std::string, std::vector<std::string>> &headers)
+{
+	std::string tmp = std::regex_replace(block, std::regex("\r\n"), "\n");
+	tmp = std::regex_replace(tmp, std::regex("\r"), " ");
+	tmp = std::regex_replace(tmp, std::regex("\n[ \t]"), " ");
+
+	auto lines = URIParse::split(tmp, "\n");
+	for(size_t x = 1; x < lines.size(); x++)
+	{
+		if(lines[x].empty())
+			continue;
+		auto parts = URIParse::split(lines[x], ":", 2);
+		if((2 != parts.size()) or not SimpleHttpStream::isToken(parts[0]))
+			return false;
+		std::string value = parts[1];
+		value.erase(0, value.find_first_not_of(" \t\v\f"));
+		value.erase(value.find_last_not_of(" \t\v\f") + 1);
+		headers[URIParse::lowercase(parts[0])].push_back(value);
+	}
+	return true;
+}
+
+}
+
+class SimpleHttpStreamTest : public ::testing::Test {
+protected:
+	void SetUp() override {
+		platform = std::make_shared<MockStreamPlatformAdapter>();
+		http = share_ref(new TestHttpStream(platform), false);
+		headersReceived = 0;
+		http->onHttpHeadersReceived = [this] { headersReceived++; };
+		http->init();
+	}
+
+	void TearDown() override {
+		http->close();
+	}
+
+	void receive(const std::string &bytes, size_t piece = 4096)
+	{
+		for(size_t offset = 0; offset < bytes.size(); offset += piece)
+			platform->m_onreceivebytes(bytes.data() + offset, std::min(piece, bytes.size() - offset));
+	}
+
+	std::shared_ptr<MockStreamPlatformAdapter> platform;
+	std::shared_ptr<TestHttpStream> http;
+	int headersReceived { 0 };
+};
+
+TEST_F(SimpleHttpStreamTest, CaseInsensitiveLookups) {
+	receive(
+		"GET /chat HTTP/1.1\r\n"
+		"Host: example.com\r\n"
+		"X-Thing:   padded value \t\r\n"
+		"Set-Cookie: a=1\r\n"
+		"set-cookie: b=2\r\n"
+		"Empty:\r\n"
+		"\r\n"
+		"body bytes");
+
+	EXPECT_EQ(headersReceived, 1);
+	EXPECT_EQ(http->getStartLine(), "GET /chat HTTP/1.1");
+	EXPECT_EQ(http->getHeader("HOST"), "example.com");
+	EXPECT_EQ(http->getHeader("x-thing"), "padded value");
+	EXPECT_EQ(http->getHeader("Set-Cookie"), "a=1,b=2");
+	EXPECT_EQ(http->getHeaderValues("SET-COOKIE"), std::vector<std::string>({ "a=1", "b=2" }));
+	EXPECT_TRUE(http->hasHeader("empty"));
+	EXPECT_EQ(http->getHeader("empty"), "");
+	EXPECT_FALSE(http->hasHeader("hos"));
+	EXPECT_FALSE(http->hasHeader("hostt"));
+	EXPECT_TRUE(http->getHeaderValues("missing").empty());
+	EXPECT_EQ(http->m_body, "body bytes");
+
+	size_t len = 99;
+	const char *value = http->findHeader("SET-cookie", &len, 1);
+	ASSERT_TRUE(value);
+	EXPECT_EQ(std::string(value, len), "b=2");
+	EXPECT_EQ(http->findHeader("set-cookie", &len, 2), nullptr);
+}
+
+TEST_F(SimpleHttpStreamTest, FoldsBareLineEndingsAndSplitReads) {
+	receive(
+		"GET / HTTP/1.1\n"
+		"Folded: one\r\n two\n\tthree\r\n"
+		"Stray: a\rb\r\n"
+		"Last: x\n"
+		"\r\r\n"
+		"rest", 1);
+
+	EXPECT_EQ(headersReceived, 1);
+	EXPECT_EQ(http->getHeader("folded"), "one two three");
+	EXPECT_EQ(http->getHeader("stray"), "a b");
+	EXPECT_EQ(http->getHeader("last"), "x");
+	EXPECT_EQ(http->m_body, "rest");
+}
+
+TEST_F(SimpleHttpStreamTest, BadFieldNameCloses) {
+	receive("GET / HTTP/1.1\r\nBad Name: x\r\n\r\n");
+	EXPECT_EQ(headersReceived, 0);
+	EXPECT_TRUE(platform->m_clientClosed);
+}
+
+TEST_F(SimpleHttpStreamTest, MatchesReferenceParse) {
+	const char *pieces[] = { "Name", "name", "X-A", ":", " ", "\t", "\r", "\n", "\r\n", "v", "a b", "@", "" };
+	uint32_t state = 7;
+	auto next = [&] { state = state * 1103515245 + 12345; return state >> 8; };
+
+	for(int round = 0; round < 2000; round++)
+	{
+		std::string block = "GET / HTTP/1.1\r\n";
+		for(int fields = next() % 6; fields > 0; fields--)
+		{
+			for(int each = 1 + next() % 6; each > 0; each--)
+				block += pieces[next() % (sizeof(pieces) / sizeof(pieces[0]))];
+			block += "\r\n";
+		}
+
+		// only up to the first blank line, as the stream would see it.
+		std::string terminated = std::regex_replace(block + "\r\n", std::regex("\n\r*\n[^]*"), "\n\n",
+			std::regex_constants::format_first_only);
+		std::map<std::string, std::vector<std::string>> expected;
+		bool valid = referenceHeaders(terminated, expected);
+
+		receive(block + "\r\n", 1 + next() % 8);
+		ASSERT_EQ(headersReceived, valid ? 1 : 0) << round;
+		for(auto it = expected.begin(); it != expected.end(); it++)
+			ASSERT_EQ(http->getHeaderValues(it->first), it->second) << round << " " << it->first;
+
+		TearDown();
+		SetUp();
+	}
+}
+
+namespace {
+
+class TestWebSocket : public SimpleWebSocket {
+public:
+	using SimpleWebSocket::SimpleWebSocket;
+	void sha1(void *dst, const void *msg, size_t len) override { memset(dst, 0, 20); }
+};
+
+// a masked client frame, as a browser would send it.
+std::string makeClientFrame(int opcode, const std::string &payload, bool fin = true)
+{
+	const uint8_t key[4] = { 0x11, 0x22, 0x33, 0x44 };
+	std::string rv;
+	rv.push_back(char((fin ? 0x80 : 0) | opcode));
+	size_t len = payload.size();
+	if(len > 65535)
+	{
+		rv.push_back(char(0x80 | 127));
+		for(int shift = 56; shift >= 0; shift -= 8)
+			rv.push_back(char((len >> shift) & 0xff));
+	}
+	else if(len > 125)
+	{
+		rv.push_back(char(0x80 | 126));
+		rv.push_back(char(len >> 8));
+		rv.push_back(char(len & 0xff));
+	}
+	else
+		rv.push_back(char(0x80 | len));
+	rv.append((const char *)key, 4);
+	for(size_t x = 0; x < len; x++)
+		rv.push_back(char(payload[x] ^ key[x % 4]));
+	return rv;
+}
+
+}
+
+class SimpleWebSocketTest : public ::testing::Test {
+protected:
+	void SetUp() override {
+		platform = std::make_shared<MockStreamPlatformAdapter>();
+		ws = share_ref(new TestWebSocket(platform), false);
+		ws->onOpen = [this] { opened = true; };
+		ws->onBinaryMessage = [this] (const uint8_t *bytes, size_t len) { messages.push_back(std::string(bytes, bytes + len)); };
+		ws->onTextMessage = [this] (const std::string &message) { messages.push_back(message); };
+		prepare();
+		ws->init();
+
+		receive(
+			"GET /chat HTTP/1.1\r\n"
+			"Host: example.com\r\n"
+			"Upgrade: websocket\r\n"
+			"Connection: Upgrade\r\n"
+			"Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n"
+			"Sec-WebSocket-Version: 13\r\n"
+			+ extraHeaders +
+			"\r\n");
+		ASSERT_TRUE(opened);
+	}
+
+	void TearDown() override {
+		ws->close();
+	}
+
+	void receive(const std::string &bytes)
+	{
+		ASSERT_TRUE(platform->m_onreceivebytes);
+		platform->m_onreceivebytes(bytes.data(), bytes.size());
+	}
+
+	virtual void prepare() {}
+
+	std::string extraHeaders;
+	std::shared_ptr<MockStreamPlatformAdapter> platform;
+	std::shared_ptr<TestWebSocket> ws;
+	bool opened = false;
+	std::vector<std::string> messages;
+};
+
+TEST_F(SimpleWebSocketTest, MaskedFramesOfEachLengthEncoding) {
+	std::string small = "hello";
+	std::string medium(1000, 'm');
+	std::string large(70000, 0);
+	for(size_t x = 0; x < large.size(); x++)
+		large[x] = char(x * 7);
+
+	receive(makeClientFrame(0x2, small) + makeClientFrame(0x1, medium));
+	receive(makeClientFrame(0x2, large));
+
+	ASSERT_EQ(messages.size(), 3u);
+	EXPECT_EQ(messages[0], small);
+	EXPECT_EQ(messages[1], medium);
+	EXPECT_EQ(messages[2], large);
+}
+
+TEST_F(SimpleWebSocketTest, FrameSplitAcrossReads) {
+	std::string payload(300, 0);
+	for(size_t x = 0; x < payload.size(); x++)
+		payload[x] = char(x);
+	std::string frame = makeClientFrame(0x2, payload);
+
+	for(size_t x = 0; x < frame.size(); x += 7)
+		receive(frame.substr(x, 7));
+
+	ASSERT_EQ(messages.size(), 1u);
+	EXPECT_EQ(messages[0], payload);
+}
+
+TEST_F(SimpleWebSocketTest, FragmentedMessage) {
+	receive(makeClientFrame(0x2, "frag", false) + makeClientFrame(0x0, "men", false));
+	EXPECT_TRUE(messages.empty());
+	receive(makeClientFrame(0x0, "ted"));
+
+	ASSERT_EQ(messages.size(), 1u);
+	EXPECT_EQ(messages[0], "fragmented");
+}
+
+TEST_F(SimpleWebSocketTest, UnmasksInPlaceWhenReceiveBufferIsWritable) {
+	platform->m_receiveBufferWritable = true;
+	std::vector<const uint8_t *> where;
+	ws->onBinaryMessage = [&] (const uint8_t *bytes, size_t len) {
+		where.push_back(bytes);
+		messages.push_back(std::string(bytes, bytes + len));
+	};
+
+	std::string first = makeClientFrame(0x2, "in place");
+	std::string second = makeClientFrame(0x2, "then buffered");
+	std::string wire = first + second;
+	std::vector<uint8_t> buffer(wire.begin(), wire.end() - 3); // second frame incomplete
+	platform->m_onreceivebytes(buffer.data(), buffer.size());
+
+	ASSERT_EQ(messages.size(), 1u);
+	EXPECT_EQ(messages[0], "in place");
+	EXPECT_EQ(where[0], buffer.data() + first.size() - 8); // delivered from the receive buffer
+
+	receive(wire.substr(wire.size() - 3));
+	ASSERT_EQ(messages.size(), 2u);
+	EXPECT_EQ(messages[1], "then buffered");
+}
+
+TEST_F(SimpleWebSocketTest, LeavesReadOnlyReceiveBufferAlone) {
+	const std::string wire = makeClientFrame(0x2, "copied") + makeClientFrame(0x1, "too");
+	std::vector<uint8_t> buffer(wire.begin(), wire.end());
+	platform->m_onreceivebytes(buffer.data(), buffer.size());
+
+	ASSERT_EQ(messages.size(), 2u);
+	EXPECT_EQ(messages[0], "copied");
+	EXPECT_EQ(messages[1], "too");
+	EXPECT_EQ(0, memcmp(buffer.data(), wire.data(), wire.size()));
+}
+
+TEST_F(SimpleWebSocketTest, ManyFramesInOddSizedReads) {
+	std::string wire;
+	std::vector<std::string> expected;
+	for(size_t x = 0; x < 40; x++)
+	{
+		std::string payload((x * 997) % 3000, char('a' + x % 26));
+		if(x == 20)
+			payload.assign(200000, 'B'); // big enough to presize for
+		expected.push_back(payload);
+		wire += makeClientFrame(0x2, payload);
+	}
+
+	size_t offset = 0;
+	for(size_t each = 1; offset < wire.size(); each = (each * 5 + 3) % 4099)
+	{
+		size_t len = std::min(each, wire.size() - offset);
+		receive(wire.substr(offset, len));
+		offset += len;
+	}
+
+	EXPECT_EQ(messages, expected);
+}
+
+TEST_F(SimpleWebSocketTest, SharedBinaryMessageIsNotCopied) {
+	platform->pumpWritable(); // the handshake response
+	platform->m_written.clear();
+
+	auto payload = std::make_shared<Bytes>(70000);
+	for(size_t x = 0; x < payload->size(); x++)
+		(*payload)[x] = uint8_t(x);
+	ws->sendBinaryMessage(payload);
+	ws->sendBinaryMessage(std::make_shared<Bytes>(10, 'x')); // small, just copied
+	platform->pumpWritable();
+
+	ASSERT_EQ(platform->m_shared.size(), 1u);
+	EXPECT_EQ(platform->m_shared[0], payload->data());
+
+	const uint8_t header[] = { 0x82, 127, 0, 0, 0, 0, 0, 1, 0x11, 0x70 };
+	std::string expected((const char *)header, sizeof(header));
+	expected.append(payload->begin(), payload->end());
+	expected += "\x82\x0a" + std::string(10, 'x');
+	EXPECT_EQ(platform->m_written, expected);
+}
+
+TEST_F(SimpleWebSocketTest, SharedFrameOnManySockets) {
+	auto other = share_ref(new TestWebSocket(platform), false); // same platform, so output lines up
+	std::string payload(3000, 'f');
+	auto frame = share_ref(new WebSocketFrame(payload.data(), payload.size()), false);
+	EXPECT_FALSE(frame->isText());
+	EXPECT_EQ(frame->getEncodedLength(), 4 + payload.size());
+	EXPECT_EQ(0, memcmp(frame->getPayload(), payload.data(), payload.size()));
+
+	platform->pumpWritable(); // the handshake response
+	platform->m_written.clear();
+
+	ws->sendFrame(frame);
+	ws->sendFrame(share_ref(new WebSocketFrame("hi"), false)); // small, just copied
+	platform->pumpWritable();
+	other->init(); // not reading anything, just for its output
+	other->sendFrame(frame);
+	platform->pumpWritable();
+
+	ASSERT_EQ(platform->m_shared.size(), 2u);
+	EXPECT_EQ(platform->m_shared[0], frame->getEncoded());
+	EXPECT_EQ(platform->m_shared[1], frame->getEncoded());
+
+	std::string encoded = std::string("\x82\x7e\x0b\xb8", 4) + payload;
+	EXPECT_EQ(platform->m_written, encoded + "\x81\x02" "hi" + encoded);
+	other->close();
+}
+
+TEST_F(SimpleWebSocketTest, DefaultRandomBytes) {
+	uint8_t a[16], b[16];
+	ws->randomBytes(a, sizeof(a));
+	ws->randomBytes(b, sizeof(b));
+	EXPECT_NE(0, memcmp(a, b, sizeof(a)));
+
+	// across refills of the buffer, and nothing left as zeros.
+	std::vector<uint8_t> many(5000);
+	for(size_t x = 0; x < many.size(); x += 7)
+		ws->randomBytes(many.data() + x, std::min(size_t(7), many.size() - x));
+	std::vector<bool> seen(256);
+	size_t zeroRun = 0, longestZeroRun = 0;
+	for(auto it = many.begin(); it != many.end(); it++)
+	{
+		seen[*it] = true;
+		zeroRun = *it ? 0 : zeroRun + 1;
+		longestZeroRun = std::max(longestZeroRun, zeroRun);
+	}
+	EXPECT_GT(std::count(seen.begin(), seen.end(), true), 240);
+	EXPECT_LT(longestZeroRun, 4u);
+}
+
+TEST_F(SimpleWebSocketTest, HeaderLengthEncodings) {
+	platform->pumpWritable();
+	platform->m_written.clear();
+
+	ws->sendTextMessage(std::string(125, 'a'));
+	ws->sendTextMessage(std::string(126, 'b'));
+	ws->sendBinaryMessage(Bytes(65536, 'c'));
+	platform->pumpWritable();
+
+	std::string expected = "\x81\x7d" + std::string(125, 'a');
+	expected += std::string("\x81\x7e\x00\x7e", 4) + std::string(126, 'b');
+	expected += std::string("\x82\x7f\x00\x00\x00\x00\x00\x01\x00\x00", 10) + std::string(65536, 'c');
+	EXPECT_EQ(platform->m_written, expected);
+}
+
+TEST_F(SimpleWebSocketTest, StreamsPiecesAsFramesArrive) {
+	std::vector<std::string> events;
+	ws->onMessageBegin = [&] (bool isText) { events.push_back(isText ? "text" : "binary"); };
+	ws->onMessageData = [&] (const uint8_t *bytes, size_t len) { events.push_back(std::string(bytes, bytes + len)); };
+	ws->onMessageEnd = [&] { events.push_back("end"); };
+
+	std::string payload(1000, 0);
+	for(size_t x = 0; x < payload.size(); x++)
+		payload[x] = char('a' + x % 26);
+	std::string frame = makeClientFrame(0x2, payload);
+
+	receive(frame.substr(0, 3)); // not even the whole header
+	EXPECT_TRUE(events.empty());
+	receive(frame.substr(3, 300));
+	ASSERT_EQ(events.size(), 2u);
+	EXPECT_EQ(events[0], "binary");
+	EXPECT_EQ(events[1], payload.substr(0, 295)); // without waiting for the rest
+
+	platform->m_receiveBufferWritable = true;
+	std::vector<uint8_t> rest(frame.begin() + 303, frame.end());
+	platform->m_onreceivebytes(rest.data(), rest.size()); // unmasked in place, key lined up
+	ASSERT_EQ(events.size(), 4u);
+	EXPECT_EQ(events[2], payload.substr(295));
+	EXPECT_EQ(events[3], "end");
+
+	events.clear();
+	receive(makeClientFrame(0x1, "frag", false) + makeClientFrame(0x9, "ping") + makeClientFrame(0x0, "", false) + makeClientFrame(0x0, "ment"));
+	EXPECT_EQ(events, std::vector<std::string>({ "text", "frag", "ment", "end" }));
+	EXPECT_TRUE(messages.empty());
+}
+
+TEST_F(SimpleWebSocketTest, MessageTooBigFailsFromTheHeader) {
+	platform->pumpWritable();
+	platform->m_written.clear();
+	ws->setMaxMessageSize(1000);
+
+	receive(makeClientFrame(0x2, std::string(1000, 'k')));
+	ASSERT_EQ(messages.size(), 1u);
+
+	receive(makeClientFrame(0x2, std::string(1001, 'x')).substr(0, 8));
+	EXPECT_EQ(messages.size(), 1u);
+	receive(makeClientFrame(0x2, "ignored"));
+	EXPECT_EQ(messages.size(), 1u);
+
+	platform->pumpWritable(2);
+	EXPECT_EQ(platform->m_written, std::string("\x88\x02\x03\xf1", 4)); // 1009
+	EXPECT_TRUE(platform->m_clientClosed); // once that went out
+}
+
+TEST_F(SimpleWebSocketTest, FragmentsAddUpToTooBig) {
+	ws->setMaxMessageSize(1000);
+	receive(makeClientFrame(0x2, std::string(600, 'a'), false));
+	EXPECT_FALSE(platform->m_clientClosed);
+	receive(makeClientFrame(0x0, std::string(401, 'b')));
+	EXPECT_TRUE(messages.empty());
+	platform->pumpWritable(3);
+	EXPECT_TRUE(platform->m_clientClosed);
+}
+
+TEST_F(SimpleWebSocketTest, StreamedMessageTooBig) {
+	size_t received = 0;
+	ws->onMessageData = [&] (const uint8_t *bytes, size_t len) { received += len; };
+	ws->setMaxMessageSize(1000);
+	receive(makeClientFrame(0x2, std::string(600, 'a'), false) + makeClientFrame(0x0, std::string(401, 'b')));
+	EXPECT_EQ(received, 600u);
+	platform->pumpWritable(3);
+	EXPECT_TRUE(platform->m_clientClosed);
+}
+
+TEST_F(SimpleWebSocketTest, LongOrFragmentedControlFrameFails) {
+	receive(makeClientFrame(0x9, std::string(126, 'p')));
+	EXPECT_TRUE(platform->m_clientClosed);
+}
+
+TEST_F(SimpleWebSocketTest, CleanCloseWithCode) {
+	platform->pumpWritable();
+	platform->m_written.clear();
+	ws->cleanClose(SimpleWebSocket::CLOSE_GOING_AWAY, "bye");
+	platform->pumpWritable();
+	EXPECT_EQ(platform->m_written, std::string("\x88\x05\x03\xe9" "bye", 7));
+}
+
+TEST_F(SimpleWebSocketTest, InvalidTextFails) {
+	platform->pumpWritable();
+	platform->m_written.clear();
+
+	receive(makeClientFrame(0x1, "caf\xc3\xa9") + makeClientFrame(0x2, "\xff binary is fine"));
+	ASSERT_EQ(messages.size(), 2u);
+
+	receive(makeClientFrame(0x1, "bad \xed\xa0\x80 surrogate") + makeClientFrame(0x1, "ignored"));
+	EXPECT_EQ(messages.size(), 2u);
+	platform->pumpWritable(2);
+	EXPECT_EQ(platform->m_written, std::string("\x88\x02\x03\xef", 4)); // 1007
+	EXPECT_TRUE(platform->m_clientClosed);
+}
+
+TEST_F(SimpleWebSocketTest, TextCheckedAcrossFragments) {
+	receive(makeClientFrame(0x1, "caf\xc3", false) + makeClientFrame(0x0, "\xa9 \xe2\x82", false) + makeClientFrame(0x0, "\xac"));
+	ASSERT_EQ(messages.size(), 1u);
+	EXPECT_EQ(messages[0], "caf\xc3\xa9 \xe2\x82\xac");
+
+	receive(makeClientFrame(0x1, "unfinished \xc3", false) + makeClientFrame(0x0, ""));
+	EXPECT_EQ(messages.size(), 1u);
+	platform->pumpWritable(3);
+	EXPECT_TRUE(platform->m_clientClosed);
+}
+
+TEST_F(SimpleWebSocketTest, BadFragmentFailsWithoutWaitingForTheRest) {
+	receive(makeClientFrame(0x1, "ok", false) + makeClientFrame(0x0, "\xc0\xaf", false));
+	platform->pumpWritable(3);
+	EXPECT_TRUE(platform->m_clientClosed);
+}
+
+TEST_F(SimpleWebSocketTest, StreamedTextChecked) {
+	std::string received;
+	bool ended = false;
+	ws->onMessageData = [&] (const uint8_t *bytes, size_t len) { received.append((const char *)bytes, len); };
+	ws->onMessageEnd = [&] { ended = true; };
+
+	std::string frame = makeClientFrame(0x1, "\xe4\xb8\xad\xe6\x96\x87");
+	for(size_t x = 0; x < frame.size(); x++)
+		receive(frame.substr(x, 1));
+	EXPECT_TRUE(ended);
+	EXPECT_EQ(received, "\xe4\xb8\xad\xe6\x96\x87");
+
+	ended = false;
+	receive(makeClientFrame(0x1, "fine so far \xe4", false));
+	receive(makeClientFrame(0x0, "\xb8"));
+	EXPECT_FALSE(ended); // still unfinished
+	platform->pumpWritable(3);
+	EXPECT_TRUE(platform->m_clientClosed);
+}
+
+namespace {
+
+// "compresses" by reversing the bytes.
+class ReverseCompression : public WebSocketCompression {
+public:
+	std::string negotiate(const std::string &offers) override
+	{
+		return std::string::npos == offers.find("x-reverse") ? "" : "x-reverse";
+	}
+
+	bool compress(const uint8_t *bytes, size_t len, Bytes &dst) override
+	{
+		dst.assign(bytes, bytes + len);
+		std::reverse(dst.begin(), dst.end());
+		return len > 2;
+	}
+
+	bool decompress(const uint8_t *bytes, size_t len, Bytes &dst, size_t maxLen) override
+	{
+		dst.assign(bytes, bytes + len);
+		std::reverse(dst.begin(), dst.end());
+		return len <= maxLen;
+	}
+
+	std::string offer() override { return "x-reverse"; }
+	bool accept(const std::string &response) override { return 0 == response.compare("x-reverse"); }
+};
+
+}
+
+class CompressedWebSocketTest : public SimpleWebSocketTest {
+protected:
+	void prepare() override {
+		extraHeaders = "Sec-WebSocket-Extensions: x-reverse\r\n";
+		ws->setCompression(share_ref(new ReverseCompression(), false));
+	}
+};
+
+TEST_F(CompressedWebSocketTest, Negotiated) {
+	EXPECT_TRUE(ws->isCompressing());
+	platform->pumpWritable();
+	EXPECT_NE(std::string::npos, platform->m_written.find("\r\nSec-WebSocket-Extensions: x-reverse\r\n"));
+}
+
+TEST_F(CompressedWebSocketTest, ReceiveCompressedAndNot) {
+	receive(makeClientFrame(0x40 | 0x1, "olleh") + makeClientFrame(0x2, "plain"));
+	receive(makeClientFrame(0x40 | 0x2, "ged", false) + makeClientFrame(0x0, "cba"));
+
+	ASSERT_EQ(messages.size(), 3u);
+	EXPECT_EQ(messages[0], "hello");
+	EXPECT_EQ(messages[1], "plain");
+	EXPECT_EQ(messages[2], "abcdeg");
+}
+
+TEST_F(CompressedWebSocketTest, SendCompressesDataFramesOnly) {
+	platform->pumpWritable();
+	platform->m_written.clear();
+
+	ws->sendTextMessage("abc");
+	ws->sendBinaryMessage(Bytes(2, 'x')); // ReverseCompression declines this
+	receive(makeClientFrame(0x9, "ping"));
+	platform->pumpWritable();
+
+	EXPECT_EQ(platform->m_written, "\xc1\x03" "cba" "\x82\x02" "xx" "\x8a\x04" "ping");
+}
+
+TEST_F(CompressedWebSocketTest, InvalidTextAfterDecompressingFails) {
+	receive(makeClientFrame(0x40 | 0x1, "\xa9\xc3"));
+	receive(makeClientFrame(0x40 | 0x1, "\xc3\xa9"));
+	ASSERT_EQ(messages.size(), 1u);
+	EXPECT_EQ(messages[0], "\xc3\xa9");
+	platform->pumpWritable(3);
+	EXPECT_TRUE(platform->m_clientClosed);
+}
+
+TEST_F(CompressedWebSocketTest, RSV1OnControlOrContinuationFails) {
+	receive(makeClientFrame(0x2, "frag", false) + makeClientFrame(0x40 | 0x0, "ment"));
+	EXPECT_TRUE(platform->m_clientClosed);
+}
+
+TEST_F(SimpleWebSocketTest, RSV1WithoutCompressionFails) {
+	receive(makeClientFrame(0x40 | 0x2, "what"));
+	EXPECT_TRUE(messages.empty());
+	EXPECT_TRUE(platform->m_clientClosed);
+}
+
+TEST_F(SimpleWebSocketTest, CompressionDroppedIfNotOffered) {
+	EXPECT_FALSE(ws->isCompressing());
+	ws->setCompression(share_ref(new ReverseCompression(), false)); // too late
+	EXPECT_FALSE(ws->isCompressing());
+}
+
+namespace {
+
+// masking keys and the handshake nonce are predictable, so the frames are too.
+class TestClientWebSocket : public TestWebSocket {
+public:
+	using TestWebSocket::TestWebSocket;
+	void randomBytes(void *dst, size_t len) override
+	{
+		for(size_t x = 0; x < len; x++)
+			((uint8_t *)dst)[x] = m_next++;
+	}
+	uint8_t m_next { 1 };
+};
+
+const char *ACCEPT_RESPONSE =
+	"HTTP/1.1 101 Switching Protocols\r\n"
+	"Upgrade: websocket\r\n"
+	"Connection: Upgrade\r\n"
+	"Sec-WebSocket-Accept: AAAAAAAAAAAAAAAAAAAAAAAAAAA=\r\n"; // TestWebSocket's sha1 is all zeros
+
+}
+
+class ClientWebSocketTest : public ::testing::Test {
+protected:
+	void SetUp() override {
+		platform = std::make_shared<MockStreamPlatformAdapter>();
+		ws = share_ref(new TestClientWebSocket(platform), false);
+		ws->onOpen = [this] { opened = true; };
+		ws->onTextMessage = [this] (const std::string &message) { messages.push_back(message); };
+		ws->onBinaryMessage = [this] (const uint8_t *bytes, size_t len) { messages.push_back(std::string(bytes, bytes + len)); };
+	}
+
+	void TearDown() override {
+		ws->close();
+	}
+
+	void start(const std::string &responseHeaders = ACCEPT_RESPONSE)
+	{
+		ASSERT_TRUE(ws->initClient("example.com:8080", "/chat", "Origin: http://example.com\r\n"));
+		platform->pumpWritable();
+		request = platform->m_written;
+		platform->m_written.clear();
+		receive(responseHeaders + "\r\n");
+	}
+
+	void receive(const std::string &bytes)
+	{
+		ASSERT_TRUE(platform->m_onreceivebytes);
+		platform->m_onreceivebytes(bytes.data(), bytes.size());
+	}
+
+	std::shared_ptr<MockStreamPlatformAdapter> platform;
+	std::shared_ptr<TestClientWebSocket> ws;
+	bool opened = false;
+	std::string request;
+	std::vector<std::string> messages;
+};
+
+TEST_F(ClientWebSocketTest, Handshake) {
+	start();
+	EXPECT_TRUE(opened);
+	EXPECT_TRUE(ws->isClient());
+	EXPECT_EQ(request,
+		"GET /chat HTTP/1.1\r\n"
+		"Host: example.com:8080\r\n"
+		"Upgrade: websocket\r\n"
+		"Connection: Upgrade\r\n"
+		"Sec-WebSocket-Key: AQIDBAUGBwgJCgsMDQ4PEA==\r\n"
+		"Sec-WebSocket-Version: 13\r\n"
+		"Origin: http://example.com\r\n"
+		"\r\n");
+}
+
+TEST_F(ClientWebSocketTest, BadAcceptFails) {
+	start(
+		"HTTP/1.1 101 Switching Protocols\r\n"
+		"Upgrade: websocket\r\n"
+		"Connection: Upgrade\r\n"
+		"Sec-WebSocket-Accept: s3pPLMBiTxaQ9kYGzzhZRbK+xOo=\r\n");
+	EXPECT_FALSE(opened);
+	EXPECT_TRUE(platform->m_clientClosed);
+}
+
+TEST_F(ClientWebSocketTest, NotSwitchingFails) {
+	start("HTTP/1.1 200 OK\r\nContent-Length: 0\r\n");
+	EXPECT_FALSE(opened);
+	EXPECT_TRUE(platform->m_clientClosed);
+}
+
+TEST_F(ClientWebSocketTest, UnofferedExtensionFails) {
+	start(std::string(ACCEPT_RESPONSE) + "Sec-WebSocket-Extensions: permessage-deflate\r\n");
+	EXPECT_FALSE(opened);
+	EXPECT_TRUE(platform->m_clientClosed);
+}
+
+TEST_F(ClientWebSocketTest, SendsMaskedFrames) {
+	start();
+	ws->m_next = 0xa0;
+	ws->sendTextMessage("hello");
+	ws->sendBinaryMessage(std::make_shared<Bytes>(2000, 'z')); // masked, so not shared
+	platform->pumpWritable();
+
+	const uint8_t key1[4] = { 0xa0, 0xa1, 0xa2, 0xa3 };
+	std::string expected = "\x81\x85" + std::string((const char *)key1, 4);
+	for(size_t x = 0; x < 5; x++)
+		expected.push_back(char("hello"[x] ^ key1[x % 4]));
+
+	const uint8_t key2[4] = { 0xa4, 0xa5, 0xa6, 0xa7 };
+	expected += std::string("\x82\xfe\x07\xd0", 4) + std::string((const char *)key2, 4);
+	for(size_t x = 0; x < 2000; x++)
+		expected.push_back(char('z' ^ key2[x % 4]));
+
+	EXPECT_EQ(platform->m_written, expected);
+	EXPECT_TRUE(platform->m_shared.empty());
+}
+
+TEST_F(ClientWebSocketTest, SharedFrameIsMaskedCopy) {
+	start();
+	ws->m_next = 0x10;
+	std::string payload(2000, 'q');
+	ws->sendFrame(share_ref(new WebSocketFrame(payload.data(), payload.size()), false));
+	platform->pumpWritable();
+
+	EXPECT_TRUE(platform->m_shared.empty());
+	ASSERT_EQ(platform->m_written.size(), 8 + payload.size());
+	EXPECT_EQ(platform->m_written.substr(0, 8), std::string("\x82\xfe\x07\xd0\x10\x11\x12\x13", 8));
+	EXPECT_EQ(uint8_t(platform->m_written[8]), 'q' ^ 0x10);
+}
+
+TEST_F(ClientWebSocketTest, ReceivesUnmaskedFramesOnly) {
+	start();
+	receive("\x81\x02hi");
+	ASSERT_EQ(messages.size(), 1u);
+	EXPECT_EQ(messages[0], "hi");
+
+	receive(makeClientFrame(0x1, "masked"));
+	EXPECT_EQ(messages.size(), 1u);
+	EXPECT_TRUE(platform->m_clientClosed);
+}
+
+TEST_F(ClientWebSocketTest, NegotiatesCompression) {
+	ws->setCompression(share_ref(new ReverseCompression(), false));
+	start(std::string(ACCEPT_RESPONSE) + "Sec-WebSocket-Extensions: x-reverse\r\n");
+	EXPECT_NE(std::string::npos, request.find("\r\nSec-WebSocket-Extensions: x-reverse\r\n"));
+	ASSERT_TRUE(opened);
+	EXPECT_TRUE(ws->isCompressing());
+
+	receive("\xc1\x03" "cba");
+	ASSERT_EQ(messages.size(), 1u);
+	EXPECT_EQ(messages[0], "abc");
+}
+
+TEST_F(ClientWebSocketTest, CompressionDroppedIfDeclined) {
+	ws->setCompression(share_ref(new ReverseCompression(), false));
+	start();
+	ASSERT_TRUE(opened);
+	EXPECT_FALSE(ws->isCompressing());
+}
+
+TEST_F(CompressedWebSocketTest, SharedFrameSentUncompressed) {
+	platform->pumpWritable();
+	platform->m_written.clear();
+	ws->sendFrame(share_ref(new WebSocketFrame(std::string("plain")), false));
+	platform->pumpWritable();
+	EXPECT_EQ(platform->m_written, "\x81\x05" "plain");
+
+	// a client masks its copy, but still doesn't compress it.
+	auto clientPlatform = std::make_shared<MockStreamPlatformAdapter>();
+	auto client = share_ref(new TestClientWebSocket(clientPlatform), false);
+	client->setCompression(share_ref(new ReverseCompression(), false));
+	ASSERT_TRUE(client->initClient("example.com", "/"));
+	clientPlatform->pumpWritable();
+	clientPlatform->m_written.clear();
+	std::string response = std::string(ACCEPT_RESPONSE) + "Sec-WebSocket-Extensions: x-reverse\r\n\r\n";
+	clientPlatform->m_onreceivebytes(response.data(), response.size());
+	ASSERT_TRUE(client->isCompressing());
+
+	client->m_next = 0x30;
+	client->sendFrame(share_ref(new WebSocketFrame(std::string("plain")), false));
+	clientPlatform->pumpWritable();
+	const uint8_t key[4] = { 0x30, 0x31, 0x32, 0x33 };
+	std::string expected = "\x81\x85" + std::string((const char *)key, 4);
+	for(size_t x = 0; x < 5; x++)
+		expected.push_back(char("plain"[x] ^ key[x % 4]));
+	EXPECT_EQ(clientPlatform->m_written, expected);
+	client->close();
+}
+
+TEST(ClientServerWebSocketTest, TalkToEachOther) {
+	auto clientPlatform = std::make_shared<MockStreamPlatformAdapter>();
+	auto serverPlatform = std::make_shared<MockStreamPlatformAdapter>();
+	auto client = share_ref(new TestClientWebSocket(clientPlatform), false);
+	auto server = share_ref(new TestWebSocket(serverPlatform), false);
+	std::vector<std::string> toClient, toServer;
+
+	client->onTextMessage = [&] (const std::string &message) { toClient.push_back(message); };
+	server->onTextMessage = [&] (const std::string &message) {
+		toServer.push_back(message);
+		server->sendTextMessage("echo " + message);
+	};
+	server->init();
+	client->initClient("localhost", "/");
+
+	auto shuttle = [&] {
+		for(int x = 0; x < 4; x++)
+		{
+			clientPlatform->pumpWritable();
+			serverPlatform->m_onreceivebytes(clientPlatform->m_written.data(), clientPlatform->m_written.size());
+			clientPlatform->m_written.clear();
+			serverPlatform->pumpWritable();
+			clientPlatform->m_onreceivebytes(serverPlatform->m_written.data(), serverPlatform->m_written.size());
+			serverPlatform->m_written.clear();
+		}
+	};
+
+	shuttle();
+	client->sendTextMessage("one");
+	client->sendTextMessage(std::string(300, 't'));
+	shuttle();
+
+	EXPECT_EQ(toServer, std::vector<std::string>({ "one", std::string(300, 't') }));
+	EXPECT_EQ(toClient, std::vector<std::string>({ "echo one", "echo " + std::string(300, 't') }));
+	EXPECT_FALSE(clientPlatform->m_clientClosed);
+	EXPECT_FALSE(serverPlatform->m_clientClosed);
+
+	client->close();
+	server->close();
+}
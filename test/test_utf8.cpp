@@ -0,0 +1,164 @@
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+
+#include "zenomt/Utf8.hpp"
+
+using namespace com::zenomt;
+
+namespace {
+
+const Utf8Implementation IMPLEMENTATIONS[] = { UTF8_SCALAR, UTF8_SSSE3, UTF8_AVX2 };
+
+// decode and check each code point, the slow obvious way.
+bool referenceValid(const std::string &s)
+{
+	size_t x = 0;
+	while(x < s.size())
+	{
+		uint8_t c = s[x];
+		size_t need;
+		uint32_t cp;
+		if(c < 0x80) { need = 1; cp = c; }
+		else if((c & 0xe0) == 0xc0) { need = 2; cp = c & 0x1f; }
+		else if((c & 0xf0) == 0xe0) { need = 3; cp = c & 0x0f; }
+		else if((c & 0xf8) == 0xf0) { need = 4; cp = c & 0x07; }
+		else return false;
+
+		if(s.size() - x < need)
+			return false;
+		for(size_t each = 1; each < need; each++)
+		{
+			uint8_t cont = s[x + each];
+			if((cont & 0xc0) != 0x80)
+				return false;
+			cp = (cp << 6) | (cont & 0x3f);
+		}
+
+		const uint32_t minimum[5] = { 0, 0, 0x80, 0x800, 0x10000 };
+		if((cp < minimum[need]) or (cp > 0x10ffff) or ((cp >= 0xd800) and (cp <= 0xdfff)))
+			return false;
+		x += need;
+	}
+	return true;
+}
+
+std::string sampleText()
+{
+	std::string rv;
+	for(int x = 0; x < 20; x++)
+		rv += "ascii text, caf\xc3\xa9, \xe2\x82\xac" "5, \xe4\xb8\xad\xe6\x96\x87, \xf0\x9f\x98\x80!";
+	return rv;
+}
+
+}
+
+TEST(Utf8Test, ValidAndInvalidSamples) {
+	const std::string valid[] = {
+		"", "hello", "\xc2\x80", "\xdf\xbf", "\xe0\xa0\x80", "\xed\x9f\xbf", "\xee\x80\x80",
+		"\xef\xbf\xbf", "\xf0\x90\x80\x80", "\xf4\x8f\xbf\xbf", sampleText()
+	};
+	const std::string invalid[] = {
+		"\x80", "\xbf", "\xc0\x80", "\xc1\xbf", "\xc2", "\xc2\x41", "\xe0\x80\x80", "\xe0\x9f\xbf",
+		"\xed\xa0\x80", "\xed\xbf\xbf", "\xe1\x80", "\xf0\x80\x80\x80", "\xf0\x8f\xbf\xbf",
+		"\xf4\x90\x80\x80", "\xf5\x80\x80\x80", "\xf8\x88\x80\x80\x80", "\xff", "\xc2\x80\x80",
+		"\xf0\x90\x80"
+	};
+
+	for(Utf8Implementation impl : IMPLEMENTATIONS)
+	{
+		// at every alignment and around block boundaries, with something after and not.
+		for(size_t pad = 0; pad < 70; pad++)
+		{
+			std::string before(pad, 'a');
+			for(const auto &each : valid)
+			{
+				EXPECT_TRUE(isValidUtf8(impl, (before + each).data(), pad + each.size())) << impl << " " << pad;
+				EXPECT_TRUE(isValidUtf8(impl, (before + each + "z").data(), pad + each.size() + 1)) << impl << " " << pad;
+			}
+			for(const auto &each : invalid)
+			{
+				ASSERT_TRUE(not referenceValid(each));
+				EXPECT_FALSE(isValidUtf8(impl, (before + each).data(), pad + each.size())) << impl << " " << pad;
+				EXPECT_FALSE(isValidUtf8(impl, (before + each + "z").data(), pad + each.size() + 1)) << impl << " " << pad;
+			}
+		}
+	}
+}
+
+TEST(Utf8Test, AllShortSequencesMatchReference) {
+	const uint8_t thirds[] = { 0x41, 0x80, 0x9f, 0xa0, 0xbf, 0xc2 };
+	for(Utf8Implementation impl : IMPLEMENTATIONS)
+	{
+		for(int first = 0x80; first < 0x100; first++)
+		{
+			for(int second = 0; second < 0x100; second++)
+			{
+				for(uint8_t third : thirds)
+				{
+					// straddling a 16 and 32 byte boundary
+					std::string s(30, 'x');
+					s.push_back(char(first));
+					s.push_back(char(second));
+					s.push_back(char(third));
+					s.push_back(char(0x80));
+					s += "tail";
+					ASSERT_EQ(isValidUtf8(impl, s.data(), s.size()), referenceValid(s)) << impl << " " << first << " " << second << " " << int(third);
+				}
+			}
+		}
+	}
+}
+
+TEST(Utf8Test, RandomCorruptionMatchesReference) {
+	std::string text = sampleText();
+	uint32_t state = 1;
+	auto next = [&] { state = state * 1103515245 + 12345; return state >> 8; };
+
+	for(int round = 0; round < 3000; round++)
+	{
+		std::string s = text.substr(next() % 40, 20 + next() % 300);
+		for(int edits = next() % 3; edits > 0; edits--)
+			s[next() % s.size()] = char(next());
+
+		bool expected = referenceValid(s);
+		for(Utf8Implementation impl : IMPLEMENTATIONS)
+			ASSERT_EQ(isValidUtf8(impl, s.data(), s.size()), expected) << impl << " round " << round;
+		ASSERT_EQ(isValidUtf8(s.data(), s.size()), expected);
+	}
+}
+
+TEST(Utf8Test, ValidatorAcrossPieces) {
+	std::string text = sampleText().substr(0, 200);
+	Utf8Validator validator;
+
+	for(size_t split = 0; split <= text.size(); split++)
+	{
+		EXPECT_TRUE(validator.update(text.data(), split));
+		EXPECT_TRUE(validator.update(text.data() + split, text.size() - split));
+		EXPECT_TRUE(validator.finish()) << split;
+	}
+
+	for(size_t x = 0; x < text.size(); x++)
+		ASSERT_TRUE(validator.update(text.data() + x, 1));
+	EXPECT_TRUE(validator.finish());
+
+	// unfinished at the end
+	EXPECT_TRUE(validator.update("ok \xe2\x82", 5));
+	EXPECT_FALSE(validator.finish());
+	EXPECT_TRUE(validator.finish()); // and it was reset
+
+	// split surrogate, and a bad continuation noticed before the character is done
+	EXPECT_TRUE(validator.update("\xed", 1));
+	EXPECT_FALSE(validator.update("\xa0\x80", 2));
+	EXPECT_FALSE(validator.update("fine", 4)); // stays invalid
+	EXPECT_FALSE(validator.finish());
+
+	EXPECT_TRUE(validator.update("\xf0\x9f", 2));
+	EXPECT_FALSE(validator.update("A", 1));
+	validator.reset();
+	EXPECT_TRUE(validator.update("\xf0\x9f", 2));
+	EXPECT_TRUE(validator.update("\x98", 1));
+	EXPECT_TRUE(validator.update("\x80", 1));
+	EXPECT_TRUE(validator.finish());
+}
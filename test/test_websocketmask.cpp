@@ -0,0 +1,95 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#include "zenomt/WebSocketMask.hpp"
+
+using namespace com::zenomt::websock;
+
+namespace {
+
+std::vector<uint8_t> referenceMask(const uint8_t *src, size_t len, const uint8_t *key, size_t offset)
+{
+	std::vector<uint8_t> rv;
+	for(size_t x = 0; x < len; x++)
+		rv.push_back(src[x] ^ key[(offset + x) % 4]);
+	return rv;
+}
+
+std::vector<uint8_t> makeInput(size_t len)
+{
+	std::vector<uint8_t> rv(len);
+	for(size_t x = 0; x < len; x++)
+		rv[x] = uint8_t(x * 31 + (x >> 8));
+	return rv;
+}
+
+const uint8_t KEY[4] = { 0x37, 0xfa, 0x21, 0x3d };
+
+}
+
+TEST(WebSocketMaskTest, RFC6455Example) {
+	// RFC 6455 §5.7, a masked "Hello"
+	const uint8_t key[4] = { 0x37, 0xfa, 0x21, 0x3d };
+	const uint8_t masked[5] = { 0x7f, 0x9f, 0x4d, 0x51, 0x58 };
+	uint8_t dst[5];
+	applyMask(dst, masked, sizeof(masked), key);
+	EXPECT_EQ(0, memcmp(dst, "Hello", 5));
+}
+
+TEST(WebSocketMaskTest, ScalarIsAlwaysSupported) {
+	EXPECT_TRUE(isMaskImplementationSupported(MASK_SCALAR));
+}
+
+TEST(WebSocketMaskTest, AllImplementationsMatchReference) {
+	const MaskImplementation impls[] = { MASK_SCALAR, MASK_SSE2, MASK_AVX2 };
+	auto input = makeInput(1024 + 64);
+
+	for(auto impl : impls)
+	{
+		if(not isMaskImplementationSupported(impl))
+			continue;
+
+		// every length up to a few vectors, at every alignment and key phase.
+		for(size_t len = 0; len < 200; len++)
+			for(size_t align = 0; align < 4; align++)
+				for(size_t offset = 0; offset < 4; offset++)
+				{
+					std::vector<uint8_t> dst(len + 8, 0xee);
+					applyMask(impl, dst.data() + align, input.data() + align, len, KEY, offset);
+					auto expected = referenceMask(input.data() + align, len, KEY, offset);
+					ASSERT_EQ(0, memcmp(dst.data() + align, expected.data(), len)) << "impl " << impl << " len " << len << " align " << align << " offset " << offset;
+					for(size_t x = align + len; x < dst.size(); x++)
+						ASSERT_EQ(dst[x], 0xee) << "wrote past end, impl " << impl << " len " << len;
+				}
+
+		std::vector<uint8_t> dst(1024);
+		applyMask(impl, dst.data(), input.data() + 3, 1024, KEY, 1);
+		EXPECT_EQ(dst, referenceMask(input.data() + 3, 1024, KEY, 1));
+	}
+}
+
+TEST(WebSocketMaskTest, InPlaceAndInPieces) {
+	auto input = makeInput(5000);
+	auto expected = referenceMask(input.data(), input.size(), KEY, 0);
+
+	auto inPlace = input;
+	applyMask(inPlace.data(), inPlace.data(), inPlace.size(), KEY);
+	EXPECT_EQ(inPlace, expected);
+
+	// odd-sized pieces, each picking up the key where the last left off.
+	auto pieces = input;
+	size_t offset = 0;
+	for(size_t each = 1; offset < pieces.size(); each = each * 3 + 1)
+	{
+		size_t len = std::min(each, pieces.size() - offset);
+		applyMask(pieces.data() + offset, pieces.data() + offset, len, KEY, offset);
+		offset += len;
+	}
+	EXPECT_EQ(pieces, expected);
+
+	// masking twice is the identity.
+	applyMask(inPlace.data(), inPlace.data(), inPlace.size(), KEY);
+	EXPECT_EQ(inPlace, input);
+}